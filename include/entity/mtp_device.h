@@ -26,7 +26,7 @@ extern "C" {
 #include "mtp_property.h"
 
 /*This number can be changed based on MAX number or stores allowed*/
-#define	MAX_NUM_DEVICE_STORES		1
+#define	MAX_NUM_DEVICE_STORES		MTP_MAX_STORAGES
 
 #define MTP_STANDARD_VERSION		0x64
 #define MTP_VENDOR_EXTN_ID		0x06
@@ -83,6 +83,8 @@ typedef struct {
 	/* Used when SendObjectInfo doesn't specify Parent Object Handle */
 	mtp_uint32 default_hparent;
 	mtp_bool is_mounted[MAX_NUM_DEVICE_STORES];
+	/* MTP_STORE_INDEX() of a store ID -> store_list index, -1 if none */
+	mtp_int32 store_index[MAX_NUM_DEVICE_STORES];
 } mtp_device_t;
 
 extern mtp_device_t *g_device;
@@ -110,6 +112,15 @@ mtp_uint32 _get_device_info_size(void);
  */
 mtp_uint32 _pack_device_info(mtp_uchar *buf, mtp_uint32 buf_sz);
 
+/*
+ * mtp_bool _get_packed_device_info(mtp_uchar **blk, mtp_uint32 *blk_len)
+ * This function gives the DeviceInfo data block packed at init time.
+ * @param[out]	blk	data block for _hdlr_set_prebuilt_data_container()
+ * @param[out]	blk_len	size of the data block
+ * @return	TRUE if the block is there, otherwise FALSE.
+ */
+mtp_bool _get_packed_device_info(mtp_uchar **blk, mtp_uint32 *blk_len);
+
 /*
  * void _reset_mtp_device()
  * This functions resets device state to IDLE/Command Ready
@@ -119,25 +130,76 @@ void _reset_mtp_device(void);
 
 /*
  * mtp_bool _device_install_storage(void)
- * This function add the storage.
+ * This function adds the configured storages that are not mounted yet.
  * @return	If success, returns TRUE. Otherwise returns FALSE.
  */
 mtp_bool _device_install_storage(void);
 
 /* mtp_bool _device_uninstall_storage(void)
- * This function removes the storage.
+ * This function removes all the storages.
  * @return	If success, returns TRUE. Otherwise returns FALSE.
  */
 mtp_bool _device_uninstall_storage(void);
 
+/*
+ * void _device_enumerate_stores(void)
+ * This function starts one thread per store, which restores its snapshot
+ * and lists its root. A store is shown to the host once its snapshot is
+ * restored, independently of the others.
+ * @return	none
+ */
+void _device_enumerate_stores(void);
+
+/*
+ * void _device_save_store_snapshots(void)
+ * This function writes a snapshot of each store changed since the last one.
+ * It takes the store lock itself, which must not be held by the caller.
+ * @return	none
+ */
+void _device_save_store_snapshots(void);
+
+/*
+ * void _device_refresh_store_space(void)
+ * This function updates the free space of the stores from the filesystem.
+ * It takes the store lock itself, and must be called without it.
+ * @return	none
+ */
+void _device_refresh_store_space(void);
+
+/*
+ * void _device_resync_stores(void)
+ * This function checks the stores against the filesystem after an event
+ * queue overflow. It takes the store lock itself, and must be called
+ * without it.
+ * @return	none
+ */
+void _device_resync_stores(void);
+
+/*
+ * void _device_set_store_space_dirty(const mtp_char *path)
+ * This function marks the free space of the store holding path as stale.
+ * @param[in]	path	Path changed outside MTP
+ * @return	none
+ */
+void _device_set_store_space_dirty(const mtp_char *path);
+
 /*
  * mtp_store_t *_device_get_store(mtp_uint32 store_id)
  * This function will get the store with store_id.
  * @param[in]	store_id	ID of the store
- * @return	the pointer to the store with store ID, otherwise NULL.
+ * @return	the pointer to the store with store ID if it is ready,
+ *		otherwise NULL.
  */
 mtp_store_t *_device_get_store(mtp_uint32 store_id);
 
+/*
+ * mtp_store_t *_device_get_store_by_path(const mtp_char *path)
+ * This function gets the store holding path, ready or still loading.
+ * @param[in]	path	Full path of a file or folder
+ * @return	the pointer to the store, otherwise NULL.
+ */
+mtp_store_t *_device_get_store_by_path(const mtp_char *path);
+
 /*
  * mtp_uint32 _device_get_store_ids(ptp_array_t *store_ids)
  * This function returns a list of storage ID's of all stores in the device.
@@ -29,6 +29,7 @@ extern "C" {
 	(4 * sizeof(mtp_uint16) + 11 * sizeof(mtp_uint32))
 
 #define MAX_SIZE_IN_BYTES_OF_OBJECT_INFO	(4000*8)
+#define MAX_SIZE_IN_BYTES_OF_PROP_LIST	(4000*8)
 
 /*
  * obj_info_t structure : Contains object metadata related information
@@ -45,6 +46,9 @@ typedef struct {
 	mtp_uint16 association_type;	/* association type */
 } obj_info_t;
 
+struct _obj_prop_val;
+struct _obj_info_cache;
+
 /*
  * mtp_obj_t structure : Contains object related information
  * Gets created for each enumerated file/dir on the device
@@ -55,7 +59,15 @@ typedef struct {
 	obj_info_t *obj_info;
 	mtp_char *file_path;
 	ptp_array_t child_array;	/* Include all the renferences */
-	slist_t propval_list;	/* Object Properties implemented */
+	ptp_array_t children;	/* Handles of direct children, in add order */
+	mtp_uint32 generation;	/* Changes whenever children does */
+	mtp_bool is_enumerated;	/* Folder contents have been scanned */
+	mtp_int64 dir_mtime;	/* Folder mtime in ns when it was scanned */
+	mtp_uint64 dev;		/* Identity of the file, 0 if unknown */
+	mtp_uint64 ino;
+	mtp_uint64 guid[2];	/* PersistentUniqueObjectIdentifier */
+	struct _obj_prop_val **propvals;	/* Property values, built on demand */
+	struct _obj_info_cache *info_cache;	/* Packed ObjectInfo, or NULL */
 } mtp_obj_t;
 
 mtp_bool _entity_get_file_times(mtp_obj_t *obj, ptp_time_string_t *create_tm,
@@ -70,6 +82,9 @@ mtp_uint32 _entity_parse_raw_obj_info(mtp_uchar *buf, mtp_uint32 buf_sz,
 void _entity_copy_obj_info(obj_info_t *dst, obj_info_t *src);
 mtp_uint32 _entity_pack_obj_info(mtp_obj_t *obj, ptp_string_t *file_name,
 		mtp_uchar *buf, mtp_uint32 buf_sz);
+mtp_bool _entity_get_packed_obj_info(mtp_obj_t *obj, mtp_uchar **data,
+		mtp_uint32 *data_sz);
+void _entity_invalidate_obj_info(mtp_obj_t *obj);
 #define _entity_dealloc_obj_info(info) g_free(info)
 #define _entity_alloc_mtp_object(...) (((mtp_obj_t *)g_malloc(sizeof(mtp_obj_t))))
 mtp_bool _entity_init_mtp_object_params(
@@ -81,6 +96,7 @@ mtp_bool _entity_init_mtp_object_params(
 		dir_entry_t *file_info);
 mtp_bool _entity_set_object_file_path(mtp_obj_t *obj, void *file_path,
 		char_mode_t char_type);
+mtp_bool _entity_refresh_object_identity(mtp_obj_t *obj);
 mtp_bool _entity_check_child_obj_path(mtp_obj_t *obj, mtp_char *src_path,
 		mtp_char *dest_path);
 mtp_bool _entity_set_child_object_path(mtp_obj_t *obj, mtp_char *src_path,
@@ -66,25 +66,12 @@ enum {
 #define MTP_PROP_GROUPCODE_OBJECT	GROUP_CODE_OFTEN_USED
 #define MTP_PROP_GROUPCODE_ALBUMART	GROUP_CODE_OFTEN_USED
 
-#define node_alloc_and_append()\
-	do {\
-		mtp_bool ret;\
-		ret = _util_add_node(&(obj->propval_list), (void *)prop_val);\
-		if (FALSE == ret) {\
-			_prop_destroy_obj_propval(prop_val);\
-			ERR("_util_add_node() Fail\n");\
-			return (FALSE);\
-		} \
-	} while (0);
-
-#define propvalue_alloc_and_check(prop_val)\
-	do {\
-		prop_val = _prop_alloc_obj_propval(prop);\
-		if (prop_val == NULL) {\
-			ERR("prop_val == NULL\n");\
-			return (FALSE);\
-		} \
-	} while (0);
+/* Which cached property values of an object a change makes stale */
+enum {
+	PROP_CACHE_PATH = 0x01,		/* file name, name */
+	PROP_CACHE_CONTENT = 0x02,	/* creation/modification dates */
+	PROP_CACHE_ALL = 0xFF
+};
 
 #define init_default_value(value)\
 	do {\
@@ -111,7 +98,7 @@ typedef struct {
 	union {
 		mtp_uchar integer[16];	/* Default value for any integer value
 								   type (UINT8, mtp_uint16, mtp_uint32) */
-		ptp_string_t *str;	/* Default value for String type */
+		ptp_vstring_t *str;	/* Default value for String type */
 		ptp_array_t *array;	/* Default array */
 	} default_val;		/* Default value */
 } prop_info_t;
@@ -122,7 +109,7 @@ typedef struct {
 	union {
 		mtp_uchar integer[16];	/* Current value for any integer value
 								   type (UINT8, mtp_uint16, mtp_uint32) */
-		ptp_string_t *str;	/* Current value for String type */
+		ptp_vstring_t *str;	/* Current value for String type */
 		ptp_array_t *array;	/* Current value for array data type
 							   (AINT8, AUINT8) */
 	} current_val;                      /*Current value */
@@ -133,35 +120,32 @@ typedef struct {
 	prop_info_t propinfo;
 	mtp_uint32 group_code;	/* Identifies the group of this property */
 	union {
-		ptp_string_t *reg_exp;  /* Regular Expression Form */
+		ptp_vstring_t *reg_exp;  /* Regular Expression Form */
 		mtp_uint32 max_len; /* LongString Form */
 	} prop_forms;            /*Object property-specific forms */
 } obj_prop_desc_t;
 
 /* This structure contains current value of a object property */
-typedef struct {
+typedef struct _obj_prop_val {
 	obj_prop_desc_t *prop;
 	union {
 		mtp_uchar integer[16];	/* Current value for any integer */
-		ptp_string_t *str;	/* Current value for String type */
+		ptp_vstring_t *str;	/* Current value for String type */
 		ptp_array_t *array;
 	} current_val;
 } obj_prop_val_t;
 
-/* This structure defines ObjectPropQuad for GetObjectPropList */
-typedef struct {
-	mtp_uint32 obj_handle;
-	mtp_uint16 prop_code;
-	mtp_uint16 data_type;
-	mtp_uchar *pval;
-	mtp_uint32 val_size;	/* a useful helper,
-							   not part of the Object Property Quadruple */
-} prop_quad_t;
+/* ObjectHandle, PropertyCode and Datatype of an ObjectPropList element */
+#define PROP_QUAD_HEADER_SIZE \
+	(sizeof(mtp_uint32) + sizeof(mtp_uint16) + sizeof(mtp_uint16))
 
-/* This structure contains a list of MTP Object properties */
-typedef struct {
-	slist_t prop_quad_list;
-} obj_proplist_t;
+/* Fits any quadruple whose value is at most a full-length PTP string */
+#define PROP_QUAD_BUF_SIZE \
+	(PROP_QUAD_HEADER_SIZE + 1 + MAX_PTP_STRING_CHARS * sizeof(mtp_wchar))
+
+/* Receives the ObjectPropList bytes as they are packed */
+typedef mtp_bool (*prop_list_writer_t)(void *data, mtp_uchar *buf,
+		mtp_uint32 size);
 
 /* This structure contains a list of InterdependentProperties  */
 typedef struct {
@@ -200,12 +184,20 @@ mtp_uint32 _prop_pack_ptptimestring(ptp_time_string_t *pstring, mtp_uchar *buf,
 		mtp_uint32 size);
 mtp_uint32 _prop_parse_rawstring(ptp_string_t *pstring, mtp_uchar *buf,
 		mtp_uint32 size);
+ptp_vstring_t *_prop_alloc_ptpvstring(ptp_string_t *src);
+ptp_vstring_t *_prop_ref_ptpvstring(ptp_vstring_t *vstr);
+void _prop_unref_ptpvstring(ptp_vstring_t *vstr);
+mtp_uint32 _prop_size_ptpvstring(ptp_vstring_t *vstr);
+mtp_uint32 _prop_pack_ptpvstring(ptp_vstring_t *vstr, mtp_uchar *buf,
+		mtp_uint32 size);
 
 /*
  * ObjectPropVal Functions
  */
 obj_prop_val_t *_prop_alloc_obj_propval(obj_prop_desc_t *prop);
-obj_prop_val_t *_prop_get_prop_val(mtp_obj_t *obj, mtp_uint32 prop_code);
+mtp_bool _prop_get_prop_val(mtp_obj_t *obj, mtp_uint32 prop_code,
+		obj_prop_val_t *pval);
+void _prop_invalidate_obj_propvals(mtp_obj_t *obj, mtp_uint32 flags);
 mtp_uint32 _prop_size_obj_propval(obj_prop_val_t *val);
 void _prop_destroy_obj_propval(obj_prop_val_t *pval);
 mtp_bool _prop_set_default_integer(prop_info_t *prop_info, mtp_uchar *value);
@@ -234,15 +226,20 @@ obj_prop_desc_t *_prop_get_obj_prop_desc(mtp_uint32 format_code,
 /*
  * ObjectProplist Functions
  */
-mtp_bool _prop_update_property_values_list(mtp_obj_t *obj);
-mtp_uint32 _prop_get_obj_proplist(mtp_obj_t *pObject, mtp_uint32 prop_code,
-		mtp_uint32 group_code, obj_proplist_t *prop_list);
+mtp_uint32 _prop_size_obj_proplist(mtp_obj_t *obj, mtp_uint32 prop_code,
+		mtp_uint32 group_code, mtp_uint64 *size);
+mtp_bool _prop_write_obj_proplist(mtp_obj_t *obj, mtp_uint32 prop_code,
+		mtp_uint32 group_code, prop_list_writer_t writer, void *data);
 /*
  * ObjectProp Functions
  */
 mtp_uint32 _prop_get_supp_obj_props(mtp_uint32 format_code,
 		ptp_array_t *supp_props);
 mtp_bool _prop_build_supp_props_default(void);
+mtp_bool _prop_get_packed_obj_prop_desc(mtp_uint32 format_code,
+		mtp_uint32 propcode, mtp_uchar **blk, mtp_uint32 *blk_len);
+mtp_bool _prop_get_packed_interdep_proplist(mtp_uchar **blk,
+		mtp_uint32 *blk_len);
 
 /*
  *Interdependent Prop Functions
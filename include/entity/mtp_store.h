@@ -22,6 +22,7 @@
 extern "C" {
 #endif
 
+#include <glib.h>
 #include "mtp_object.h"
 
 
@@ -53,6 +54,21 @@ typedef struct {
 	mtp_uint32 store_id;
 	store_info_t store_info;
 	slist_t obj_list;
+	GHashTable *handle_index;	/* obj_handle -> mtp_obj_t */
+	GHashTable *shadowed_index;	/* obj_handle -> GSList of older duplicates */
+	GHashTable *path_index;	/* file_path -> mtp_obj_t */
+	GHashTable *format_index;	/* obj_fmt -> ptp_array_t of handles */
+	ptp_array_t root_children;	/* Handles of objects under the root */
+	mtp_uint32 root_generation;	/* Changes whenever root_children does */
+	mtp_uint32 generation;	/* Changes on every add/detach in the store */
+	GHashTable *handles_cache;	/* Packed GetObjectHandles results */
+	mtp_bool is_root_enumerated;	/* Root folder contents have been scanned */
+	mtp_int64 root_mtime;	/* Root folder mtime in ns when it was scanned */
+	mtp_uint32 saved_generation;	/* generation when the snapshot was written */
+	mtp_uint64 reserved_space;	/* Announced by SendObjectInfo, not yet written */
+	gint is_space_dirty;	/* Changed outside MTP, refresh free space. Atomic */
+	mtp_int64 space_time;	/* Monotonic time of the last free space refresh */
+	mtp_bool is_ready;	/* Snapshot restored, shown to the host */
 	mtp_bool is_hidden;	/*for hidden storage*/
 } mtp_store_t;
 
@@ -66,19 +82,32 @@ typedef enum {
 	MTP_EXTERNAL_STORE_ID = 0x20001
 } mtp_store_id_t;
 
+/* Store ID of the n-th configured storage, and back */
+#define MTP_STORE_ID(n)		((mtp_uint32)(MTP_EXTERNAL_STORE_ID + ((n) << 16)))
+#define MTP_STORE_INDEX(id)	((mtp_int32)(((id) - MTP_EXTERNAL_STORE_ID) >> 16))
+
 void _entity_update_store_info_run_time(store_info_t *info,
 		mtp_char *root_path);
+void _entity_update_store_free_space(mtp_store_t *store, mtp_int64 delta);
+void _entity_reserve_store_space(mtp_store_t *store, mtp_uint64 size);
+void _entity_release_store_space(mtp_store_t *store, mtp_uint64 size,
+		mtp_bool is_written);
+void _entity_set_store_space(mtp_store_t *store, mtp_uint64 capacity,
+		mtp_uint64 avail_size);
 mtp_uint32 _entity_get_store_info_size(store_info_t *info);
 mtp_uint32 _entity_pack_store_info(store_info_t *info, mtp_uchar *buf,
 		mtp_uint32 buf_sz);
 mtp_uint32 _entity_get_store_id_by_path(const mtp_char *path_name);
 mtp_bool _entity_init_mtp_store(mtp_store_t *store, mtp_uint32 store_id,
-		mtp_char *store_path);
+		mtp_char *store_path, const mtp_char *store_desc);
 mtp_obj_t *_entity_add_file_to_store(mtp_store_t *store, mtp_uint32 h_parent,
 		mtp_char *file_path, mtp_char *file_name, dir_entry_t *file_info);
 mtp_obj_t *_entity_add_folder_to_store(mtp_store_t *store, mtp_uint32 h_parent,
 		mtp_char *file_path, mtp_char *file_name, dir_entry_t *file_info);
 mtp_bool _entity_add_object_to_store(mtp_store_t *store, mtp_obj_t *obj);
+mtp_bool _entity_detach_object_from_store(mtp_store_t *store, mtp_obj_t *obj);
+mtp_bool _entity_set_object_path_in_store(mtp_store_t *store, mtp_obj_t *obj,
+		mtp_char *file_path);
 mtp_obj_t *_entity_get_object_from_store(mtp_store_t *store, mtp_uint32 handle);
 mtp_obj_t *_entity_get_last_object_from_store(mtp_store_t *store,
 		mtp_uint32 handle);
@@ -106,7 +135,21 @@ mtp_bool _entity_check_if_B_parent_of_A(mtp_store_t *store,
 void _entity_destroy_mtp_store(mtp_store_t *store);
 void _entity_store_recursive_enum_folder_objects(mtp_store_t *store,
 		mtp_obj_t *pobj);
+void _entity_store_enum_folder_objects(mtp_store_t *store, mtp_obj_t *pobj);
+void _entity_store_prefetch_root(mtp_store_t *store);
+void _entity_store_resync(mtp_store_t *store);
 void _entity_copy_store_data(mtp_store_t *dst, mtp_store_t *src);
+GByteArray *_entity_pack_store_snapshot(mtp_store_t *store);
+mtp_bool _entity_write_store_snapshot(mtp_uint32 store_id,
+		const GByteArray *snapshot);
+mtp_bool _entity_load_store_snapshot(mtp_store_t *store);
+void _entity_clear_previous_handles(void);
+mtp_uint32 _entity_take_previous_handle(const mtp_char *file_path,
+		mtp_uint64 dev, mtp_uint64 ino);
+mtp_bool _entity_get_cached_handles(mtp_store_t *store, mtp_uint32 h_parent,
+		mtp_uint32 format, mtp_uchar **data, mtp_uint32 *data_sz);
+void _entity_cache_handles(mtp_store_t *store, mtp_uint32 h_parent,
+		mtp_uint32 format, mtp_uchar *data, mtp_uint32 data_sz);
 
 #ifdef __cplusplus
 }
@@ -29,7 +29,6 @@ typedef struct {
 	mtp_obj_t *obj;
 } obj_data_t;
 
-mtp_err_t _hutil_get_prop_desc(mtp_uint32 format, mtp_uint32 prop_code, void *data);
 mtp_err_t _hutil_get_storage_entry(mtp_uint32 store_id, store_info_t *info);
 mtp_err_t _hutil_get_storage_ids(ptp_array_t *store_ids);
 mtp_err_t _hutil_add_object_entry(obj_info_t *obj_info, mtp_char *file_name,
@@ -47,9 +46,22 @@ mtp_err_t _hutil_get_object_entry_size(mtp_uint32 obj_handle, mtp_uint64 *obj_sz
 mtp_err_t _hutil_set_protection(mtp_uint32 obj_handle, mtp_uint16 prot_status);
 mtp_err_t _hutil_get_object_handles(mtp_uint32 store_id, mtp_uint32 format,
 		mtp_uint32 h_parent, ptp_array_t *handle_arr);
+mtp_bool _hutil_get_cached_object_handles(mtp_uint32 store_id,
+		mtp_uint32 format, mtp_uint32 h_parent, mtp_uchar **data,
+		mtp_uint32 *data_sz);
+void _hutil_cache_object_handles(mtp_uint32 store_id, mtp_uint32 format,
+		mtp_uint32 h_parent, mtp_uchar *data, mtp_uint32 data_sz);
+mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
+		mtp_uint32 prop_code, mtp_uint32 group_code, mtp_uint32 depth,
+		GPtrArray *objs);
 mtp_err_t _hutil_construct_object_entry(mtp_uint32 store_id, mtp_uint32 h_parent,
 		obj_data_t *objdata, mtp_obj_t **obj, void *data, mtp_uint32 data_sz);
 
+mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
+		mtp_uint32 h_parent, mtp_uint16 format, mtp_uint64 obj_sz,
+		obj_data_t *obj_data, mtp_obj_t **obj_ptr, void *data,
+		mtp_int32 data_sz, mtp_uint32 *err_idx);
+
 mtp_err_t _hutil_get_interdep_prop_config_list_size(mtp_uint32 *list_sz,
 		mtp_uint32 format);
 mtp_err_t _hutil_get_interdep_prop_config_list_data(void *data,
@@ -44,15 +44,37 @@
  */
 #define MTP_SEND_ZLP_FROM_GET_PARTIAL_OBJECT
 
-/* External Storage */
+/* External Storage, the only storage unless others are configured */
 #define MTP_EXTERNAL_PATH_CHAR		"/media/card"
 
+/* Storages exposed at once, each one from a "storage" config entry */
+#define MTP_MAX_STORAGES		8
+
 /*STORAGE*/
 #define MTP_MAX_STORAGE			(30*1024*1024)	/*30MB */
 #define MTP_MAX_STORAGE_IN_OBJTS	0xFFFFFFFF
 
 #define MTP_BUF_SIZE_FOR_INT		11      /* 2^32 - 1 = 4294967295 (10 digits) */
 
+/* Packed GetObjectHandles results kept per store */
+#define MTP_MAX_HANDLES_CACHE_ENTRIES	512
+
+/* Bytes of packed ObjectInfo datasets kept for GetObjectInfo */
+#define MTP_MAX_OBJECT_INFO_CACHE_SIZE	(1024 * 1024)
+
+/* Object table snapshots of the stores */
+#define MTP_SNAPSHOT_DIR		"/var/lib/cmtp-responder"
+#define MTP_SNAPSHOT_INTERVAL		300	/* seconds */
+
+/* Free space refresh: stale stores are checked every second, all stores
+ * every MTP_SPACE_REFRESH_INTERVAL
+ */
+#define MTP_SPACE_REFRESH_CHECK		1	/* seconds */
+#define MTP_SPACE_REFRESH_INTERVAL	60	/* seconds */
+
+/* Waits for the store lock longer than this are logged */
+#define MTP_LOCK_WAIT_WARN_MS		50
+
 #define MTP_STORAGE_DESC_EXT		"Card Storage"
 
 /* about 976kbytes for object property value like sample data*/
@@ -99,6 +121,10 @@
 #define MTP_MAX_TX_IPC_SIZE	262144
 #define MTP_MAX_IO_BUF_SIZE	10485760	/* 10MB */
 #define MTP_READ_FILE_DELAY	0		/* us */
+#define MTP_SCAN_THREADS	0		/* 0 : one per online CPU */
+#define MTP_MAX_SCAN_THREADS	8
+#define MTP_GUID_FROM_INODE	false
+#define MTP_USE_FANOTIFY	false
 
 #define MTP_SUPPORT_PTHREAD_SCHED	false
 #define MTP_INHERITSCHED		'i'
@@ -107,6 +133,15 @@
 #define MTP_USB_SCHEDPARAM		0
 
 typedef struct {
+	char path[MTP_MAX_PATHNAME_SIZE + 1];	/* Root folder, no trailing slash */
+	char desc[MTP_MAX_REG_STRING + 1];	/* StorageDescription shown to the host */
+} mtp_storage_conf_t;
+
+typedef struct {
+	/* Storages, in store ID order */
+	int num_storages;
+	mtp_storage_conf_t storages[MTP_MAX_STORAGES];
+
 	/* Speed related config */
 	int mmap_threshold;	/* Max. 512KB. If requested memory is lesser than this, malloc is used. Otherwise, mmap is used */
 
@@ -125,6 +160,8 @@ typedef struct {
 
 	int read_file_delay;
 
+	int scan_threads;	/* Threads reading directories in a full storage scan */
+
 	/* Experimental */
 	bool support_pthread_sched;
 	char inheritsched;	/* i : Inherit, e : Explicit */
@@ -136,6 +173,8 @@ typedef struct {
 	/* Speed related config (End) */
 
 	/* MTP Features */
+	bool guid_from_inode;	/* PersistentUniqueObjectIdentifier from (dev, inode), kept across renames */
+	bool use_fanotify;	/* One fanotify mark per storage filesystem instead of inotify watches */
 	/* MTP Features (End) */
 
 	/* Vendor Features */
@@ -28,7 +28,9 @@ extern "C" {
 
 typedef enum {
 	USB_INSERTED,
-	USB_REMOVED
+	USB_REMOVED,		/* Service stops */
+	USB_DISCONNECTED,	/* Host gone, service kept for reconnection */
+	USB_CONNECTED		/* Host back after USB_DISCONNECTED */
 } usb_state_t;
 
 typedef struct {
@@ -43,8 +45,11 @@ typedef enum {
 	EVENT_START_MAIN_OP,
 	EVENT_CLOSE,
 	EVENT_USB_REMOVED,
+	EVENT_USB_DISCONNECTED,
+	EVENT_USB_CONNECTED,
 	EVENT_OBJECT_ADDED,
 	EVENT_OBJECT_REMOVED,
+	EVENT_STORE_ADDED,
 	EVENT_START_DATAIN,
 	EVENT_DONE_DATAIN,
 	EVENT_START_DATAOUT,
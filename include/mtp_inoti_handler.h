@@ -27,25 +27,27 @@ extern "C" {
 #include "mtp_config.h"
 #ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
 #include <limits.h>
 #include "mtp_datatype.h"
 
 #define INOTI_EVENT_SIZE	(sizeof(struct inotify_event))
 #define INOTI_BUF_LEN		(INOTI_EVENT_SIZE + NAME_MAX + 1)
-#define INOTI_FOLDER_COUNT_MAX	(1024)
+#define INOTI_MAX_USER_WATCHES_PATH	"/proc/sys/fs/inotify/max_user_watches"
+
+/* fanotify reporting directory and name needs Linux 5.9 headers */
+#ifdef FAN_REPORT_DFID_NAME
+#define INOTI_SUPPORT_FANOTIFY
+#define FANOTI_BUF_LEN		8192
+#define FANOTI_EVENT_MASK	(FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | \
+		FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR)
+#endif /* FAN_REPORT_DFID_NAME */
 
 typedef struct {
 	mtp_int32 wd;
 	mtp_char *forlder_name;
 } inoti_watches_t;
 
-typedef struct _open_files_info {
-	mtp_char *name;
-	mtp_int32 wd;
-	struct _open_files_info* previous;
-	struct _open_files_info* next;
-} open_files_info_t;
-
 void *_thread_inoti(void *arg);
 void _inoti_add_watch_for_fs_events(mtp_char *path);
 mtp_bool _inoti_init_filesystem_evnts();
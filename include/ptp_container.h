@@ -89,6 +89,9 @@ void _hdlr_init_data_container(data_container_t *dst, mtp_uint16 code,
 		mtp_uint32 trans_id);
 mtp_uchar *_hdlr_alloc_buf_data_container(data_container_t *dst,
 		mtp_uint32 bufsz, mtp_uint64 pkt_size);
+mtp_uchar *_hdlr_alloc_prebuilt_data(mtp_uint32 bufsz, mtp_uint32 *blk_len);
+void _hdlr_set_prebuilt_data_container(data_container_t *dst,
+		mtp_uchar *blk, mtp_uint32 blk_len);
 mtp_bool _hdlr_send_data_container(data_container_t *dst);
 mtp_bool _hdlr_send_bulk_data(mtp_uchar *dst, mtp_uint32 len);
 mtp_bool _hdlr_rcv_data_container(data_container_t *dst, mtp_uint32 size);
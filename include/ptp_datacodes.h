@@ -149,6 +149,8 @@
 #define	MTP_OPCODE_GETOBJECTPROPDESC		0x9802
 #define	MTP_OPCODE_GETOBJECTPROPVALUE		0x9803
 #define	MTP_OPCODE_SETOBJECTPROPVALUE		0x9804
+#define	MTP_OPCODE_GETOBJECTPROPLIST		0x9805
+#define	MTP_OPCODE_SENDOBJECTPROPLIST		0x9808
 #define MTP_OPCODE_GETINTERDEPPROPDESC		0x9807
 
 /* Operation for Windows Media 10 MTP extension */
@@ -168,6 +170,8 @@
 #define PTP_EVENTCODE_CANCELTRANSACTION		0x4001
 #define PTP_EVENTCODE_OBJECTADDED		0x4002
 #define PTP_EVENTCODE_OBJECTREMOVED		0x4003
+#define PTP_EVENTCODE_STOREADDED		0x4004
+#define PTP_EVENTCODE_STOREREMOVED		0x4005
 #define PTP_EVENTCODE_DEVICEPROPCHANGED		0x4006
 #define PTP_EVENTCODE_OBJECTINFOCHANGED		0x4007
 #define PTP_EVENTCODE_DEVICEINFOCHANGED		0x4008
@@ -773,4 +777,17 @@ typedef struct {
 	mtp_wchar str[MAX_PTP_TIME_STRING_CHARS];
 } ptp_time_string_t;
 
+/*
+ * PTP string allocated to the size of its contents, for values kept in
+ * property descriptions and object properties. A string is shared by
+ * taking a reference instead of copying it.
+ */
+typedef struct {
+	mtp_int32 ref_count;
+	/* Num of chars in string including the NUL */
+	mtp_uchar num_chars;
+	/* num_chars Unicode chars, '\0' terminated */
+	mtp_wchar str[];
+} ptp_vstring_t;
+
 #endif /* _PTP_DATACODES_H_ */
@@ -49,6 +49,8 @@ mtp_uint32 _transport_send_bulk_pkt_to_tx_mq(const mtp_byte *buf,
 		mtp_uint32 pkt_len);
 void _transport_send_zlp(void);
 mtp_bool _transport_init_interfaces(_cmd_handler_cb func);
+void _transport_suspend_interfaces(void);
+mtp_bool _transport_resume_interfaces(void);
 void _transport_usb_finalize(void);
 void _transport_init_status_info(void);
 
@@ -28,6 +28,7 @@ extern "C" {
 #define MTP_FILE_ATTR_INVALID		0xFFFFFFFF
 #define MTP_LOG_FILE			"/var/log/mtp.log"
 #define MTP_LOG_MAX_SIZE		5 * 1024 * 1024 /*5MB*/
+#define MTP_DIR_BUF_SIZE		(32 * 1024)	/* getdents64 batch */
 
 typedef enum {
 	MTP_FILE_TYPE = 0,
@@ -48,6 +49,8 @@ typedef struct {
 	mtp_uint64 fsize;
 	time_t ctime;  /* created time */
 	time_t mtime;	/* modified time */
+	mtp_uint64 dev;	/* device and inode, the identity of the file */
+	mtp_uint64 ino;
 } file_attr_t;
 
 typedef struct {
@@ -56,11 +59,24 @@ typedef struct {
 	file_attr_t attrs;
 } dir_entry_t;
 
+/* Directory stream read by _util_ifind_first() and _util_ifind_next() */
+typedef struct {
+	mtp_uint64 buf[MTP_DIR_BUF_SIZE / sizeof(mtp_uint64)];	/* dirent64 records */
+	mtp_int32 fd;
+	mtp_int32 buf_len;	/* Bytes filled by the last getdents64 */
+	mtp_int32 buf_pos;	/* Offset of the next record in buf */
+	mtp_int32 error;	/* errno of a failed read, 0 at the end of the stream */
+	mtp_int64 mtime;	/* Of the directory when it was opened, in ns */
+} mtp_dir_t;
+
 typedef enum {
 	MTP_FILE_READ = 0x1,
 	MTP_FILE_WRITE = 0x2,
 } file_mode_t;
 
+/* Called by _util_remove_dir_children_notify() */
+typedef void (*remove_cb_t)(const mtp_char *name, void *user_data);
+
 typedef struct {
 	mtp_uint64 disk_size;
 	mtp_uint64 avail_size;
@@ -85,8 +101,12 @@ mtp_bool _util_set_file_attrs(const mtp_char *filename, mtp_dword attrs);
 mtp_bool _util_dir_create(const mtp_char *dirname, mtp_int32 *error);
 mtp_int32 _util_remove_dir_children_recursive(const mtp_char *dirname,
 		mtp_uint32 *num_of_deleted_file, mtp_uint32 *num_of_file, mtp_bool readonly);
-mtp_bool _util_ifind_next(char *dir_name, DIR *dirp, dir_entry_t *dir_info);
-mtp_bool _util_ifind_first(char *dir_name, DIR **dirp, dir_entry_t *dir_info);
+mtp_int32 _util_remove_dir_children_notify(const mtp_char *dirname,
+		mtp_uint32 *num_of_deleted_file, mtp_uint32 *num_of_file,
+		mtp_bool readonly, remove_cb_t done_cb, void *user_data);
+mtp_bool _util_ifind_next(char *dir_name, mtp_dir_t *dirp, dir_entry_t *dir_info);
+mtp_bool _util_ifind_first(char *dir_name, mtp_dir_t **dirp, dir_entry_t *dir_info);
+void _util_ifind_close(mtp_dir_t *dirp);
 mtp_bool _util_is_file_opened(const mtp_char *fullpath);
 mtp_bool _util_get_filesystem_info(mtp_char *storepath, fs_info_t *fs_info);
 void _FLOGD(const char *file, const char *fmt, ...);
@@ -57,7 +57,7 @@ mtp_bool _util_is_path_len_valid(const mtp_char *path);
 mtp_bool _util_create_path(mtp_char *path, mtp_uint32 size, const mtp_char *dir,
 		const mtp_char *filename);
 void _util_get_parent_path(const mtp_char *fullpath, mtp_char *p_path);
-void _util_conv_wstr_to_guid(mtp_wchar *wstr, mtp_uint64 *guid);
+void _util_get_guid(const void *data, mtp_uint32 size, mtp_uint64 *guid);
 mtp_bool _util_get_unique_dir_path(const mtp_char *exist_path, mtp_char *new_path,
 		mtp_uint32 new_path_buf_len);
 
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <glib.h>
 #include "mtp_datatype.h"
 #include "mtp_util.h"
 
@@ -55,6 +56,44 @@ typedef void *(*thread_func_t) (void *pArg);
 		} \
 	} while (0);\
 
+/*
+ * Reader/writer lock of the stores. Lookups take it shared, changes to
+ * the stores take it exclusive. Unlike the old command mutex it is not
+ * recursive for writers.
+ */
+#define UTIL_READ_LOCK(rw)\
+	do {\
+		int lock_ret = 0;\
+		mtp_int64 lock_start = g_get_monotonic_time();\
+		lock_ret = pthread_rwlock_rdlock(rw);\
+		if (lock_ret != 0)\
+			ERR("Error read locking. Error = %d\n", lock_ret);\
+		else\
+			_util_note_lock_wait(__func__, lock_start);\
+	} while (0);\
+
+
+#define UTIL_WRITE_LOCK(rw)\
+	do {\
+		int lock_ret = 0;\
+		mtp_int64 lock_start = g_get_monotonic_time();\
+		lock_ret = pthread_rwlock_wrlock(rw);\
+		if (lock_ret != 0)\
+			ERR("Error write locking. Error = %d\n", lock_ret);\
+		else\
+			_util_note_lock_wait(__func__, lock_start);\
+	} while (0);\
+
+
+#define UTIL_RW_UNLOCK(rw)\
+	do {\
+		int unlock_ret = 0;\
+		unlock_ret = pthread_rwlock_unlock(rw);\
+		if (unlock_ret != 0)\
+			ERR("Error unlocking rwlock. Error = %d\n", unlock_ret);\
+	} while (0);\
+
+void _util_note_lock_wait(const mtp_char *who, mtp_int64 start);
 mtp_bool _util_thread_create(pthread_t *tid, const mtp_char *tname,
 		mtp_int32 thread_state, thread_func_t thread_func, void *arg);
 mtp_bool _util_thread_join(pthread_t tid, void **data);
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2019 Collabora Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MTP_UTF_H_
+#define _MTP_UTF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mtp_datatype.h"
+
+/*
+ * UTF-8/UTF-16 converters that neither allocate nor log. The _simd
+ * versions convert runs of ASCII 16 bytes at a time with SSE2 or NEON
+ * and fall back to the _scalar code on everything else; where neither is
+ * available the two are the same. Both give the same dest and return
+ * value for any input, see _util_utf16_to_utf8() and
+ * _util_utf8_to_utf16() for the contract.
+ */
+mtp_int32 _util_utf16_to_utf8_scalar(char *dest, mtp_int32 dest_size,
+		const mtp_wchar *src);
+mtp_int32 _util_utf16_to_utf8_simd(char *dest, mtp_int32 dest_size,
+		const mtp_wchar *src);
+mtp_int32 _util_utf8_to_utf16_scalar(mtp_wchar *dest, mtp_int32 dest_items,
+		const char *src);
+mtp_int32 _util_utf8_to_utf16_simd(mtp_wchar *dest, mtp_int32 dest_items,
+		const char *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MTP_UTF_H_ */
@@ -16,6 +16,7 @@
  */
 
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <glib.h>
 #include "mtp_support.h"
 #include "mtp_util.h"
@@ -23,6 +24,8 @@
 #include "mtp_device.h"
 #include "mtp_transport.h"
 #include "ptp_container.h"
+#include "mtp_thread.h"
+#include "mtp_event_handler.h"
 
 #define MTP_DEVICE_VERSION_CHAR		"V1.0"
 
@@ -36,6 +39,13 @@ mtp_device_t *g_device = &_g_device;
  * STATIC VARIABLES
  */
 static mtp_store_t g_store_list[MAX_NUM_DEVICE_STORES];
+static pthread_t g_store_thrds[MAX_NUM_DEVICE_STORES];
+extern pthread_rwlock_t g_store_lock;
+extern mtp_config_t g_conf;
+
+/* DeviceInfo dataset, packed once by _init_mtp_device() */
+static mtp_uchar *g_device_info_blk;
+static mtp_uint32 g_device_info_blk_len;
 
 static mtp_uint16 g_ops_supported[] = {
 	PTP_OPCODE_GETDEVICEINFO,
@@ -53,6 +63,8 @@ static mtp_uint16 g_ops_supported[] = {
         MTP_OPCODE_GETOBJECTPROPDESC,
 	MTP_OPCODE_GETOBJECTPROPVALUE,
 	MTP_OPCODE_SETOBJECTPROPVALUE,
+	MTP_OPCODE_GETOBJECTPROPLIST,
+	MTP_OPCODE_SENDOBJECTPROPLIST,
 #ifdef MTP_SUPPORT_SET_PROTECTION
 	PTP_OPCODE_SETOBJECTPROTECTION,
 #endif /* MTP_SUPPORT_SET_PROTECTION */
@@ -67,6 +79,7 @@ static mtp_uint16 g_ops_supported[] = {
 static mtp_uint16 g_event_supported[] = {
 	PTP_EVENTCODE_OBJECTADDED,
 	PTP_EVENTCODE_OBJECTREMOVED,
+	PTP_EVENTCODE_STOREADDED,
 };
 
 static mtp_uint16 g_capture_fmts[] = {
@@ -110,6 +123,19 @@ static mtp_err_t __clear_store_data(mtp_uint32 store_id)
 			g_device->store_list[count - 1].root_path = NULL;
 			g_device->store_list[count - 1].is_hidden = FALSE;
 			_util_init_list(&(g_device->store_list[count - 1].obj_list));
+			g_device->store_list[count - 1].handle_index = NULL;
+			g_device->store_list[count - 1].path_index = NULL;
+			g_device->store_list[count - 1].format_index = NULL;
+			g_device->store_list[count - 1].handles_cache = NULL;
+			g_device->store_list[count - 1].is_root_enumerated = FALSE;
+			g_device->store_list[count - 1].root_mtime = 0;
+			g_device->store_list[count - 1].saved_generation = 0;
+			g_device->store_list[count - 1].reserved_space = 0;
+			g_atomic_int_set(&g_device->store_list[count - 1].is_space_dirty,
+					FALSE);
+			g_device->store_list[count - 1].is_ready = FALSE;
+			memset(&(g_device->store_list[count - 1].root_children), 0,
+					sizeof(ptp_array_t));
 
 			/*Initialize the destroyed store*/
 			g_device->num_stores--;
@@ -119,10 +145,56 @@ static mtp_err_t __clear_store_data(mtp_uint32 store_id)
 	return MTP_ERROR_GENERAL;
 }
 
+/* Store IDs map straight to a slot, whatever the number of stores */
+static mtp_store_t *__find_store(mtp_uint32 store_id)
+{
+	mtp_int32 idx = MTP_STORE_INDEX(store_id);
+	mtp_int32 slot = 0;
+
+	if ((store_id & 0xFFFF) != (MTP_EXTERNAL_STORE_ID & 0xFFFF) ||
+			idx < 0 || idx >= MAX_NUM_DEVICE_STORES)
+		return NULL;
+
+	slot = g_device->store_index[idx];
+	if (slot < 0 || slot >= g_device->num_stores ||
+			g_device->store_list[slot].store_id != store_id)
+		return NULL;
+
+	return &(g_device->store_list[slot]);
+}
+
+/* Nothing in DeviceInfo changes at run time, so it is only packed once */
+static void __build_device_info_blk(void)
+{
+	mtp_uint32 size = _get_device_info_size();
+
+	g_free(g_device_info_blk);
+	g_device_info_blk = _hdlr_alloc_prebuilt_data(size,
+			&g_device_info_blk_len);
+	retm_if(!g_device_info_blk, "_hdlr_alloc_prebuilt_data() Fail\n");
+
+	if (_pack_device_info(g_device_info_blk + sizeof(header_container_t),
+				size) != size) {
+		ERR("_pack_device_info() Fail\n");
+		g_free(g_device_info_blk);
+		g_device_info_blk = NULL;
+	}
+}
+
+mtp_bool _get_packed_device_info(mtp_uchar **blk, mtp_uint32 *blk_len)
+{
+	retv_if(g_device_info_blk == NULL, FALSE);
+
+	*blk = g_device_info_blk;
+	*blk_len = g_device_info_blk_len;
+	return TRUE;
+}
+
 void _init_mtp_device(void)
 {
 	device_info_t *info = &(g_device->device_info);
 	mtp_wchar wtemp[MAX_PTP_STRING_CHARS + 1] = { 0 };
+	mtp_int32 ii = 0;
 
 	g_device->status = DEVICE_STATUSOK;
 	g_device->phase = DEVICE_PHASE_IDLE;
@@ -130,6 +202,8 @@ void _init_mtp_device(void)
 	g_device->store_list = g_store_list;
 	g_device->default_store_id = MTP_EXTERNAL_STORE_ID;
 	g_device->default_hparent = PTP_OBJECTHANDLE_ROOT;
+	for (ii = 0; ii < MAX_NUM_DEVICE_STORES; ii++)
+		g_device->store_index[ii] = -1;
 
 	_prop_build_supp_props_default();
 	info->ops_supported = g_ops_supported;
@@ -160,6 +234,8 @@ void _init_mtp_device(void)
 	info->serial_no.num_chars = 0;
 	_util_utf8_to_utf16(wtemp, sizeof(wtemp) / WCHAR_SIZ, SERIAL);
 	_prop_copy_char_to_ptpstring(&(info->serial_no), wtemp, WCHAR_TYPE);
+
+	__build_device_info_blk();
 }
 
 /* LCOV_EXCL_START */
@@ -329,20 +405,19 @@ void _reset_mtp_device(void)
 /* LCOV_EXCL_STOP */
 
 /*
- * static mtp_bool _device_add_store(void)
- * This function will add the store to the device.
+ * static mtp_bool __add_store_to_device(mtp_int32 index)
+ * This function will add the index-th configured storage to the device.
+ * @param[in]	index	Index of the storage in the configuration
  * @return	TRUE if success, otherwise FALSE.
  */
-static mtp_bool __add_store_to_device(void)
+static mtp_bool __add_store_to_device(mtp_int32 index)
 {
 	mtp_char *storage_path = NULL;
 	mtp_uint32 store_id = 0;
 	file_attr_t attrs = { 0, };
-	char sto_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 
-	_util_get_external_path(sto_path);
-	storage_path = (mtp_char *)sto_path;
-	store_id = MTP_EXTERNAL_STORE_ID;
+	storage_path = (mtp_char *)g_conf.storages[index].path;
+	store_id = MTP_STORE_ID(index);
 
 	retvm_if(!_util_get_file_attrs(storage_path, &attrs), FALSE,
 		"_util_get_file_attrs() Fail\n");
@@ -356,28 +431,28 @@ static mtp_bool __add_store_to_device(void)
 		"reached to max [%d]\n", MAX_NUM_DEVICE_STORES);
 
 	retvm_if(!_entity_init_mtp_store(&(g_device->store_list[g_device->num_stores]),
-		store_id, storage_path), FALSE,
+		store_id, storage_path, g_conf.storages[index].desc), FALSE,
 		"_entity_init_mtp_store() Fail\n");
 
+	g_device->store_index[index] = g_device->num_stores;
 	g_device->num_stores++;
-	g_device->is_mounted[0] = TRUE;
+	g_device->is_mounted[index] = TRUE;
 
 	return TRUE;
 }
 
 /*
- * static mtp_bool _device_remove_store(void)
- * This function will remove the store from the device.
+ * static mtp_bool __remove_store_from_device(mtp_int32 index)
+ * This function will remove the index-th configured storage.
+ * Stores go in reverse order, so that the others keep their place.
  * @return	TRUE if success, otherwise FALSE.
  */
 /* LCOV_EXCL_START */
-static mtp_bool __remove_store_from_device(void)
+static mtp_bool __remove_store_from_device(mtp_int32 index)
 {
-	mtp_store_t *store = NULL;
-
-	store = &(g_device->store_list[0]);
-	__clear_store_data(store->store_id);
-	g_device->is_mounted[0] = FALSE;
+	__clear_store_data(MTP_STORE_ID(index));
+	g_device->is_mounted[index] = FALSE;
+	g_device->store_index[index] = -1;
 
 	return TRUE;
 }
@@ -386,38 +461,246 @@ static mtp_bool __remove_store_from_device(void)
 
 mtp_bool _device_install_storage(void)
 {
+	mtp_int32 ii = 0;
+
 	DBG("ADD Storage\n");
 	/* LCOV_EXCL_START */
-	if (g_device->is_mounted[0] == FALSE)
-		__add_store_to_device();
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		if (g_device->is_mounted[ii] == FALSE &&
+				!__add_store_to_device(ii))
+			ERR("Storage [%s] not added\n", g_conf.storages[ii].path);
+	}
 	/* LCOV_EXCL_STOP */
 
 	return TRUE;
 }
 
 /* LCOV_EXCL_START */
+static void __join_store_threads(void)
+{
+	mtp_int32 ii = 0;
+
+	for (ii = 0; ii < MAX_NUM_DEVICE_STORES; ii++) {
+		if (g_store_thrds[ii] == 0)
+			continue;
+
+		if (_util_thread_join(g_store_thrds[ii], NULL) == FALSE)
+			ERR("_util_thread_join() Fail\n");
+		g_store_thrds[ii] = 0;
+	}
+}
+
 mtp_bool _device_uninstall_storage(void)
 {
-	if (TRUE == g_device->is_mounted[0])
-		__remove_store_from_device();
+	mtp_int32 ii = 0;
+
+	/* Loading threads give up early, the USB is gone already */
+	__join_store_threads();
+
+	_device_save_store_snapshots();
+	for (ii = MAX_NUM_DEVICE_STORES - 1; ii >= 0; ii--) {
+		if (TRUE == g_device->is_mounted[ii])
+			__remove_store_from_device(ii);
+	}
 
 	return TRUE;
 }
 
-/* LCOV_EXCL_STOP */
+/*
+ * Brings one store up: its snapshot is restored, then the store is shown
+ * to the host and its root is listed.
+ */
+static void *__store_init_thread(void *arg)
+{
+	mtp_store_t *store = (mtp_store_t *)arg;
+	gint64 start = g_get_monotonic_time();
 
-mtp_store_t *_device_get_store(mtp_uint32 store_id)
+	/* Takes the store lock itself, only to add what it restored */
+	_entity_load_store_snapshot(store);
+
+	UTIL_WRITE_LOCK(&g_store_lock);
+	store->is_ready = TRUE;
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	DBG("Store [0x%x] ready in [%lld] ms\n", store->store_id,
+			(long long)((g_get_monotonic_time() - start) / 1000));
+	_eh_send_event_req_to_eh_thread(EVENT_STORE_ADDED, store->store_id,
+			0, NULL);
+
+	_entity_store_prefetch_root(store);
+
+	return NULL;
+}
+
+void _device_enumerate_stores(void)
 {
 	mtp_int32 ii = 0;
 	mtp_store_t *store = NULL;
 
+	__join_store_threads();
+	_entity_clear_previous_handles();
+
 	for (ii = 0; ii < g_device->num_stores; ii++) {
+		store = &(g_device->store_list[ii]);
+		if (store->is_ready)
+			continue;
 
+		if (_util_thread_create(&g_store_thrds[ii], "store thread",
+					PTHREAD_CREATE_JOINABLE,
+					__store_init_thread, (void *)store))
+			continue;
+
+		/* No thread, the store is brought up right here */
+		ERR("store thread creation Fail\n");
+		g_store_thrds[ii] = 0;
+		__store_init_thread((void *)store);
+	}
+}
+
+/*
+ * The stores are packed under the store lock and written once it is
+ * released, so that requests do not wait on the file system.
+ */
+void _device_save_store_snapshots(void)
+{
+	static pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+	GByteArray *snapshots[MAX_NUM_DEVICE_STORES] = { NULL };
+	mtp_uint32 store_ids[MAX_NUM_DEVICE_STORES] = { 0 };
+	mtp_uint32 generations[MAX_NUM_DEVICE_STORES] = { 0 };
+	mtp_bool is_written[MAX_NUM_DEVICE_STORES] = { FALSE };
+	mtp_int32 n_stores = 0;
+	mtp_int32 ii = 0;
+	mtp_int32 jj = 0;
+	mtp_store_t *store = NULL;
+
+	/* Savers on other threads would write the same files */
+	pthread_mutex_lock(&save_lock);
+
+	UTIL_READ_LOCK(&g_store_lock);
+	for (ii = 0; ii < g_device->num_stores &&
+			n_stores < MAX_NUM_DEVICE_STORES; ii++) {
 		store = &(g_device->store_list[ii]);
-		if (store->store_id == store_id)
-			return store;
+		/* A half restored store would overwrite a good snapshot */
+		if (!store->is_ready ||
+				store->generation == store->saved_generation)
+			continue;
+
+		snapshots[n_stores] = _entity_pack_store_snapshot(store);
+		if (snapshots[n_stores] == NULL)
+			continue;
+		store_ids[n_stores] = store->store_id;
+		generations[n_stores] = store->generation;
+		n_stores++;
 	}
-	return NULL;
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	for (ii = 0; ii < n_stores; ii++) {
+		is_written[ii] = _entity_write_store_snapshot(store_ids[ii],
+				snapshots[ii]);
+		g_byte_array_free(snapshots[ii], TRUE);
+	}
+
+	/* The stores may have changed or gone in the meantime */
+	UTIL_WRITE_LOCK(&g_store_lock);
+	for (ii = 0; ii < n_stores; ii++) {
+		if (!is_written[ii])
+			continue;
+
+		for (jj = 0; jj < g_device->num_stores; jj++) {
+			store = &(g_device->store_list[jj]);
+			if (store->store_id == store_ids[ii])
+				store->saved_generation = generations[ii];
+		}
+	}
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	pthread_mutex_unlock(&save_lock);
+}
+
+/*
+ * Runs statfs() for the stores changed outside MTP, and for all of them
+ * every MTP_SPACE_REFRESH_INTERVAL seconds, with the store lock
+ * released so that requests never wait on the filesystem.
+ */
+void _device_refresh_store_space(void)
+{
+	mtp_uint32 store_ids[MAX_NUM_DEVICE_STORES] = { 0 };
+	mtp_char *root_paths[MAX_NUM_DEVICE_STORES] = { NULL };
+	mtp_int32 n_stores = 0;
+	mtp_int32 ii = 0;
+	mtp_store_t *store = NULL;
+	fs_info_t fs_info = { 0 };
+	gint64 now = g_get_monotonic_time();
+	mtp_bool is_dirty = FALSE;
+
+	UTIL_WRITE_LOCK(&g_store_lock);
+	for (ii = 0; ii < g_device->num_stores &&
+			n_stores < MAX_NUM_DEVICE_STORES; ii++) {
+		store = &(g_device->store_list[ii]);
+		/* Changes from now on need another refresh */
+		is_dirty = g_atomic_int_compare_and_exchange(
+				&store->is_space_dirty, TRUE, FALSE);
+		if (!is_dirty && now - store->space_time <
+				(gint64)MTP_SPACE_REFRESH_INTERVAL * G_USEC_PER_SEC)
+			continue;
+
+		store->space_time = now;
+		store_ids[n_stores] = store->store_id;
+		root_paths[n_stores] = g_strdup(store->root_path);
+		n_stores++;
+	}
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	for (ii = 0; ii < n_stores; ii++) {
+		if (_util_get_filesystem_info(root_paths[ii], &fs_info)) {
+			UTIL_WRITE_LOCK(&g_store_lock);
+			store = __find_store(store_ids[ii]);
+			if (store && !g_strcmp0(store->root_path, root_paths[ii]))
+				_entity_set_store_space(store, fs_info.disk_size,
+						fs_info.avail_size);
+			UTIL_RW_UNLOCK(&g_store_lock);
+		}
+		g_free(root_paths[ii]);
+	}
+}
+
+/*
+ * Checks every store against the file system, once change events were
+ * lost. The store lock is taken by each check, not held across them.
+ */
+void _device_resync_stores(void)
+{
+	mtp_int32 ii = 0;
+
+	for (ii = 0; ii < g_device->num_stores; ii++)
+		_entity_store_resync(&(g_device->store_list[ii]));
+}
+
+/*
+ * Notes a change made outside MTP to the store holding path. Called with
+ * the store lock taken shared, hence the atomic.
+ */
+void _device_set_store_space_dirty(const mtp_char *path)
+{
+	mtp_store_t *store = NULL;
+
+	store = _device_get_store_by_path(path);
+	if (store)
+		g_atomic_int_set(&store->is_space_dirty, TRUE);
+}
+
+/* LCOV_EXCL_STOP */
+
+mtp_store_t *_device_get_store(mtp_uint32 store_id)
+{
+	mtp_store_t *store = __find_store(store_id);
+
+	return (store && store->is_ready) ? store : NULL;
+}
+
+mtp_store_t *_device_get_store_by_path(const mtp_char *path)
+{
+	return __find_store(_entity_get_store_id_by_path(path));
 }
 
 mtp_uint32 _device_get_store_ids(ptp_array_t *store_ids)
@@ -428,7 +711,8 @@ mtp_uint32 _device_get_store_ids(ptp_array_t *store_ids)
 	for (ii = g_device->num_stores - 1; ii >= 0; ii--) {
 
 		store = &(g_device->store_list[ii]);
-		if ((store != NULL) && (FALSE == store->is_hidden))
+		if ((store != NULL) && (FALSE == store->is_hidden) &&
+				store->is_ready)
 			_prop_append_ele_ptparray(store_ids, store->store_id);
 	}
 	return store_ids->num_ele;
@@ -436,19 +720,9 @@ mtp_uint32 _device_get_store_ids(ptp_array_t *store_ids)
 
 mtp_obj_t *_device_get_object_with_handle(mtp_uint32 obj_handle)
 {
-	mtp_int32 ii = 0;
-	mtp_obj_t *obj = NULL;
-	mtp_store_t *store = NULL;
+	mtp_store_t *store = _device_get_store_containing_obj(obj_handle);
 
-	for (ii = 0; ii < g_device->num_stores; ii++) {
-
-		store = &(g_device->store_list[ii]);
-		obj = _entity_get_object_from_store(store, obj_handle);
-		if (obj == NULL)
-			continue;
-		break;
-	}
-	return obj;
+	return store ? _entity_get_object_from_store(store, obj_handle) : NULL;
 }
 
 /* LCOV_EXCL_START */
@@ -493,6 +767,9 @@ mtp_uint16 _device_delete_object(mtp_uint32 obj_handle, mtp_uint32 fmt)
 
 	for (ii = 0; ii < g_device->num_stores; ii++) {
 		store = &(g_device->store_list[ii]);
+		if (!store->is_ready)
+			continue;
+
 		response = _entity_delete_obj_mtp_store(store, obj_handle,
 				fmt, TRUE);
 		switch (response) {
@@ -523,24 +800,39 @@ mtp_uint16 _device_delete_object(mtp_uint32 obj_handle, mtp_uint32 fmt)
 	/* LCOV_EXCL_STOP */
 }
 
+/*
+ * Requests on one object tend to follow each other, so the store of the
+ * last hit is probed first and the others only when it misses.
+ */
 mtp_store_t *_device_get_store_containing_obj(mtp_uint32 obj_handle)
 {
+	/* Set by lookups under the shared store lock too */
+	static gint last_idx = 0;
+	mtp_uint32 start = (mtp_uint32)g_atomic_int_get(&last_idx);
 	mtp_uint32 ii = 0;
-	mtp_obj_t *obj = NULL;
+	mtp_uint32 idx = 0;
 	mtp_store_t *store = NULL;
 
 	for (ii = 0; ii < g_device->num_stores; ii++) {
-		store = &(g_device->store_list[ii]);
-		obj = _entity_get_object_from_store(store, obj_handle);
-		if (obj != NULL)
+		idx = (start + ii) % g_device->num_stores;
+		store = &(g_device->store_list[idx]);
+		if (store->handle_index && g_hash_table_lookup(store->handle_index,
+					GUINT_TO_POINTER(obj_handle))) {
+			if (idx != start)
+				g_atomic_int_set(&last_idx, (gint)idx);
 			return store;
+		}
 	}
 	return NULL;
 }
 
+/* Stores still loading are skipped, like in _device_get_store() */
 mtp_store_t *_device_get_store_at_index(mtp_uint32 index)
 {
 	retvm_if(index >= g_device->num_stores, NULL, "Index not valid\n");
 
+	if (!g_device->store_list[index].is_ready)
+		return NULL;
+
 	return &(g_device->store_list[index]);
 }
@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <glib.h>
 #include "mtp_fs.h"
 #include "mtp_support.h"
@@ -27,7 +28,27 @@
 
 extern mtp_bool g_is_full_enum;
 extern mtp_uint32 g_next_obj_handle;
+extern mtp_config_t g_conf;
 
+/*
+ * Packed ObjectInfo dataset of one object. Entries are kept in a list
+ * from most to least recently used, and the oldest ones are dropped once
+ * MTP_MAX_OBJECT_INFO_CACHE_SIZE bytes are cached. GetObjectInfo uses
+ * it with the store lock taken shared, so the list and the info_cache
+ * member of the objects are guarded by g_info_cache_lock.
+ */
+struct _obj_info_cache {
+	struct _obj_info_cache *prev;
+	struct _obj_info_cache *next;
+	mtp_obj_t *obj;
+	mtp_uint32 data_sz;
+	mtp_uchar data[];
+};
+
+static struct _obj_info_cache *g_info_cache_head;
+static struct _obj_info_cache *g_info_cache_tail;
+static mtp_uint32 g_info_cache_size;
+static pthread_mutex_t g_info_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* LCOV_EXCL_START */
 mtp_bool _entity_get_file_times(mtp_obj_t *obj, ptp_time_string_t *create_tm,
@@ -402,7 +423,16 @@ mtp_bool _entity_init_mtp_object_params(
 	obj->obj_handle = 0;
 	obj->obj_info = NULL;
 	obj->file_path = NULL;
-	obj->obj_handle = g_next_obj_handle++;
+	obj->propvals = NULL;
+	obj->info_cache = NULL;
+	obj->dev = file_info ? file_info->attrs.dev : 0;
+	obj->ino = file_info ? file_info->attrs.ino : 0;
+
+	/* Same handle as in the previous session, if it is known */
+	obj->obj_handle = _entity_take_previous_handle(file_path, obj->dev,
+			obj->ino);
+	if (obj->obj_handle == 0)
+		obj->obj_handle = g_next_obj_handle++;
 	_entity_set_object_file_path(obj, file_path, CHAR_TYPE);
 	obj->obj_info = _entity_alloc_object_info();
 
@@ -413,13 +443,31 @@ mtp_bool _entity_init_mtp_object_params(
 	_entity_init_object_info_params(obj->obj_info, store_id, h_parent,
 			file_name, file_info);
 
-	_util_init_list(&(obj->propval_list));
 	memset(&(obj->child_array), 0, sizeof(ptp_array_t));
 	obj->child_array.type = UINT32_TYPE;
+	memset(&(obj->children), 0, sizeof(ptp_array_t));
+	obj->children.type = UINT32_TYPE;
+	obj->generation = 0;
+	obj->is_enumerated = FALSE;
+	obj->dir_mtime = 0;
 
 	return TRUE;
 }
 
+/*
+ * PersistentUniqueObjectIdentifier of obj. It follows the path unless
+ * guid_from_inode is set and the file's identity is known.
+ */
+static void __update_obj_guid(mtp_obj_t *obj)
+{
+	mtp_uint64 id[2] = { obj->dev, obj->ino };
+
+	if (g_conf.guid_from_inode && obj->ino != 0)
+		_util_get_guid(id, sizeof(id), obj->guid);
+	else
+		_util_get_guid(obj->file_path, strlen(obj->file_path), obj->guid);
+}
+
 mtp_bool _entity_set_object_file_path(mtp_obj_t *obj, void *file_path,
 		char_mode_t char_type)
 {
@@ -433,6 +481,29 @@ mtp_bool _entity_set_object_file_path(mtp_obj_t *obj, void *file_path,
 		g_free(obj->file_path);
 		obj->file_path = g_strdup((char *)file_path);
 	}
+	__update_obj_guid(obj);
+	_prop_invalidate_obj_propvals(obj, PROP_CACHE_PATH);
+	_entity_invalidate_obj_info(obj);
+	return TRUE;
+}
+
+/*
+ * Objects made by SendObjectInfo or CopyObject exist before their file
+ * does. Once it is written, pick up its identity and the GUID that
+ * follows from it.
+ */
+mtp_bool _entity_refresh_object_identity(mtp_obj_t *obj)
+{
+	file_attr_t attrs = { 0 };
+
+	retv_if(obj == NULL, FALSE);
+	retv_if(obj->file_path == NULL, FALSE);
+	retvm_if(!_util_get_file_attrs(obj->file_path, &attrs), FALSE,
+		"_util_get_file_attrs Fail\n");
+
+	obj->dev = attrs.dev;
+	obj->ino = attrs.ino;
+	__update_obj_guid(obj);
 	return TRUE;
 }
 
@@ -583,11 +654,13 @@ mtp_bool _entity_set_child_object_path(mtp_obj_t *obj, mtp_char *src_path,
 					dest_child_path\n");
 			_entity_remove_reference_child_array(obj,
 					child_obj->obj_handle);
+			_entity_detach_object_from_store(src_store, child_obj);
 			_entity_dealloc_mtp_obj(child_obj);
 			continue;
 		}
 
-		_entity_set_object_file_path(child_obj, dest_child_path, CHAR_TYPE);
+		_entity_set_object_path_in_store(src_store, child_obj,
+				dest_child_path);
 
 		if (child_obj->obj_info == NULL) {
 			ERR("obj_info is NULL\n");
@@ -600,6 +673,7 @@ mtp_bool _entity_set_child_object_path(mtp_obj_t *obj, mtp_char *src_path,
 				ERR("Fail to set the full path!!\n");
 				_entity_remove_reference_child_array(obj,
 						child_obj->obj_handle);
+				_entity_detach_object_from_store(src_store, child_obj);
 				_entity_dealloc_mtp_obj(child_obj);
 				continue;
 			}
@@ -673,10 +747,6 @@ mtp_bool _entity_remove_reference_child_array(mtp_obj_t *obj, mtp_uint32 handle)
 
 void _entity_dealloc_mtp_obj(mtp_obj_t *obj)
 {
-	mtp_uint16 ii = 0;
-	slist_node_t *node = NULL;
-	slist_node_t *next_node = NULL;
-
 	ret_if(NULL == obj);
 
 	if (obj->obj_info) {
@@ -685,17 +755,134 @@ void _entity_dealloc_mtp_obj(mtp_obj_t *obj)
 	}
 
 	_entity_remove_reference_child_array(obj, PTP_OBJECTHANDLE_ALL);
+	_prop_deinit_ptparray(&(obj->children));
 
-	for (ii = 0, next_node = obj->propval_list.start;
-			ii < obj->propval_list.nnodes; ii++) {
-		node = next_node;
-		next_node = node->link;
-		_prop_destroy_obj_propval((obj_prop_val_t *)node->value);
-		g_free(node);
-	}
+	_prop_invalidate_obj_propvals(obj, PROP_CACHE_ALL);
+	g_free(obj->propvals);
+	_entity_invalidate_obj_info(obj);
 
 	g_free(obj->file_path);
 	g_free(obj);
 	obj = NULL;
 }
 /* LCOV_EXCL_STOP */
+
+static void __unlink_obj_info(struct _obj_info_cache *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		g_info_cache_head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		g_info_cache_tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void __link_obj_info_first(struct _obj_info_cache *entry)
+{
+	entry->prev = NULL;
+	entry->next = g_info_cache_head;
+
+	if (g_info_cache_head)
+		g_info_cache_head->prev = entry;
+	else
+		g_info_cache_tail = entry;
+	g_info_cache_head = entry;
+}
+
+/* With g_info_cache_lock held */
+static void __drop_obj_info(mtp_obj_t *obj)
+{
+	struct _obj_info_cache *entry = obj->info_cache;
+
+	if (entry == NULL)
+		return;
+
+	__unlink_obj_info(entry);
+	g_info_cache_size -= entry->data_sz;
+	obj->info_cache = NULL;
+	g_free(entry);
+}
+
+/*
+ * Returns a copy of the packed ObjectInfo dataset of obj in *data, to be
+ * released with g_free(), packing and caching the dataset if needed.
+ */
+mtp_bool _entity_get_packed_obj_info(mtp_obj_t *obj, mtp_uchar **data,
+		mtp_uint32 *data_sz)
+{
+	struct _obj_info_cache *entry = NULL;
+	mtp_char f_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
+	mtp_wchar wf_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
+	ptp_string_t ptp_string = { 0 };
+	mtp_uint32 num_bytes = 0;
+
+	retv_if(obj == NULL || obj->obj_info == NULL, FALSE);
+	retv_if(data == NULL || data_sz == NULL, FALSE);
+
+	pthread_mutex_lock(&g_info_cache_lock);
+	entry = obj->info_cache;
+	if (entry != NULL) {
+		__unlink_obj_info(entry);
+		__link_obj_info_first(entry);
+		*data_sz = entry->data_sz;
+		*data = g_malloc(*data_sz);
+		memcpy(*data, entry->data, *data_sz);
+		pthread_mutex_unlock(&g_info_cache_lock);
+		return TRUE;
+	}
+	pthread_mutex_unlock(&g_info_cache_lock);
+
+	/* Packed outside the cache lock, the object is kept by the store lock */
+	_util_get_file_name(obj->file_path, f_name);
+	_util_utf8_to_utf16(wf_name, sizeof(wf_name) / WCHAR_SIZ, f_name);
+	_prop_copy_char_to_ptpstring(&ptp_string, wf_name, WCHAR_TYPE);
+
+	num_bytes = _entity_get_object_info_size(obj, &ptp_string);
+	retv_if(num_bytes == 0, FALSE);
+
+	entry = g_malloc(sizeof(struct _obj_info_cache) + num_bytes);
+	retvm_if(!entry, FALSE, "g_malloc() Fail\n");
+
+	if (num_bytes != _entity_pack_obj_info(obj, &ptp_string,
+				entry->data, num_bytes)) {
+		ERR("_entity_pack_obj_info() Fail\n");
+		g_free(entry);
+		return FALSE;
+	}
+	entry->obj = obj;
+	entry->data_sz = num_bytes;
+	*data_sz = num_bytes;
+	*data = g_malloc(num_bytes);
+	memcpy(*data, entry->data, num_bytes);
+
+	pthread_mutex_lock(&g_info_cache_lock);
+	/* Another reader may have cached it meanwhile */
+	__drop_obj_info(obj);
+	obj->info_cache = entry;
+	g_info_cache_size += num_bytes;
+	__link_obj_info_first(entry);
+
+	/* Make room, but always keep the entry just added */
+	while (g_info_cache_tail != entry &&
+			g_info_cache_size > MTP_MAX_OBJECT_INFO_CACHE_SIZE)
+		__drop_obj_info(g_info_cache_tail->obj);
+	pthread_mutex_unlock(&g_info_cache_lock);
+
+	return TRUE;
+}
+
+/* Drops the packed ObjectInfo of obj, after any change to its metadata */
+void _entity_invalidate_obj_info(mtp_obj_t *obj)
+{
+	ret_if(obj == NULL);
+
+	pthread_mutex_lock(&g_info_cache_lock);
+	__drop_obj_info(obj);
+	pthread_mutex_unlock(&g_info_cache_lock);
+}
@@ -19,6 +19,7 @@
 #include "mtp_property.h"
 #include "mtp_support.h"
 #include "mtp_transport.h"
+#include "ptp_container.h"
 
 /*
  * EXTERN AND GLOBAL VARIABLES
@@ -29,6 +30,18 @@ obj_interdep_proplist_t interdep_proplist;
  */
 static obj_prop_desc_t props_list_default[NUM_OBJECT_PROP_DESC_DEFAULT];
 
+/* Property values kept per object, see __get_cache_slot() */
+#define NUM_CACHED_OBJ_PROPS	4
+
+/*
+ * ObjectPropDesc data blocks of props_list_default, and the
+ * InterdependentPropDesc one, packed by _prop_build_supp_props_default().
+ */
+static mtp_uchar *g_prop_desc_blks[NUM_OBJECT_PROP_DESC_DEFAULT];
+static mtp_uint32 g_prop_desc_blk_lens[NUM_OBJECT_PROP_DESC_DEFAULT];
+static mtp_uchar *g_interdep_blk;
+static mtp_uint32 g_interdep_blk_len;
+
 /*
  * FUNCTIONS
  */
@@ -65,86 +78,30 @@ static mtp_bool __check_object_propcode(obj_prop_desc_t *prop,
 	return FALSE;
 }
 
-static mtp_bool __create_prop_integer(mtp_obj_t *obj,
-		mtp_uint16 propcode, mtp_uint64 value)
-{
-	obj_prop_desc_t *prop = NULL;
-	obj_prop_val_t *prop_val = NULL;
-	mtp_uint32 fmt_code = obj->obj_info->obj_fmt;
-
-	retv_if(obj == NULL, FALSE);
-	retv_if(obj->obj_info == NULL, FALSE);
-
-	prop = _prop_get_obj_prop_desc(fmt_code, propcode);
-	retvm_if(!prop, FALSE, "Create property Fail.. Prop = [0x%X]\n", propcode);
-
-	propvalue_alloc_and_check(prop_val);
-	_prop_set_current_integer_val(prop_val, value);
-	node_alloc_and_append();
-
-	return TRUE;
-}
-
-static mtp_bool __create_prop_string(mtp_obj_t *obj, mtp_uint16 propcode,
+static obj_prop_val_t *__create_prop_string(obj_prop_desc_t *prop,
 		mtp_wchar *value)
 {
 	ptp_string_t ptp_str = {0};
-	obj_prop_desc_t *prop = NULL;
 	obj_prop_val_t *prop_val = NULL;
-	mtp_uint32 fmt_code = obj->obj_info->obj_fmt;
 
-	retv_if(obj == NULL, FALSE);
-	retv_if(obj->obj_info == NULL, FALSE);
-
-	prop = _prop_get_obj_prop_desc(fmt_code, propcode);
-	retvm_if(!prop, FALSE, "Create property Fail.. Prop = [0x%X]\n", propcode);
-
-	propvalue_alloc_and_check(prop_val);
+	prop_val = _prop_alloc_obj_propval(prop);
+	retvm_if(!prop_val, NULL, "_prop_alloc_obj_propval() Fail\n");
 	_prop_copy_char_to_ptpstring(&ptp_str, value, WCHAR_TYPE);
 	_prop_set_current_string_val(prop_val, &ptp_str);
-	node_alloc_and_append();
 
-	return TRUE;
+	return prop_val;
 }
 
-static mtp_bool __create_prop_timestring(mtp_obj_t *obj,
-	mtp_uint32 propcode, ptp_time_string_t *value)
+static obj_prop_val_t *__create_prop_timestring(obj_prop_desc_t *prop,
+		ptp_time_string_t *value)
 {
-	obj_prop_desc_t *prop = NULL;
 	obj_prop_val_t *prop_val = NULL;
-	mtp_uint32 fmt_code = obj->obj_info->obj_fmt;
-
-	retv_if(obj == NULL, FALSE);
-	retv_if(obj->obj_info == NULL, FALSE);
-
-	prop = _prop_get_obj_prop_desc(fmt_code, propcode);
-	retvm_if(!prop, FALSE, "Create property Fail.. Prop = [0x%X]\n", propcode);
 
-	propvalue_alloc_and_check(prop_val);
+	prop_val = _prop_alloc_obj_propval(prop);
+	retvm_if(!prop_val, NULL, "_prop_alloc_obj_propval() Fail\n");
 	_prop_set_current_string_val(prop_val, (ptp_string_t *)value);
-	node_alloc_and_append();
 
-	return TRUE;
-}
-
-static mtp_bool __create_prop_array(mtp_obj_t *obj, mtp_uint16 propcode,
-		mtp_char *arr, mtp_uint32 size)
-{
-	obj_prop_desc_t *prop = NULL;
-	obj_prop_val_t *prop_val = NULL;
-	mtp_uint32 fmt_code = obj->obj_info->obj_fmt;
-
-	retv_if(obj == NULL, FALSE);
-	retv_if(obj->obj_info == NULL, FALSE);
-
-	prop = _prop_get_obj_prop_desc(fmt_code, propcode);
-	retvm_if(!prop, FALSE, "Create property Fail.. Prop = [0x%X]\n", propcode);
-
-	propvalue_alloc_and_check(prop_val);
-	_prop_set_current_array_val(prop_val, (mtp_uchar *)arr, size);
-	node_alloc_and_append();
-
-	return TRUE;
+	return prop_val;
 }
 /* LCOV_EXCL_STOP */
 
@@ -445,17 +402,6 @@ void _prop_destroy_ptparray(ptp_array_t *parray)
 /* LCOV_EXCL_STOP */
 
 /* PtpString Functions */
-static ptp_string_t *__alloc_ptpstring(void)
-{
-	ptp_string_t *pstring = NULL;
-
-	pstring = (ptp_string_t *)g_malloc(sizeof(ptp_string_t));
-	if (pstring != NULL)
-		pstring->num_chars = 0;
-
-	return (pstring);
-}
-
 void _prop_copy_char_to_ptpstring(ptp_string_t *pstring, void *str,
 		char_mode_t cmode)
 {
@@ -660,6 +606,67 @@ mtp_uint32 _prop_parse_rawstring(ptp_string_t *pstring, mtp_uchar *buf,
 }
 /* LCOV_EXCL_STOP */
 
+/*
+ * Returns a ptp_vstring_t holding a copy of src, allocated for its
+ * characters only, with one reference.
+ */
+ptp_vstring_t *_prop_alloc_ptpvstring(ptp_string_t *src)
+{
+	ptp_vstring_t *vstr = NULL;
+	mtp_uchar num_chars = (src != NULL) ? src->num_chars : 0;
+
+	vstr = (ptp_vstring_t *)g_malloc(sizeof(ptp_vstring_t) +
+			num_chars * sizeof(mtp_wchar));
+	if (vstr == NULL)
+		return NULL;
+
+	vstr->ref_count = 1;
+	vstr->num_chars = num_chars;
+	if (num_chars > 0)
+		memcpy(vstr->str, src->str, num_chars * sizeof(mtp_wchar));
+
+	return vstr;
+}
+
+ptp_vstring_t *_prop_ref_ptpvstring(ptp_vstring_t *vstr)
+{
+	if (vstr != NULL)
+		g_atomic_int_inc(&(vstr->ref_count));
+
+	return vstr;
+}
+
+void _prop_unref_ptpvstring(ptp_vstring_t *vstr)
+{
+	if (vstr != NULL && g_atomic_int_dec_and_test(&(vstr->ref_count)))
+		g_free(vstr);
+}
+
+mtp_uint32 _prop_size_ptpvstring(ptp_vstring_t *vstr)
+{
+	_prop_size_ptp_string_body(vstr);
+}
+
+mtp_uint32 _prop_pack_ptpvstring(ptp_vstring_t *vstr, mtp_uchar *buf,
+		mtp_uint32 size)
+{
+	if (vstr == NULL)
+		return 0;
+
+	return _prop_pack_ptpstring_body(vstr->str, buf, size,
+			_prop_size_ptpvstring(vstr), vstr->num_chars);
+}
+
+static mtp_bool __is_equal_ptpvstring(ptp_string_t *pstring,
+		ptp_vstring_t *vstr)
+{
+	if (pstring->num_chars != vstr->num_chars)
+		return FALSE;
+
+	return !memcmp(pstring->str, vstr->str,
+			vstr->num_chars * sizeof(mtp_wchar));
+}
+
 mtp_bool _prop_is_valid_integer(prop_info_t *prop_info, mtp_uint64 value)
 {
 	if ((prop_info->data_type & PTP_DATATYPE_VALUEMASK) !=
@@ -706,14 +713,14 @@ mtp_bool _prop_is_valid_string(prop_info_t *prop_info, ptp_string_t *pstring)
 		/* LCOV_EXCL_START */
 		slist_node_t *node = NULL;
 		mtp_uint32 ii;
-		ptp_string_t *ele_str = NULL;
+		ptp_vstring_t *ele_str = NULL;
 
 		node = prop_info->supp_value_list.start;
 		for (ii = 0; ii < prop_info->supp_value_list.nnodes;
 				ii++, node = node->link) {
-			ele_str = (ptp_string_t *) node->value;
+			ele_str = (ptp_vstring_t *) node->value;
 			if (ele_str != NULL) {
-				if (_prop_is_equal_ptpstring(pstring, ele_str)) {
+				if (__is_equal_ptpvstring(pstring, ele_str)) {
 					/* value found in the list of supported values */
 					return TRUE;
 				}
@@ -741,14 +748,12 @@ mtp_bool _prop_is_valid_string(prop_info_t *prop_info, ptp_string_t *pstring)
 mtp_bool _prop_set_default_string(prop_info_t *prop_info, mtp_wchar *val)
 {
 	if (prop_info->data_type == PTP_DATATYPE_STRING) {
-		g_free(prop_info->default_val.str);
-		prop_info->default_val.str = __alloc_ptpstring();
-		if (NULL == prop_info->default_val.str)
-			return FALSE;
+		ptp_string_t str = { 0 };
 
-		_prop_copy_char_to_ptpstring(prop_info->default_val.str,
-				val, WCHAR_TYPE);
-		return TRUE;
+		_prop_copy_char_to_ptpstring(&str, val, WCHAR_TYPE);
+		_prop_unref_ptpvstring(prop_info->default_val.str);
+		prop_info->default_val.str = _prop_alloc_ptpvstring(&str);
+		return (prop_info->default_val.str != NULL);
 	} else {
 		return FALSE;
 	}
@@ -787,15 +792,9 @@ mtp_bool _prop_set_current_integer(device_prop_desc_t *prop, mtp_uint32 val)
 mtp_bool _prop_set_current_string(device_prop_desc_t *prop, ptp_string_t *str)
 {
 	if (_prop_is_valid_string(&(prop->propinfo), str)) {
-		g_free(prop->current_val.str);
-		prop->current_val.str = __alloc_ptpstring();
-		if (prop->current_val.str != NULL) {
-			_prop_copy_ptpstring(prop->current_val.str, str);
-			return TRUE;
-		} else {
-			g_free(prop->current_val.str);
-			return FALSE;
-		}
+		_prop_unref_ptpvstring(prop->current_val.str);
+		prop->current_val.str = _prop_alloc_ptpvstring(str);
+		return (prop->current_val.str != NULL);
 	} else {
 		/* setting invalid value */
 		return FALSE;
@@ -819,13 +818,9 @@ mtp_bool _prop_set_current_integer_val(obj_prop_val_t *pval, mtp_uint64 val)
 mtp_bool _prop_set_current_string_val(obj_prop_val_t *pval, ptp_string_t *str)
 {
 	if (_prop_is_valid_string(&(pval->prop->propinfo), str)) {
-		g_free(pval->current_val.str);
-		pval->current_val.str = __alloc_ptpstring();
-		if (pval->current_val.str != NULL) {
-			_prop_copy_ptpstring(pval->current_val.str, str);
-			return TRUE;
-		} else
-			return FALSE;
+		_prop_unref_ptpvstring(pval->current_val.str);
+		pval->current_val.str = _prop_alloc_ptpvstring(str);
+		return (pval->current_val.str != NULL);
 	} else {
 		/* setting invalid value */
 		return FALSE;
@@ -946,20 +941,18 @@ mtp_bool _prop_set_current_array_val(obj_prop_val_t *pval, mtp_uchar *arr,
 
 mtp_bool _prop_set_regexp(obj_prop_desc_t *prop, mtp_wchar *regex)
 {
-	ptp_string_t *str;
+	ptp_string_t str = { 0 };
 
 	if ((prop->propinfo.data_type != PTP_DATATYPE_STRING) ||
 			(prop->propinfo.form_flag != REGULAR_EXPRESSION_FORM)) {
 		return FALSE;
 	}
-	str = __alloc_ptpstring();
-	if (str == NULL)
-		return FALSE;
 
-	_prop_copy_char_to_ptpstring(str, regex, WCHAR_TYPE);
-	prop->prop_forms.reg_exp = str;
+	_prop_copy_char_to_ptpstring(&str, regex, WCHAR_TYPE);
+	_prop_unref_ptpvstring(prop->prop_forms.reg_exp);
+	prop->prop_forms.reg_exp = _prop_alloc_ptpvstring(&str);
 
-	return TRUE;
+	return (prop->prop_forms.reg_exp != NULL);
 }
 
 /* DeviceObjectPropDesc Functions */
@@ -975,12 +968,9 @@ static void __init_obj_propval(obj_prop_val_t *pval, obj_prop_desc_t *prop)
 		pval->current_val.integer[ii] = 0;
 
 	if (prop->propinfo.data_type == PTP_DATATYPE_STRING) {
-
-		pval->current_val.str = __alloc_ptpstring();
-		if (NULL == pval->current_val.str)
-			return;
-		_prop_copy_ptpstring(pval->current_val.str,
-				prop->propinfo.default_val.str);
+		/* The default is shared, not copied */
+		pval->current_val.str =
+			_prop_ref_ptpvstring(prop->propinfo.default_val.str);
 	} else if ((prop->propinfo.data_type & PTP_DATATYPE_VALUEMASK) ==
 			PTP_DATATYPE_VALUE) {
 
@@ -1034,48 +1024,245 @@ obj_prop_val_t * _prop_alloc_obj_propval(obj_prop_desc_t *prop)
 	return pval;
 }
 
-obj_prop_val_t *_prop_get_prop_val(mtp_obj_t *obj, mtp_uint32 propcode)
+/*
+ * Number of props_list_default entries in use, OMA DRM status being
+ * the last one.
+ */
+static mtp_uint32 __get_num_obj_props(void)
 {
-	obj_prop_val_t *prop_val = NULL;
-	slist_node_t *node = NULL;
-	mtp_uint32 ii = 0;
+	if (_get_oma_drm_status() == TRUE)
+		return NUM_OBJECT_PROP_DESC_DEFAULT;
 
-	/*Update the properties if count is zero*/
-	if (obj->propval_list.nnodes == 0)
-		_prop_update_property_values_list(obj);
+	return NUM_OBJECT_PROP_DESC_DEFAULT - 1;
+}
 
-	for (ii = 0, node = obj->propval_list.start;
-			ii < obj->propval_list.nnodes; ii++, node = node->link) {
-		if (node == NULL || node->value == NULL)
-			goto ERROR_CATCH;
+/* Slot of a property value kept in obj->propvals, -1 if it is derived */
+static mtp_int32 __get_cache_slot(mtp_uint16 propcode)
+{
+	switch (propcode) {
+	case MTP_OBJ_PROPERTYCODE_OBJECTFILENAME:
+		return 0;
+	case MTP_OBJ_PROPERTYCODE_NAME:
+		return 1;
+	case MTP_OBJ_PROPERTYCODE_DATEMODIFIED:
+		return 2;
+	case MTP_OBJ_PROPERTYCODE_DATECREATED:
+		return 3;
+	default:
+		return -1;
+	}
+}
 
-		prop_val = (obj_prop_val_t *)node->value;
-		if (prop_val) {
-			if (prop_val->prop->propinfo.prop_code == propcode)
-				return prop_val;
-		}
+static mtp_uint32 __get_prop_cache_flag(mtp_uint16 propcode)
+{
+	switch (propcode) {
+	case MTP_OBJ_PROPERTYCODE_DATEMODIFIED:
+	case MTP_OBJ_PROPERTYCODE_DATECREATED:
+		return PROP_CACHE_CONTENT;
+	default:
+		return PROP_CACHE_PATH;
 	}
+}
 
-	return NULL;
+/*
+ * Integer properties are never kept per object: they are read from
+ * obj_info, or are the same for every object, when they are asked for.
+ */
+static mtp_bool __get_derived_integer(mtp_obj_t *obj, mtp_uint16 propcode,
+		mtp_uint64 *value)
+{
+	obj_info_t *info = obj->obj_info;
 
-ERROR_CATCH:
-	/* update property and try again */
-	_prop_update_property_values_list(obj);
+	switch (propcode) {
+	case MTP_OBJ_PROPERTYCODE_STORAGEID:
+		*value = info->store_id;
+		break;
+	case MTP_OBJ_PROPERTYCODE_OBJECTFORMAT:
+		*value = info->obj_fmt;
+		break;
+	case MTP_OBJ_PROPERTYCODE_PROTECTIONSTATUS:
+		*value = info->protcn_status;
+		break;
+	case MTP_OBJ_PROPERTYCODE_OBJECTSIZE:
+		*value = info->file_size;
+		break;
+	case MTP_OBJ_PROPERTYCODE_PARENT:
+		*value = info->h_parent;
+		break;
+	case MTP_OBJ_PROPERTYCODE_ASSOCIATIONTYPE:
+		*value = info->association_type;
+		break;
+	case MTP_OBJ_PROPERTYCODE_NONCONSUMABLE:
+	case MTP_OBJ_PROPERTYCODE_OMADRMSTATUS:
+		*value = 0;
+		break;
+	default:
+		return FALSE;
+	}
 
-	for (ii = 0, node = obj->propval_list.start;
-			ii < obj->propval_list.nnodes;
-			ii++, node = node->link) {
-		if (node == NULL || node->value == NULL)
-			break;
+	return TRUE;
+}
 
-		prop_val = (obj_prop_val_t *)node->value;
-		if ((prop_val) && (prop_val->prop->propinfo.prop_code ==
-					propcode)) {
-			return prop_val;
-		}
+static obj_prop_val_t *__build_file_name_prop(mtp_obj_t *obj,
+		obj_prop_desc_t *prop)
+{
+	mtp_char file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
+	mtp_wchar w_file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
+
+	_util_get_file_name(obj->file_path, file_name);
+	_util_utf8_to_utf16(w_file_name, sizeof(w_file_name) / WCHAR_SIZ, file_name);
+
+	return __create_prop_string(prop, w_file_name);
+}
+
+static obj_prop_val_t *__build_name_prop(mtp_obj_t *obj,
+		obj_prop_desc_t *prop)
+{
+	char filename_wo_extn[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_wchar buf[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+
+	_util_get_file_name_wo_extn(obj->file_path, filename_wo_extn);
+	_util_utf8_to_utf16(buf, sizeof(buf) / WCHAR_SIZ, filename_wo_extn);
+
+	return __create_prop_string(prop, buf);
+}
+
+static obj_prop_val_t *__build_time_prop(mtp_obj_t *obj,
+		obj_prop_desc_t *prop)
+{
+	ptp_time_string_t create_tm, modify_tm;
+
+	retvm_if(!_entity_get_file_times(obj, &create_tm, &modify_tm), NULL,
+			"_entity_get_file_times() Fail\n");
+
+	if (prop->propinfo.prop_code == MTP_OBJ_PROPERTYCODE_DATECREATED)
+		return __create_prop_timestring(prop, &create_tm);
+
+	return __create_prop_timestring(prop, &modify_tm);
+}
+
+/* Computes the current value of one cached property of obj */
+static obj_prop_val_t *__build_prop_val(mtp_obj_t *obj, obj_prop_desc_t *prop)
+{
+	switch (prop->propinfo.prop_code) {
+	case MTP_OBJ_PROPERTYCODE_OBJECTFILENAME:
+		return __build_file_name_prop(obj, prop);
+	case MTP_OBJ_PROPERTYCODE_DATEMODIFIED:
+	case MTP_OBJ_PROPERTYCODE_DATECREATED:
+		return __build_time_prop(obj, prop);
+	case MTP_OBJ_PROPERTYCODE_NAME:
+		return __build_name_prop(obj, prop);
+	default:
+		ERR("Create property Fail.. Prop = [0x%X]\n",
+				prop->propinfo.prop_code);
+		return NULL;
+	}
+}
+
+/*
+ * Returns the cached value of prop for obj, building it if obj does
+ * not have it yet or it was invalidated.
+ */
+static obj_prop_val_t *__get_cached_prop_val(mtp_obj_t *obj,
+		obj_prop_desc_t *prop)
+{
+	mtp_int32 slot = __get_cache_slot(prop->propinfo.prop_code);
+
+	retv_if(slot < 0, NULL);
+	retvm_if(obj->file_path == NULL || obj->file_path[0] != '/', NULL,
+		"Path is not valid.. path = [%s]\n", obj->file_path);
+
+	if (obj->propvals == NULL) {
+		obj->propvals = (obj_prop_val_t **)g_malloc0(
+				sizeof(obj_prop_val_t *) * NUM_CACHED_OBJ_PROPS);
+		retvm_if(!obj->propvals, NULL, "g_malloc0() Fail\n");
+	}
+
+	if (obj->propvals[slot] == NULL)
+		obj->propvals[slot] = __build_prop_val(obj, prop);
+
+	return obj->propvals[slot];
+}
+
+/*
+ * Fills *pval with the value of prop for obj. Integer values, and the
+ * GUID kept in the object, are made up in place; string values point
+ * into the object's cache and stay valid until the object changes.
+ */
+static mtp_bool __get_obj_propval(mtp_obj_t *obj, obj_prop_desc_t *prop,
+		obj_prop_val_t *pval)
+{
+	obj_prop_val_t *cached = NULL;
+	mtp_uint64 value = 0;
+
+	retv_if(obj->obj_info == NULL, FALSE);
+
+	if (__get_derived_integer(obj, prop->propinfo.prop_code, &value)) {
+		memset(pval, 0, sizeof(obj_prop_val_t));
+		pval->prop = prop;
+		memcpy(pval->current_val.integer,
+				prop->propinfo.default_val.integer,
+				prop->propinfo.dts_size);
+		_prop_set_current_integer_val(pval, value);
+		return TRUE;
+	}
+
+	if (prop->propinfo.prop_code == MTP_OBJ_PROPERTYCODE_PERSISTENTGUID) {
+		memset(pval, 0, sizeof(obj_prop_val_t));
+		pval->prop = prop;
+		memcpy(pval->current_val.integer, obj->guid, sizeof(obj->guid));
+		return TRUE;
+	}
+
+	cached = __get_cached_prop_val(obj, prop);
+	if (cached == NULL)
+		return FALSE;
+
+	memcpy(pval, cached, sizeof(obj_prop_val_t));
+	return TRUE;
+}
+
+mtp_bool _prop_get_prop_val(mtp_obj_t *obj, mtp_uint32 propcode,
+		obj_prop_val_t *pval)
+{
+	mtp_uint32 num_props = __get_num_obj_props();
+	mtp_uint32 ii = 0;
+
+	retv_if(obj == NULL, FALSE);
+	retv_if(pval == NULL, FALSE);
+
+	for (ii = 0; ii < num_props; ii++) {
+		if (props_list_default[ii].propinfo.prop_code == propcode)
+			return __get_obj_propval(obj, &(props_list_default[ii]),
+					pval);
+	}
+
+	ERR("No matched property[0x%x]\n", propcode);
+	return FALSE;
+}
+
+/*
+ * Drops the cached values that a change of the kinds in flags makes
+ * stale. They are built again the next time they are asked for.
+ */
+void _prop_invalidate_obj_propvals(mtp_obj_t *obj, mtp_uint32 flags)
+{
+	obj_prop_val_t *pval = NULL;
+	mtp_uint32 ii = 0;
+
+	ret_if(obj == NULL || obj->propvals == NULL);
+
+	for (ii = 0; ii < NUM_CACHED_OBJ_PROPS; ii++) {
+		pval = obj->propvals[ii];
+		if (pval == NULL)
+			continue;
+
+		if (!(__get_prop_cache_flag(pval->prop->propinfo.prop_code) & flags))
+			continue;
+
+		_prop_destroy_obj_propval(pval);
+		obj->propvals[ii] = NULL;
 	}
-	ERR("node or node->value is null. try again but not found\n");
-	return NULL;
 }
 
 mtp_uint32 _prop_size_obj_propval(obj_prop_val_t *pval)
@@ -1089,7 +1276,7 @@ mtp_uint32 _prop_size_obj_propval(obj_prop_val_t *pval)
 		if (pval->current_val.str == NULL)
 			size = 0;
 		else
-			size = _prop_size_ptpstring(pval->current_val.str);
+			size = _prop_size_ptpvstring(pval->current_val.str);
 
 	} else if ((pval->prop->propinfo.data_type & PTP_DATATYPE_ARRAYMASK) ==
 			PTP_DATATYPE_ARRAY) {
@@ -1115,10 +1302,8 @@ void _prop_destroy_obj_propval(obj_prop_val_t *pval)
 	}
 
 	if (pval->prop->propinfo.data_type == PTP_DATATYPE_STRING) {
-		if (pval->current_val.str) {
-			g_free(pval->current_val.str);
-			pval->current_val.str = NULL;
-		}
+		_prop_unref_ptpvstring(pval->current_val.str);
+		pval->current_val.str = NULL;
 	} else if ((pval->prop->propinfo.data_type & PTP_DATATYPE_ARRAYMASK) ==
 			PTP_DATATYPE_ARRAY) {
 		_prop_destroy_ptparray(pval->current_val.array);
@@ -1215,7 +1400,7 @@ mtp_uint32 _prop_size_obj_prop_desc(obj_prop_desc_t *prop)
 	/* size of default value: DTS */
 	if (prop->propinfo.data_type == PTP_DATATYPE_STRING) {
 
-		size += _prop_size_ptpstring(prop->propinfo.default_val.str);
+		size += _prop_size_ptpvstring(prop->propinfo.default_val.str);
 
 	} else if ((prop->propinfo.data_type & PTP_DATATYPE_ARRAYMASK) ==
 			PTP_DATATYPE_ARRAY) {
@@ -1253,7 +1438,7 @@ mtp_uint32 _prop_size_obj_prop_desc(obj_prop_desc_t *prop)
 					ii < prop->propinfo.supp_value_list.nnodes;
 					ii++, node = node->link) {
 
-				size += _prop_size_ptpstring((ptp_string_t *) node->value);
+				size += _prop_size_ptpvstring((ptp_vstring_t *) node->value);
 			}
 		}
 		break;
@@ -1262,7 +1447,7 @@ mtp_uint32 _prop_size_obj_prop_desc(obj_prop_desc_t *prop)
 		break;
 
 	case REGULAR_EXPRESSION_FORM:
-		size += _prop_size_ptpstring(prop->prop_forms.reg_exp);
+		size += _prop_size_ptpvstring(prop->prop_forms.reg_exp);
 		break;
 
 	case BYTE_ARRAY_FORM:
@@ -1317,8 +1502,8 @@ mtp_uint32 _prop_pack_obj_prop_desc(obj_prop_desc_t *prop, mtp_uchar *buf,
 	if (prop->propinfo.data_type == PTP_DATATYPE_STRING) {
 
 		bytes_to_write =
-			_prop_size_ptpstring(prop->propinfo.default_val.str);
-		if (bytes_to_write != _prop_pack_ptpstring(prop->propinfo.default_val.str,
+			_prop_size_ptpvstring(prop->propinfo.default_val.str);
+		if (bytes_to_write != _prop_pack_ptpvstring(prop->propinfo.default_val.str,
 					temp, bytes_to_write)) {
 			return (mtp_uint32)(temp - buf);
 		}
@@ -1404,9 +1589,9 @@ mtp_uint32 _prop_pack_obj_prop_desc(obj_prop_desc_t *prop, mtp_uchar *buf,
 					ii++, node = node->link) {
 
 				bytes_to_write =
-					_prop_size_ptpstring((ptp_string_t *) node->value);
+					_prop_size_ptpvstring((ptp_vstring_t *) node->value);
 				if (bytes_to_write !=
-						_prop_pack_ptpstring((ptp_string_t *) node->value,
+						_prop_pack_ptpvstring((ptp_vstring_t *) node->value,
 							temp, bytes_to_write)) {
 					return (mtp_uint32) (temp - buf);
 				}
@@ -1433,9 +1618,9 @@ mtp_uint32 _prop_pack_obj_prop_desc(obj_prop_desc_t *prop, mtp_uchar *buf,
 		break;
 
 	case REGULAR_EXPRESSION_FORM:
-		bytes_to_write = _prop_size_ptpstring(prop->prop_forms.reg_exp);
+		bytes_to_write = _prop_size_ptpvstring(prop->prop_forms.reg_exp);
 		if (bytes_to_write !=
-				_prop_pack_ptpstring(prop->prop_forms.reg_exp,
+				_prop_pack_ptpvstring(prop->prop_forms.reg_exp,
 					temp, bytes_to_write)) {
 
 			return (mtp_uint32)(temp - buf);
@@ -1467,13 +1652,7 @@ obj_prop_desc_t *_prop_get_obj_prop_desc(mtp_uint32 format_code,
 		mtp_uint32 propcode)
 {
 	mtp_uint32 i = 0;
-	int num_default_obj_props = 0;
-
-	/*Default*/
-	if (_get_oma_drm_status() == TRUE)
-		num_default_obj_props = NUM_OBJECT_PROP_DESC_DEFAULT;
-	else
-		num_default_obj_props = NUM_OBJECT_PROP_DESC_DEFAULT - 1;
+	mtp_uint32 num_default_obj_props = __get_num_obj_props();
 
 	for (i = 0; i < num_default_obj_props; i++) {
 		if (props_list_default[i].propinfo.prop_code == propcode)
@@ -1488,228 +1667,146 @@ obj_prop_desc_t *_prop_get_obj_prop_desc(mtp_uint32 format_code,
 }
 
 /* Objectproplist functions */
-static mtp_bool __append_obj_proplist(obj_proplist_t *prop_list, mtp_uint32 obj_handle,
-		mtp_uint16 propcode, mtp_uint32 data_type, mtp_uchar *val)
+static mtp_uint32 __size_obj_propval_quad(obj_prop_val_t *pval)
 {
-	ptp_string_t *str = NULL;
-	prop_quad_t *quad = NULL;
-	ptp_array_t *arr_uint8;
-	ptp_array_t *arr_uint16;
-	ptp_array_t *arr_uint32;
-
-	quad = (prop_quad_t *)g_malloc(sizeof(prop_quad_t));
-	if (NULL == quad)
-		return FALSE;
-
-	quad->obj_handle = obj_handle;
-	quad->prop_code =  propcode;
-	quad->data_type =  data_type;
-	quad->pval = val;
+	prop_info_t *propinfo = &(pval->prop->propinfo);
 
-	switch (data_type) {
-	case PTP_DATATYPE_UINT8:
-	case PTP_DATATYPE_INT8:
-		quad->val_size = sizeof(mtp_uchar);
-		break;
+	if (propinfo->data_type == PTP_DATATYPE_STRING) {
+		/* A missing string goes out as an empty one */
+		return (pval->current_val.str != NULL) ?
+			_prop_size_ptpvstring(pval->current_val.str) : 1;
+	}
 
-	case PTP_DATATYPE_UINT16:
-	case PTP_DATATYPE_INT16:
-		quad->val_size = sizeof(mtp_uint16);
-		break;
+	if ((propinfo->data_type & PTP_DATATYPE_ARRAYMASK) ==
+			PTP_DATATYPE_ARRAY) {
+		return (pval->current_val.array != NULL) ?
+			_prop_get_size_ptparray(pval->current_val.array) :
+			sizeof(mtp_uint32);
+	}
 
-	case PTP_DATATYPE_UINT32:
-	case PTP_DATATYPE_INT32:
-		quad->val_size = sizeof(mtp_uint32);
-		break;
+	return propinfo->dts_size;
+}
 
-	case PTP_DATATYPE_UINT64:
-	case PTP_DATATYPE_INT64:
-		quad->val_size = sizeof(mtp_int64);
-		break;
+static mtp_uint32 __pack_obj_propval_quad(mtp_uint32 obj_handle,
+		obj_prop_val_t *pval, mtp_uchar *buf, mtp_uint32 size)
+{
+	prop_info_t *propinfo = &(pval->prop->propinfo);
+	mtp_uint32 val_size = __size_obj_propval_quad(pval);
+	mtp_uchar *temp = buf;
 
-	case PTP_DATATYPE_UINT128:
-	case PTP_DATATYPE_INT128:
-		quad->val_size = 2 * sizeof(mtp_int64);
-		break;
+	retv_if(size < PROP_QUAD_HEADER_SIZE + val_size, 0);
 
-	case PTP_DATATYPE_AUINT8:
-	case PTP_DATATYPE_AINT8:
-		memcpy(&arr_uint8, val, sizeof(ptp_array_t *));
-		quad->val_size = (arr_uint8 != NULL) ?
-			_prop_get_size_ptparray(arr_uint8) : 0;
-		quad->pval = (mtp_uchar *)arr_uint8;
-		break;
+	memcpy(temp, &obj_handle, sizeof(mtp_uint32));
+#ifdef __BIG_ENDIAN__
+	_util_conv_byte_order(temp, sizeof(mtp_uint32));
+#endif /* __BIG_ENDIAN__ */
+	temp += sizeof(mtp_uint32);
 
-	case PTP_DATATYPE_AUINT16:
-	case PTP_DATATYPE_AINT16:
-		memcpy(&arr_uint16, val, sizeof(ptp_array_t *));
-		quad->val_size = (arr_uint16 != NULL) ?
-			_prop_get_size_ptparray(arr_uint16) : 0;
-		quad->pval = (mtp_uchar *)arr_uint16;
-		break;
+	memcpy(temp, &(propinfo->prop_code), sizeof(mtp_uint16));
+#ifdef __BIG_ENDIAN__
+	_util_conv_byte_order(temp, sizeof(mtp_uint16));
+#endif /* __BIG_ENDIAN__ */
+	temp += sizeof(mtp_uint16);
 
-	case PTP_DATATYPE_AUINT32:
-	case PTP_DATATYPE_AINT32:
-		memcpy(&arr_uint32, val, sizeof(ptp_array_t *));
-		quad->val_size = (arr_uint32 != NULL) ? _prop_get_size_ptparray(arr_uint32) : 0;
-		quad->pval = (mtp_uchar *)arr_uint32;
-		break;
+	memcpy(temp, &(propinfo->data_type), sizeof(mtp_uint16));
+#ifdef __BIG_ENDIAN__
+	_util_conv_byte_order(temp, sizeof(mtp_uint16));
+#endif /* __BIG_ENDIAN__ */
+	temp += sizeof(mtp_uint16);
 
-	case PTP_DATATYPE_STRING:
-		memcpy(&str, val, sizeof(ptp_string_t *));
-		quad->val_size = (str != NULL) ? _prop_size_ptpstring(str) : 1;
-		quad->pval = (mtp_uchar *)str;
-		break;
-	default:
-		/* don't know  */
-		quad->val_size = 0;
-		break;
+	if (propinfo->data_type == PTP_DATATYPE_STRING) {
+		if (pval->current_val.str == NULL)
+			*temp = 0;
+		else
+			_prop_pack_ptpvstring(pval->current_val.str, temp,
+					val_size);
+	} else if ((propinfo->data_type & PTP_DATATYPE_ARRAYMASK) ==
+			PTP_DATATYPE_ARRAY) {
+		if (pval->current_val.array == NULL)
+			memset(temp, 0, sizeof(mtp_uint32));
+		else
+			_prop_pack_ptparray(pval->current_val.array, temp,
+					val_size);
+	} else {
+		memcpy(temp, pval->current_val.integer, val_size);
+#ifdef __BIG_ENDIAN__
+		_util_conv_byte_order(temp, val_size);
+#endif /* __BIG_ENDIAN__ */
 	}
 
-	_util_add_node(&(prop_list->prop_quad_list), quad);
-	return TRUE;
+	return PROP_QUAD_HEADER_SIZE + val_size;
 }
-mtp_uint32 _prop_get_obj_proplist(mtp_obj_t *obj, mtp_uint32 propcode,
-		mtp_uint32 group_code, obj_proplist_t *prop_list)
+
+/*
+ * Counts the ObjectPropList quadruples of one object and adds their
+ * packed size to *size. Only the selected property values are built.
+ */
+mtp_uint32 _prop_size_obj_proplist(mtp_obj_t *obj, mtp_uint32 propcode,
+		mtp_uint32 group_code, mtp_uint64 *size)
 {
-	obj_prop_val_t *propval = NULL;
-	slist_node_t *node = NULL;
+	obj_prop_val_t propval;
+	mtp_uint32 num_props = __get_num_obj_props();
+	mtp_uint32 num_quads = 0;
 	mtp_uint32 ii = 0;
 
-	if (obj->propval_list.nnodes == 0)
-		retvm_if(!_prop_update_property_values_list(obj), 0,
-			"update Property Values FAIL!!\n");
-
-	for (ii = 0, node = obj->propval_list.start;
-			ii < obj->propval_list.nnodes;
-			ii++, node = node->link) {
-		propval = (obj_prop_val_t *)node->value;
-
-		if (NULL == propval)
-			continue;
-
-		if (FALSE == __check_object_propcode(propval->prop,
+	for (ii = 0; ii < num_props; ii++) {
+		if (FALSE == __check_object_propcode(&(props_list_default[ii]),
 					propcode, group_code)) {
 			continue;
 		}
-		__append_obj_proplist(prop_list, obj->obj_handle,
-				propval->prop->propinfo.prop_code,
-				propval->prop->propinfo.data_type,
-				(mtp_uchar *)propval->current_val.integer);
+
+		if (!__get_obj_propval(obj, &(props_list_default[ii]), &propval))
+			continue;
+
+		*size += PROP_QUAD_HEADER_SIZE + __size_obj_propval_quad(&propval);
+		num_quads++;
 	}
 
-	return prop_list->prop_quad_list.nnodes;
+	return num_quads;
 }
 
-mtp_bool _prop_update_property_values_list(mtp_obj_t *obj)
+/*
+ * Packs the quadruples counted by _prop_size_obj_proplist() one at a
+ * time and hands each to the writer, so that a list is never held in
+ * memory as a whole.
+ */
+mtp_bool _prop_write_obj_proplist(mtp_obj_t *obj, mtp_uint32 propcode,
+		mtp_uint32 group_code, prop_list_writer_t writer, void *data)
 {
+	obj_prop_val_t propval;
+	mtp_uchar quad[PROP_QUAD_BUF_SIZE];
+	mtp_uchar *buf = NULL;
+	mtp_uint32 buf_sz = 0;
+	mtp_uint32 quad_sz = 0;
+	mtp_uint32 num_props = __get_num_obj_props();
+	mtp_bool ret = TRUE;
 	mtp_uint32 ii = 0;
-	mtp_char guid[16] = { 0 };
-	slist_node_t *node = NULL;
-	slist_node_t *next_node = NULL;
-	ptp_time_string_t create_tm, modify_tm;
-	mtp_wchar buf[MTP_MAX_PATHNAME_SIZE+1] = { 0 };
-	mtp_char file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
-	mtp_wchar w_file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
-	char filename_wo_extn[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-	mtp_wchar object_fullpath[MTP_MAX_PATHNAME_SIZE * 2 + 1] = { 0 };
-
-	retv_if(obj == NULL, FALSE);
-	retv_if(obj->obj_info == NULL, FALSE);
 
-	if (obj->propval_list.nnodes > 0) {
-		/*
-		 * Remove all the old property value,
-		 * and ready to set up new list
-		 */
-		for (ii = 0, next_node = obj->propval_list.start;
-				ii < obj->propval_list.nnodes; ii++) {
-			node = next_node;
-			next_node = node->link;
-			_prop_destroy_obj_propval((obj_prop_val_t *)
-					node->value);
-			g_free(node);
+	for (ii = 0; ii < num_props && ret; ii++) {
+		if (FALSE == __check_object_propcode(&(props_list_default[ii]),
+					propcode, group_code)) {
+			continue;
 		}
-		obj->propval_list.start = NULL;
-		obj->propval_list.end = NULL;
-		obj->propval_list.nnodes = 0;
-		node = NULL;
-	}
-
-	/* Populate Object Info to Object properties */
-	retvm_if(obj->file_path == NULL || obj->file_path[0] != '/', FALSE,
-		"Path is not valid.. path = [%s]\n", obj->file_path);
 
-	/*STORAGE ID*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_STORAGEID,
-				obj->obj_info->store_id), FALSE);
-
-	/*OBJECT FORMAT*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_OBJECTFORMAT,
-				obj->obj_info->obj_fmt), FALSE);
-
-	/*PROTECTION STATUS*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_PROTECTIONSTATUS,
-				obj->obj_info->protcn_status), FALSE);
-
-	/*OBJECT SIZE*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_OBJECTSIZE,
-				obj->obj_info->file_size), FALSE);
+		if (!__get_obj_propval(obj, &(props_list_default[ii]), &propval))
+			continue;
 
-	/*OBJECT FILENAME*/
-	_util_get_file_name(obj->file_path, file_name);
-	_util_utf8_to_utf16(w_file_name, sizeof(w_file_name) / WCHAR_SIZ, file_name);
-	retv_if(FALSE == __create_prop_string(obj,
-				MTP_OBJ_PROPERTYCODE_OBJECTFILENAME, w_file_name), FALSE);
-
-	/*PARENT*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_PARENT, obj->obj_info->h_parent), FALSE);
-
-	/*PERSISTENT GUID*/
-	_util_utf8_to_utf16(object_fullpath,
-			sizeof(object_fullpath) / WCHAR_SIZ, obj->file_path);
-	_util_conv_wstr_to_guid(object_fullpath, (mtp_uint64 *) guid);
-	retv_if((FALSE == __create_prop_array(obj,
-					MTP_OBJ_PROPERTYCODE_PERSISTENTGUID,
-					guid, sizeof(guid))), FALSE);
-
-	/*NON-CONSUMABLE*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_NONCONSUMABLE, 0), FALSE);
-
-	_entity_get_file_times(obj, &create_tm, &modify_tm);
-	/*DATE MODIFIED*/
-	retv_if(FALSE == __create_prop_timestring(obj, MTP_OBJ_PROPERTYCODE_DATEMODIFIED,
-		&modify_tm), FALSE);
-
-	/*DATE CREATED*/
-	retv_if(FALSE == __create_prop_timestring(obj, MTP_OBJ_PROPERTYCODE_DATECREATED,
-		&create_tm), FALSE);
-
-	/* NAME */
-	_util_get_file_name_wo_extn(obj->file_path,
-			filename_wo_extn);
-	_util_utf8_to_utf16(buf, sizeof(buf) / WCHAR_SIZ, filename_wo_extn);
-	retv_if(FALSE == __create_prop_string(obj,
-				MTP_OBJ_PROPERTYCODE_NAME, buf), FALSE);
+		buf = quad;
+		buf_sz = PROP_QUAD_HEADER_SIZE + __size_obj_propval_quad(&propval);
+		if (buf_sz > sizeof(quad)) {
+			buf = (mtp_uchar *)g_malloc(buf_sz);
+			retvm_if(!buf, FALSE, "g_malloc() Fail\n");
+		}
 
-	/*ASSOCIATION TYPE*/
-	retv_if(FALSE == __create_prop_integer(obj,
-				MTP_OBJ_PROPERTYCODE_ASSOCIATIONTYPE,
-				obj->obj_info->association_type), FALSE);
+		quad_sz = __pack_obj_propval_quad(obj->obj_handle, &propval,
+				buf, buf_sz);
+		ret = (quad_sz == buf_sz) && writer(data, buf, quad_sz);
 
-	/* OMADRM STATUS */
-	if (_get_oma_drm_status() == TRUE) {
-		retv_if(FALSE == __create_prop_integer(obj,
-					MTP_OBJ_PROPERTYCODE_OMADRMSTATUS, 0), FALSE);
+		if (buf != quad)
+			g_free(buf);
 	}
 
-	return TRUE;
+	return ret;
 }
 
 /* LCOV_EXCL_STOP */
@@ -1729,21 +1826,22 @@ mtp_bool _prop_add_supp_integer_val(prop_info_t *prop_info, mtp_uint32 value)
 
 mtp_bool _prop_add_supp_string_val(prop_info_t *prop_info, mtp_wchar *val)
 {
-	ptp_string_t *str = NULL;
+	ptp_string_t str = { 0 };
+	ptp_vstring_t *vstr = NULL;
 	mtp_bool ret;
 
 	if ((prop_info->data_type != PTP_DATATYPE_STRING) ||
 			(prop_info->form_flag != ENUM_FORM)) {
 		return FALSE;
 	}
-	str = __alloc_ptpstring();
 
-	if (str != NULL) {
-		_prop_copy_char_to_ptpstring(str, val, WCHAR_TYPE);
-		ret = _util_add_node(&(prop_info->supp_value_list), (void *)str);
+	_prop_copy_char_to_ptpstring(&str, val, WCHAR_TYPE);
+	vstr = _prop_alloc_ptpvstring(&str);
+	if (vstr != NULL) {
+		ret = _util_add_node(&(prop_info->supp_value_list), (void *)vstr);
 		if (ret == FALSE) {
 			ERR("List add Fail\n");
-			g_free(str);
+			_prop_unref_ptpvstring(vstr);
 			return FALSE;
 		}
 		return TRUE;
@@ -1756,13 +1854,7 @@ mtp_uint32 _prop_get_supp_obj_props(mtp_uint32 format_code,
 		ptp_array_t *supp_props)
 {
 	mtp_uint32 i = 0;
-	mtp_uint32 num_default_obj_props = 0;
-
-	/*Default*/
-	if (_get_oma_drm_status() == TRUE)
-		num_default_obj_props = NUM_OBJECT_PROP_DESC_DEFAULT;
-	else
-		num_default_obj_props = NUM_OBJECT_PROP_DESC_DEFAULT - 1;
+	mtp_uint32 num_default_obj_props = __get_num_obj_props();
 
 	for (i = 0; i < num_default_obj_props; i++) {
 		_prop_append_ele_ptparray(supp_props,
@@ -1775,6 +1867,62 @@ mtp_uint32 _prop_get_supp_obj_props(mtp_uint32 format_code,
 	return supp_props->num_ele;
 }
 
+static mtp_bool __is_interdep_proplist_per_format(
+		obj_interdep_proplist_t *config_list)
+{
+	interdep_prop_config_t *prop_config = NULL;
+	slist_node_t *node = config_list->plist.start;
+	mtp_int32 ii;
+
+	for (ii = 0; ii < config_list->plist.nnodes; ii++, node = node->link) {
+		prop_config = node->value;
+		if (prop_config->format_code != PTP_FORMATCODE_NOTUSED)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* The descriptions never change once built, so they are packed once */
+static void __build_prop_desc_blks(void)
+{
+	mtp_uint32 num_props = __get_num_obj_props();
+	mtp_uint32 size = 0;
+	mtp_uint32 ii = 0;
+
+	for (ii = 0; ii < num_props; ii++) {
+		size = _prop_size_obj_prop_desc(&(props_list_default[ii]));
+		g_prop_desc_blks[ii] = _hdlr_alloc_prebuilt_data(size,
+				&(g_prop_desc_blk_lens[ii]));
+		if (g_prop_desc_blks[ii] == NULL)
+			continue;
+
+		if (_prop_pack_obj_prop_desc(&(props_list_default[ii]),
+					g_prop_desc_blks[ii] + sizeof(header_container_t),
+					size) != size) {
+			ERR("_prop_pack_obj_prop_desc() Fail\n");
+			g_free(g_prop_desc_blks[ii]);
+			g_prop_desc_blks[ii] = NULL;
+		}
+	}
+
+	if (__is_interdep_proplist_per_format(&interdep_proplist))
+		return;
+
+	size = _prop_get_size_interdep_proplist(&interdep_proplist,
+			PTP_FORMATCODE_NOTUSED);
+	g_interdep_blk = _hdlr_alloc_prebuilt_data(size, &g_interdep_blk_len);
+	ret_if(g_interdep_blk == NULL);
+
+	if (_prop_pack_interdep_proplist(&interdep_proplist,
+				PTP_FORMATCODE_NOTUSED,
+				g_interdep_blk + sizeof(header_container_t),
+				size) != size) {
+		ERR("_prop_pack_interdep_proplist() Fail\n");
+		g_free(g_interdep_blk);
+		g_interdep_blk = NULL;
+	}
+}
+
 mtp_bool _prop_build_supp_props_default(void)
 {
 	mtp_wchar temp[MTP_MAX_REG_STRING + 1] = { 0 };
@@ -1993,11 +2141,44 @@ mtp_bool _prop_build_supp_props_default(void)
 				(mtp_uchar *)&default_val);
 	}
 
+	__build_prop_desc_blks();
 	initialized = TRUE;
 
 	return TRUE;
 }
 
+mtp_bool _prop_get_packed_obj_prop_desc(mtp_uint32 format_code,
+		mtp_uint32 propcode, mtp_uchar **blk, mtp_uint32 *blk_len)
+{
+	obj_prop_desc_t *prop = NULL;
+	mtp_uint32 idx = 0;
+
+	prop = _prop_get_obj_prop_desc(format_code, propcode);
+	retv_if(prop == NULL, FALSE);
+
+	idx = prop - props_list_default;
+	retv_if(g_prop_desc_blks[idx] == NULL, FALSE);
+
+	*blk = g_prop_desc_blks[idx];
+	*blk_len = g_prop_desc_blk_lens[idx];
+	return TRUE;
+}
+
+/*
+ * The InterdependentPropDesc data block is the same for every format,
+ * unless some entries apply to one format only: then there is none and
+ * the dataset has to be packed for the format asked for.
+ */
+mtp_bool _prop_get_packed_interdep_proplist(mtp_uchar **blk,
+		mtp_uint32 *blk_len)
+{
+	retv_if(g_interdep_blk == NULL, FALSE);
+
+	*blk = g_interdep_blk;
+	*blk_len = g_interdep_blk_len;
+	return TRUE;
+}
+
 /* LCOV_EXCL_ST */
 mtp_uint32 _prop_get_size_interdep_prop(interdep_prop_config_t *prop_config)
 {
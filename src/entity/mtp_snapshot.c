@@ -0,0 +1,613 @@
+/*
+ * Copyright (c) 2019 Collabora Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mtp_util.h"
+#include "mtp_support.h"
+#include "mtp_thread.h"
+#include "mtp_device.h"
+#include "mtp_inoti_handler.h"
+
+/*
+ * Snapshot of the object table of a store, written on storage removal
+ * and periodically, and read back at the next install so that only the
+ * folders that changed in between have to be scanned again. Objects that
+ * cannot be restored as they are keep their handle in a table of
+ * previous handles, looked up by inode and by path when they are found
+ * again.
+ *
+ * Layout, in host byte order:
+ *	snapshot_header_t
+ *	snapshot_record_t[num_records], parents before their children
+ *	names: root path, then one NUL terminated file name per record
+ */
+#define MTP_SNAPSHOT_MAGIC	0x50414E53	/* "SNAP" */
+#define MTP_SNAPSHOT_VERSION	2	/* Bumped with any layout change */
+#define MTP_SNAPSHOT_RECORD_SIZE	48	/* sizeof(snapshot_record_t) */
+
+#define SNAPSHOT_FLAG_ENUMERATED	0x0001	/* Folder contents recorded */
+#define SNAPSHOT_FLAG_READ_ONLY		0x0002
+
+typedef struct {
+	mtp_uint32 magic;
+	mtp_uint32 version;
+	mtp_uint32 store_id;
+	mtp_uint32 num_records;
+	mtp_uint32 next_handle;	/* g_next_obj_handle when written */
+	mtp_uint32 names_size;
+	mtp_int64 root_mtime;
+	mtp_uint32 root_flags;
+	mtp_uint32 reserved;
+} snapshot_header_t;
+
+typedef struct {
+	mtp_uint32 handle;
+	mtp_uint32 h_parent;
+	mtp_uint64 size;
+	mtp_int64 mtime;	/* Folders: mtime in ns when scanned */
+	mtp_uint64 dev;
+	mtp_uint64 ino;
+	mtp_uint32 name_off;	/* Into the names area */
+	mtp_uint16 fmt;
+	mtp_uint16 flags;
+} snapshot_record_t;
+
+G_STATIC_ASSERT(sizeof(snapshot_record_t) == MTP_SNAPSHOT_RECORD_SIZE);
+
+/* Identity of a file, inode numbers are only unique within a device */
+typedef struct {
+	mtp_uint64 dev;
+	mtp_uint64 ino;
+} file_id_t;
+
+/* Handle an object had in the previous session */
+typedef struct {
+	file_id_t id;
+	mtp_uint32 handle;
+	mtp_char *path;
+} prev_handle_t;
+
+extern mtp_uint32 g_next_obj_handle;
+extern pthread_rwlock_t g_store_lock;
+
+static GHashTable *g_prev_by_id = NULL;	/* file_id_t -> prev_handle_t */
+static GHashTable *g_prev_by_path = NULL;	/* path -> prev_handle_t, owner */
+
+static mtp_char *__get_snapshot_path(mtp_uint32 store_id)
+{
+	return g_strdup_printf("%s/store-%08x.snap", MTP_SNAPSHOT_DIR, store_id);
+}
+
+static mtp_int64 __get_mtime_ns(const struct stat *stat_buf)
+{
+	return (mtp_int64)stat_buf->st_mtim.tv_sec * 1000000000LL +
+		stat_buf->st_mtim.tv_nsec;
+}
+
+static guint __file_id_hash(gconstpointer key)
+{
+	const file_id_t *id = (const file_id_t *)key;
+
+	return (guint)(id->ino ^ (id->ino >> 32)) ^ (guint)(id->dev * 31);
+}
+
+static gboolean __file_id_equal(gconstpointer a, gconstpointer b)
+{
+	const file_id_t *id_a = (const file_id_t *)a;
+	const file_id_t *id_b = (const file_id_t *)b;
+
+	return id_a->ino == id_b->ino && id_a->dev == id_b->dev;
+}
+
+static void __free_prev_handle(gpointer data)
+{
+	prev_handle_t *prev = (prev_handle_t *)data;
+
+	g_free(prev->path);
+	g_free(prev);
+}
+
+static void __clear_prev_handles(void)
+{
+	if (g_prev_by_id) {
+		g_hash_table_destroy(g_prev_by_id);
+		g_prev_by_id = NULL;
+	}
+	if (g_prev_by_path) {
+		g_hash_table_destroy(g_prev_by_path);
+		g_prev_by_path = NULL;
+	}
+}
+
+static void __forget_prev_handle(prev_handle_t *prev)
+{
+	if (prev->id.ino && g_hash_table_lookup(g_prev_by_id, &prev->id) == prev)
+		g_hash_table_remove(g_prev_by_id, &prev->id);
+
+	/* Frees prev */
+	g_hash_table_remove(g_prev_by_path, prev->path);
+}
+
+static void __add_prev_handle(gpointer data, gpointer user_data)
+{
+	prev_handle_t *prev = (prev_handle_t *)data;
+	prev_handle_t *old = NULL;
+
+	if (g_prev_by_path == NULL) {
+		g_prev_by_id = g_hash_table_new(__file_id_hash, __file_id_equal);
+		g_prev_by_path = g_hash_table_new_full(g_str_hash, g_str_equal,
+				NULL, __free_prev_handle);
+	}
+
+	old = (prev_handle_t *)g_hash_table_lookup(g_prev_by_path, prev->path);
+	if (old)
+		__forget_prev_handle(old);
+
+	g_hash_table_insert(g_prev_by_path, prev->path, prev);
+	if (prev->id.ino)
+		g_hash_table_replace(g_prev_by_id, &prev->id, prev);
+}
+
+/*
+ * Forgets the handles left over from an earlier session, before the
+ * stores load their snapshots. Each store adds to the same map then.
+ */
+void _entity_clear_previous_handles(void)
+{
+	__clear_prev_handles();
+}
+
+/*
+ * Gives back the handle the file had in the previous session, found by
+ * device and inode, or by path if the file was replaced. Each handle is
+ * given out once, and never if it is in use already.
+ */
+mtp_uint32 _entity_take_previous_handle(const mtp_char *file_path,
+		mtp_uint64 dev, mtp_uint64 ino)
+{
+	prev_handle_t *prev = NULL;
+	file_id_t id = { dev, ino };
+	mtp_uint32 handle = 0;
+
+	if (g_prev_by_path == NULL || file_path == NULL)
+		return 0;
+
+	if (ino != 0) {
+		prev = (prev_handle_t *)g_hash_table_lookup(g_prev_by_id, &id);
+
+		/* Inode number now used by another file */
+		if (prev && g_strcmp0(prev->path, file_path) &&
+				access(prev->path, F_OK) == 0)
+			prev = NULL;
+	}
+
+	if (prev == NULL)
+		prev = (prev_handle_t *)g_hash_table_lookup(g_prev_by_path,
+				file_path);
+	if (prev == NULL)
+		return 0;
+
+	handle = prev->handle;
+	__forget_prev_handle(prev);
+
+	if (_device_get_object_with_handle(handle) != NULL)
+		return 0;
+
+	return handle;
+}
+
+static void __snapshot_add_children(mtp_store_t *store, ptp_array_t *children,
+		GByteArray *records, GByteArray *names, mtp_uint32 *count)
+{
+	mtp_uint32 *ptr32 = children->array_entry;
+	snapshot_record_t rec = { 0 };
+	mtp_obj_t *obj = NULL;
+	mtp_char *name = NULL;
+	mtp_uint32 ii = 0;
+
+	for (ii = 0; ii < children->num_ele; ii++) {
+		obj = _entity_get_object_from_store(store, ptr32[ii]);
+		if (obj == NULL || obj->obj_info == NULL || obj->file_path == NULL)
+			continue;
+
+		name = strrchr(obj->file_path, '/');
+		name = name ? name + 1 : obj->file_path;
+
+		rec.handle = obj->obj_handle;
+		rec.h_parent = obj->obj_info->h_parent;
+		rec.size = obj->obj_info->file_size;
+		rec.mtime = obj->is_enumerated ? obj->dir_mtime : 0;
+		rec.dev = obj->dev;
+		rec.ino = obj->ino;
+		rec.name_off = names->len;
+		rec.fmt = obj->obj_info->obj_fmt;
+		rec.flags = 0;
+		if (obj->is_enumerated)
+			rec.flags |= SNAPSHOT_FLAG_ENUMERATED;
+		if (obj->obj_info->protcn_status != PTP_PROTECTIONSTATUS_NOPROTECTION)
+			rec.flags |= SNAPSHOT_FLAG_READ_ONLY;
+
+		g_byte_array_append(names, (guint8 *)name, strlen(name) + 1);
+		g_byte_array_append(records, (guint8 *)&rec, sizeof(rec));
+		(*count)++;
+
+		if (obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION)
+			__snapshot_add_children(store, &(obj->children), records,
+					names, count);
+	}
+}
+
+/*
+ * Packs the object table of a store into a snapshot, with the store lock
+ * held. It is written by _entity_write_store_snapshot() once the lock is
+ * released.
+ */
+GByteArray *_entity_pack_store_snapshot(mtp_store_t *store)
+{
+	snapshot_header_t hdr = { 0 };
+	GByteArray *records = NULL;
+	GByteArray *names = NULL;
+
+	retv_if(store == NULL, NULL);
+	retv_if(store->root_path == NULL, NULL);
+
+	records = g_byte_array_new();
+	names = g_byte_array_new();
+
+	g_byte_array_append(names, (guint8 *)store->root_path,
+			strlen(store->root_path) + 1);
+	__snapshot_add_children(store, &(store->root_children), records, names,
+			&hdr.num_records);
+
+	hdr.magic = MTP_SNAPSHOT_MAGIC;
+	hdr.version = MTP_SNAPSHOT_VERSION;
+	hdr.store_id = store->store_id;
+	hdr.next_handle = g_next_obj_handle;
+	hdr.names_size = names->len;
+	hdr.root_mtime = store->root_mtime;
+	hdr.root_flags = store->is_root_enumerated ? SNAPSHOT_FLAG_ENUMERATED : 0;
+
+	g_byte_array_prepend(records, (guint8 *)&hdr, sizeof(hdr));
+	g_byte_array_append(records, names->data, names->len);
+	g_byte_array_free(names, TRUE);
+
+	return records;
+}
+
+/* Writes a packed snapshot, without the store lock */
+mtp_bool _entity_write_store_snapshot(mtp_uint32 store_id,
+		const GByteArray *snapshot)
+{
+	mtp_char *path = NULL;
+	GError *error = NULL;
+	mtp_bool ret = FALSE;
+
+	retv_if(snapshot == NULL, FALSE);
+
+	path = __get_snapshot_path(store_id);
+	if (g_mkdir_with_parents(MTP_SNAPSHOT_DIR, 0700) < 0) {
+		ERR("Cannot make directory [%s]\n", MTP_SNAPSHOT_DIR);
+	} else if (!g_file_set_contents(path, (gchar *)snapshot->data,
+				snapshot->len, &error)) {
+		ERR("Snapshot write Fail [%s]\n", error ? error->message : "");
+		g_clear_error(&error);
+	} else {
+		DBG("Snapshot of [%u] objects written to [%s]\n",
+				((const snapshot_header_t *)snapshot->data)->num_records,
+				path);
+		ret = TRUE;
+	}
+
+	g_free(path);
+
+	return ret;
+}
+
+/* One record, checked against the file system before the merge */
+typedef struct {
+	const snapshot_record_t *rec;
+	mtp_char *path;
+	const mtp_char *name;
+	file_attr_t attrs;
+	mtp_bool is_valid;	/* Still there, or trusted to be */
+	mtp_bool is_enumerated;	/* Folder unchanged since the snapshot */
+} load_item_t;
+
+/*
+ * Entries of folders whose mtime still matches are trusted as they are,
+ * entries of other folders are checked against the file system. Runs
+ * without the store lock.
+ */
+static void __check_record(load_item_t *item, mtp_bool is_trusted)
+{
+	const snapshot_record_t *rec = item->rec;
+	mtp_bool is_folder = (rec->fmt == PTP_FMT_ASSOCIATION);
+	mtp_int64 mtime = 0;
+	struct stat stat_buf = { 0 };
+
+	item->attrs.attribute = MTP_FILE_ATTR_MODE_NONE;
+	item->attrs.dev = rec->dev;
+	item->attrs.ino = rec->ino;
+	if (is_folder) {
+		item->attrs.attribute = MTP_FILE_ATTR_MODE_DIR;
+	} else {
+		item->attrs.fsize = rec->size;
+		if (rec->flags & SNAPSHOT_FLAG_READ_ONLY)
+			item->attrs.attribute |= MTP_FILE_ATTR_MODE_READ_ONLY;
+	}
+
+	if (!is_trusted || (rec->flags & SNAPSHOT_FLAG_ENUMERATED)) {
+		if (stat(item->path, &stat_buf) < 0)
+			return;
+		if (is_folder ? !S_ISDIR(stat_buf.st_mode) :
+				!S_ISREG(stat_buf.st_mode))
+			return;
+
+		mtime = __get_mtime_ns(&stat_buf);
+		item->attrs.dev = (mtp_uint64)stat_buf.st_dev;
+		item->attrs.ino = (mtp_uint64)stat_buf.st_ino;
+		if (!is_folder) {
+			item->attrs.fsize = (mtp_uint64)stat_buf.st_size;
+			item->attrs.attribute = MTP_FILE_ATTR_MODE_NONE;
+			if (!(stat_buf.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
+				item->attrs.attribute |= MTP_FILE_ATTR_MODE_READ_ONLY;
+		}
+	}
+
+	item->is_valid = TRUE;
+	item->is_enumerated = (rec->flags & SNAPSHOT_FLAG_ENUMERATED) &&
+		mtime == rec->mtime;
+}
+
+/* Adds the object of one checked record, with the store lock held */
+static mtp_bool __merge_record(mtp_store_t *store, const load_item_t *item)
+{
+	const snapshot_record_t *rec = item->rec;
+	dir_entry_t entry = { { 0 }, 0 };
+	mtp_obj_t *obj = NULL;
+
+	/* Parent dropped, so is its subtree */
+	if (rec->h_parent != PTP_OBJECTHANDLE_ROOT &&
+			_entity_get_object_from_store(store, rec->h_parent) == NULL)
+		return FALSE;
+
+	g_strlcpy(entry.filename, item->path, sizeof(entry.filename));
+	entry.type = (rec->fmt == PTP_FMT_ASSOCIATION) ? MTP_DIR_TYPE :
+		MTP_FILE_TYPE;
+	entry.attrs = item->attrs;
+
+	obj = _entity_alloc_mtp_object();
+	retvm_if(!obj, FALSE, "Memory allocation Fail\n");
+
+	if (_entity_init_mtp_object_params(obj, store->store_id, rec->h_parent,
+				entry.filename, (mtp_char *)item->name,
+				&entry) == FALSE) {
+		ERR("_entity_init_mtp_object_params Fail\n");
+		g_free(obj);
+		return FALSE;
+	}
+	obj->obj_handle = rec->handle;
+	obj->obj_info->obj_fmt = rec->fmt;
+
+	if (item->is_enumerated) {
+		obj->is_enumerated = TRUE;
+		obj->dir_mtime = rec->mtime;
+	}
+
+	if (!_entity_add_object_to_store(store, obj)) {
+		_entity_dealloc_mtp_obj(obj);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Restores the objects of a store from its snapshot. The file is read
+ * and checked against the file system without the store lock, which is
+ * only taken to add the result, so loading a large store does not hold
+ * up the requests on the other stores.
+ */
+mtp_bool _entity_load_store_snapshot(mtp_store_t *store)
+{
+	const snapshot_header_t *hdr = NULL;
+	const snapshot_record_t *recs = NULL;
+	const mtp_char *names = NULL;
+	const snapshot_record_t *rec = NULL;
+	const mtp_char *name = NULL;
+	const mtp_char *parent_path = NULL;
+	const load_item_t *parent = NULL;
+	struct stat stat_buf = { 0 };
+	struct stat root_buf = { 0 };
+	mtp_bool is_root_enumerated = FALSE;
+	mtp_bool is_trusted = FALSE;
+	mtp_bool is_parent_valid = FALSE;
+	mtp_uint32 n_loaded = 0;
+	mtp_uint32 idx = 0;
+	mtp_uint32 ii = 0;
+	mtp_char *path = NULL;
+	GArray *items = NULL;
+	GHashTable *folders = NULL;
+	GPtrArray *dropped = NULL;
+	load_item_t item = { 0 };
+	load_item_t *cur = NULL;
+	prev_handle_t *prev = NULL;
+	void *map = MAP_FAILED;
+	gint64 start = g_get_monotonic_time();
+	mtp_int32 fd = -1;
+
+	retv_if(store == NULL, FALSE);
+	retv_if(store->root_path == NULL, FALSE);
+
+	path = __get_snapshot_path(store->store_id);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		DBG("No snapshot [%s]\n", path);
+		g_free(path);
+		return FALSE;
+	}
+	g_free(path);
+
+	if (fstat(fd, &stat_buf) == 0 &&
+			stat_buf.st_size >= (off_t)sizeof(snapshot_header_t))
+		map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	retvm_if(map == MAP_FAILED, FALSE, "Snapshot cannot be mapped\n");
+
+	hdr = (const snapshot_header_t *)map;
+	recs = (const snapshot_record_t *)(hdr + 1);
+	names = (const mtp_char *)(recs + hdr->num_records);
+
+	if (hdr->magic != MTP_SNAPSHOT_MAGIC ||
+			hdr->version != MTP_SNAPSHOT_VERSION ||
+			hdr->store_id != store->store_id ||
+			hdr->num_records > (stat_buf.st_size - sizeof(*hdr)) /
+			sizeof(*recs) ||
+			hdr->names_size == 0 ||
+			sizeof(*hdr) + (mtp_uint64)hdr->num_records * sizeof(*recs) +
+			hdr->names_size != (mtp_uint64)stat_buf.st_size ||
+			names[hdr->names_size - 1] != '\0' ||
+			g_strcmp0(names, store->root_path)) {
+		ERR("Snapshot does not match the store, ignored\n");
+		munmap(map, stat_buf.st_size);
+		return FALSE;
+	}
+
+	if ((hdr->root_flags & SNAPSHOT_FLAG_ENUMERATED) &&
+			stat(store->root_path, &root_buf) == 0 &&
+			__get_mtime_ns(&root_buf) == hdr->root_mtime)
+		is_root_enumerated = TRUE;
+
+	/* Folder handle -> index in items + 1 */
+	folders = g_hash_table_new(g_direct_hash, g_direct_equal);
+	items = g_array_sized_new(FALSE, TRUE, sizeof(load_item_t),
+			hdr->num_records);
+
+	for (ii = 0; ii < hdr->num_records; ii++) {
+		rec = &recs[ii];
+		if (rec->handle == 0 || rec->handle >= hdr->next_handle ||
+				rec->name_off >= hdr->names_size)
+			continue;
+
+		name = names + rec->name_off;
+		if (name[0] == '\0' || strchr(name, '/'))
+			continue;
+
+		/* Parents come first, a missing one was corrupt */
+		if (rec->h_parent == PTP_OBJECTHANDLE_ROOT) {
+			parent_path = store->root_path;
+			is_trusted = is_root_enumerated;
+			is_parent_valid = TRUE;
+		} else {
+			idx = GPOINTER_TO_UINT(g_hash_table_lookup(folders,
+						GUINT_TO_POINTER(rec->h_parent)));
+			if (idx == 0)
+				continue;
+
+			parent = &g_array_index(items, load_item_t, idx - 1);
+			parent_path = parent->path;
+			is_trusted = parent->is_enumerated;
+			is_parent_valid = parent->is_valid;
+		}
+
+		path = g_strconcat(parent_path, "/", name, NULL);
+		if (strlen(path) > MTP_MAX_PATHNAME_SIZE) {
+			g_free(path);
+			continue;
+		}
+
+		memset(&item, 0, sizeof(item));
+		item.rec = rec;
+		item.path = path;
+		item.name = name;
+		if (is_parent_valid)
+			__check_record(&item, is_trusted);
+		g_array_append_val(items, item);
+
+		if (rec->fmt == PTP_FMT_ASSOCIATION)
+			g_hash_table_insert(folders, GUINT_TO_POINTER(rec->handle),
+					GUINT_TO_POINTER(items->len));
+	}
+	g_hash_table_destroy(folders);
+
+	dropped = g_ptr_array_new();
+
+	UTIL_WRITE_LOCK(&g_store_lock);
+	if (is_root_enumerated) {
+		store->is_root_enumerated = TRUE;
+		store->root_mtime = hdr->root_mtime;
+	}
+
+	for (ii = 0; ii < items->len; ii++) {
+		cur = &g_array_index(items, load_item_t, ii);
+		if (_device_get_object_with_handle(cur->rec->handle)) {
+			cur->is_valid = FALSE;
+			continue;
+		}
+
+		if (cur->is_valid && __merge_record(store, cur)) {
+			n_loaded++;
+			continue;
+		}
+
+		/* Kept for when the object is found again */
+		cur->is_valid = FALSE;
+		prev = g_new0(prev_handle_t, 1);
+		prev->id.dev = cur->rec->dev;
+		prev->id.ino = cur->rec->ino;
+		prev->handle = cur->rec->handle;
+		prev->path = g_strdup(cur->path);
+		g_ptr_array_add(dropped, prev);
+	}
+
+	/* Only now, so that the records above do not consume them */
+	g_ptr_array_foreach(dropped, __add_prev_handle, NULL);
+
+	/* Keep new handles clear of the restored ones */
+	g_next_obj_handle = MAX(g_next_obj_handle, hdr->next_handle);
+
+	store->saved_generation = store->generation;
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	g_ptr_array_free(dropped, TRUE);
+
+#ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
+	if (is_root_enumerated)
+		_inoti_add_watch_for_fs_events(store->root_path);
+#endif /*MTP_SUPPORT_OBJECTADDDELETE_EVENT*/
+
+	for (ii = 0; ii < items->len; ii++) {
+		cur = &g_array_index(items, load_item_t, ii);
+#ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
+		if (cur->is_valid && cur->is_enumerated)
+			_inoti_add_watch_for_fs_events(cur->path);
+#endif /*MTP_SUPPORT_OBJECTADDDELETE_EVENT*/
+		g_free(cur->path);
+	}
+	g_array_free(items, TRUE);
+
+	DBG("Loaded [%u] of [%u] snapshot objects in [%lld] ms\n", n_loaded,
+			hdr->num_records,
+			(long long)((g_get_monotonic_time() - start) / 1000));
+	munmap(map, stat_buf.st_size);
+
+	return TRUE;
+}
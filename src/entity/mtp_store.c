@@ -18,23 +18,359 @@
 #include <glib.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <dirent.h>
 #include "mtp_util.h"
 #include "mtp_support.h"
+#include "mtp_thread.h"
 #include "mtp_device.h"
 #include "mtp_transport.h"
 #include "mtp_inoti_handler.h"
+#include "mtp_event_handler.h"
 
 
 extern mtp_char g_last_deleted[MTP_MAX_PATHNAME_SIZE + 1];
+extern mtp_config_t g_conf;
+extern pthread_rwlock_t g_store_lock;
 mtp_uint32 g_next_obj_handle = 1;
 
 
+/* Packed handle array for one (parent, format) pair of a store */
+typedef struct {
+	mtp_uint64 key;		/* h_parent << 32 | format */
+	mtp_uint32 generation;	/* generation of the scope when packed */
+	mtp_uint32 data_sz;
+	mtp_uchar *data;
+} handles_cache_t;
+
+typedef struct scan_dir_s scan_dir_t;
+
+/* Directory entry read by a scan worker */
+typedef struct {
+	mtp_char *path;
+	file_type_t type;
+	file_attr_t attrs;
+	scan_dir_t *dir;	/* Contents, for MTP_DIR_TYPE entries */
+} scan_entry_t;
+
+/* One directory of a parallel scan */
+struct scan_dir_s {
+	mtp_char *path;
+	GArray *entries;	/* scan_entry_t, in readdir order */
+	gint is_taken;		/* A thread is reading or has read it */
+	mtp_bool is_read;
+	mtp_bool is_complete;	/* Read up to the last entry */
+	mtp_int64 mtime;	/* Of the directory when it was opened */
+};
+
+/*
+ * Directories found by one scan thread. It takes the newest from its own
+ * queue and idle threads steal the oldest.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	GQueue dirs;		/* scan_dir_t */
+} scan_queue_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* a queue grew or stop was set */
+	pthread_cond_t read_cond;	/* a directory was read */
+	/* One per reader thread, the last one for the merging thread */
+	scan_queue_t queues[MTP_MAX_SCAN_THREADS + 1];
+	mtp_uint32 n_queues;
+	gint n_pending;		/* Directories in all the queues */
+	mtp_bool stop;
+} scan_ctx_t;
+
+typedef struct {
+	scan_ctx_t *ctx;
+	mtp_uint32 idx;		/* Own queue */
+} scan_worker_t;
+
 static inline mtp_bool UTIL_CHECK_LIST_NEXT(slist_iterator *iter)
 {
 	return (iter && iter->node_ptr) ? TRUE : FALSE;
 }
 
+static void __destroy_handles_cache(gpointer data)
+{
+	handles_cache_t *entry = (handles_cache_t *)data;
+
+	g_free(entry->data);
+	g_free(entry);
+}
+
+/*
+ * Returns the generation guarding a GetObjectHandles scope.
+ * PTP_OBJECTHANDLE_ALL stands for the whole store.
+ */
+static mtp_bool __get_scope_generation(mtp_store_t *store, mtp_uint32 h_parent,
+		mtp_uint32 *generation)
+{
+	mtp_obj_t *parent_obj = NULL;
+
+	if (h_parent == PTP_OBJECTHANDLE_ALL) {
+		*generation = store->generation;
+		return TRUE;
+	}
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT) {
+		*generation = store->root_generation;
+		return TRUE;
+	}
+
+	parent_obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(h_parent));
+	retv_if(parent_obj == NULL, FALSE);
+
+	*generation = parent_obj->generation;
+	return TRUE;
+}
+
+static void __bump_generation(mtp_store_t *store, mtp_uint32 h_parent)
+{
+	mtp_obj_t *parent_obj = NULL;
+
+	store->generation++;
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT) {
+		store->root_generation = store->generation;
+		return;
+	}
+
+	if (store->handle_index == NULL)
+		return;
+
+	parent_obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(h_parent));
+	if (parent_obj != NULL)
+		parent_obj->generation = store->generation;
+}
+
+static ptp_array_t *__get_children_array(mtp_store_t *store,
+		mtp_uint32 h_parent)
+{
+	mtp_obj_t *parent_obj = NULL;
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT)
+		return &(store->root_children);
+
+	if (store->handle_index == NULL)
+		return NULL;
+
+	parent_obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(h_parent));
+
+	return (parent_obj != NULL) ? &(parent_obj->children) : NULL;
+}
+
+/*
+ * Parent folder of obj, NULL for the root. While a folder is copied with
+ * keep_handle its handle is duplicated and the handle index only holds
+ * the newest copy, so the parent is then found by path.
+ */
+static mtp_obj_t *__get_parent_object(mtp_store_t *store, mtp_obj_t *obj)
+{
+	mtp_char parent_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_uint32 h_parent = obj->obj_info->h_parent;
+	mtp_obj_t *parent_obj = NULL;
+	mtp_char *ptr = NULL;
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT || store->handle_index == NULL)
+		return NULL;
+
+	if (store->shadowed_index && obj->file_path && store->path_index &&
+			g_hash_table_contains(store->shadowed_index,
+				GUINT_TO_POINTER(h_parent))) {
+		g_strlcpy(parent_path, obj->file_path, sizeof(parent_path));
+		ptr = strrchr(parent_path, '/');
+		if (ptr != NULL) {
+			*ptr = '\0';
+			parent_obj = (mtp_obj_t *)g_hash_table_lookup(
+					store->path_index, parent_path);
+			if (parent_obj && parent_obj->obj_handle == h_parent)
+				return parent_obj;
+		}
+	}
+
+	return (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(h_parent));
+}
+
+/* The children array obj is listed in */
+static ptp_array_t *__get_siblings_array(mtp_store_t *store, mtp_obj_t *obj)
+{
+	mtp_obj_t *parent_obj = NULL;
+
+	if (obj->obj_info->h_parent == PTP_OBJECTHANDLE_ROOT)
+		return &(store->root_children);
+
+	parent_obj = __get_parent_object(store, obj);
+	return (parent_obj != NULL) ? &(parent_obj->children) : NULL;
+}
+
+/*
+ * The handle index points at the newest object with a handle. Older
+ * duplicates are kept in shadowed_index and take over when it goes.
+ */
+static void __index_object_handle(mtp_store_t *store, mtp_obj_t *obj)
+{
+	gpointer key = GUINT_TO_POINTER(obj->obj_handle);
+	mtp_obj_t *old = NULL;
+	GSList *list = NULL;
+
+	if (store->handle_index == NULL)
+		return;
+
+	old = (mtp_obj_t *)g_hash_table_lookup(store->handle_index, key);
+	if (old != NULL && old != obj) {
+		if (store->shadowed_index == NULL)
+			store->shadowed_index = g_hash_table_new(g_direct_hash,
+					g_direct_equal);
+		list = g_hash_table_lookup(store->shadowed_index, key);
+		g_hash_table_insert(store->shadowed_index, key,
+				g_slist_prepend(list, old));
+	}
+
+	g_hash_table_replace(store->handle_index, key, obj);
+}
+
+static void __unindex_object_handle(mtp_store_t *store, mtp_obj_t *obj)
+{
+	gpointer key = GUINT_TO_POINTER(obj->obj_handle);
+	GSList *list = NULL;
+
+	if (store->handle_index == NULL)
+		return;
+
+	if (store->shadowed_index)
+		list = g_hash_table_lookup(store->shadowed_index, key);
+
+	if (g_hash_table_lookup(store->handle_index, key) == obj) {
+		if (list == NULL) {
+			g_hash_table_remove(store->handle_index, key);
+			return;
+		}
+
+		/* The newest remaining duplicate is reachable again */
+		g_hash_table_replace(store->handle_index, key, list->data);
+		list = g_slist_delete_link(list, list);
+	} else {
+		list = g_slist_remove(list, obj);
+	}
+
+	if (list != NULL)
+		g_hash_table_insert(store->shadowed_index, key, list);
+	else if (store->shadowed_index)
+		g_hash_table_remove(store->shadowed_index, key);
+}
+
+static void __free_shadowed_index(mtp_store_t *store)
+{
+	GHashTableIter iter;
+	gpointer value = NULL;
+
+	if (store->shadowed_index == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, store->shadowed_index);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		g_slist_free((GSList *)value);
+	g_hash_table_destroy(store->shadowed_index);
+	store->shadowed_index = NULL;
+}
+
+static void __index_object_path(mtp_store_t *store, mtp_obj_t *obj)
+{
+	if (store->path_index == NULL || obj->file_path == NULL)
+		return;
+
+	g_hash_table_replace(store->path_index, g_strdup(obj->file_path), obj);
+}
+
+static void __unindex_object_path(mtp_store_t *store, mtp_obj_t *obj)
+{
+	if (store->path_index == NULL || obj->file_path == NULL)
+		return;
+
+	/* Another object may have been indexed under the same path since */
+	if (g_hash_table_lookup(store->path_index, obj->file_path) == obj)
+		g_hash_table_remove(store->path_index, obj->file_path);
+}
+
+static void __index_object_format(mtp_store_t *store, mtp_obj_t *obj)
+{
+	ptp_array_t *bucket = NULL;
+	gpointer key = GUINT_TO_POINTER(obj->obj_info->obj_fmt);
+
+	if (store->format_index == NULL)
+		return;
+
+	bucket = (ptp_array_t *)g_hash_table_lookup(store->format_index, key);
+	if (bucket == NULL) {
+		bucket = _prop_alloc_ptparray(UINT32_TYPE);
+		retm_if(!bucket, "Format bucket allocation Fail\n");
+		g_hash_table_insert(store->format_index, key, bucket);
+	}
+
+	_prop_append_ele_ptparray(bucket, obj->obj_handle);
+}
+
+static void __unindex_object_format(mtp_store_t *store, mtp_obj_t *obj)
+{
+	ptp_array_t *bucket = NULL;
+	gpointer key = GUINT_TO_POINTER(obj->obj_info->obj_fmt);
+
+	if (store->format_index == NULL)
+		return;
+
+	bucket = (ptp_array_t *)g_hash_table_lookup(store->format_index, key);
+	if (bucket == NULL)
+		return;
+
+	_prop_rem_elem_ptparray(bucket, obj->obj_handle);
+	if (bucket->num_ele == 0)
+		g_hash_table_remove(store->format_index, key);
+}
+
+static void __destroy_format_bucket(gpointer data)
+{
+	_prop_destroy_ptparray((ptp_array_t *)data);
+}
+
+static void __index_object(mtp_store_t *store, mtp_obj_t *obj)
+{
+	ptp_array_t *siblings = NULL;
+
+	/* The parent is looked up before obj can shadow it */
+	siblings = __get_siblings_array(store, obj);
+	__index_object_handle(store, obj);
+	__index_object_path(store, obj);
+	__index_object_format(store, obj);
+
+	if (siblings != NULL)
+		_prop_append_ele_ptparray(siblings, obj->obj_handle);
+	__bump_generation(store, obj->obj_info->h_parent);
+}
+
+static void __unindex_object(mtp_store_t *store, mtp_obj_t *obj)
+{
+	ptp_array_t *siblings = NULL;
+
+	if (obj->obj_info != NULL) {
+		siblings = __get_siblings_array(store, obj);
+		if (siblings != NULL)
+			_prop_rem_elem_ptparray(siblings, obj->obj_handle);
+		__unindex_object_format(store, obj);
+		__bump_generation(store, obj->obj_info->h_parent);
+	}
+
+	__unindex_object_path(store, obj);
+	__unindex_object_handle(store, obj);
+}
+
 static void __init_store_info(store_info_t *info)
 {
 	ret_if(info == NULL);
@@ -81,6 +417,56 @@ void _entity_update_store_info_run_time(store_info_t *info,
 	info->free_space = fs_info.avail_size;
 }
 
+/*
+ * Free space is a model, moved by delta as objects are written and
+ * deleted, and reset from statfs() in the background by
+ * _device_refresh_store_space(). Requests never wait on the filesystem.
+ */
+void _entity_update_store_free_space(mtp_store_t *store, mtp_int64 delta)
+{
+	store_info_t *info = NULL;
+
+	ret_if(store == NULL);
+
+	info = &(store->store_info);
+	if (delta < 0)
+		info->free_space -= MIN(info->free_space, (mtp_uint64)(-delta));
+	else
+		info->free_space = MIN(info->capacity,
+				info->free_space + (mtp_uint64)delta);
+}
+
+/* Space of an object announced by the host, taken until it is sent */
+void _entity_reserve_store_space(mtp_store_t *store, mtp_uint64 size)
+{
+	ret_if(store == NULL);
+
+	_entity_update_store_free_space(store, -(mtp_int64)size);
+	store->reserved_space += size;
+}
+
+void _entity_release_store_space(mtp_store_t *store, mtp_uint64 size,
+		mtp_bool is_written)
+{
+	ret_if(store == NULL);
+
+	store->reserved_space -= MIN(store->reserved_space, size);
+
+	/* A written object keeps using its space */
+	if (!is_written)
+		_entity_update_store_free_space(store, (mtp_int64)size);
+}
+
+void _entity_set_store_space(mtp_store_t *store, mtp_uint64 capacity,
+		mtp_uint64 avail_size)
+{
+	ret_if(store == NULL);
+
+	store->store_info.capacity = capacity;
+	store->store_info.free_space = (avail_size > store->reserved_space) ?
+		avail_size - store->reserved_space : 0;
+}
+
 /* LCOV_EXCL_START */
 mtp_uint32 _entity_get_store_info_size(store_info_t *info)
 {
@@ -145,18 +531,31 @@ mtp_uint32 _entity_pack_store_info(store_info_t *info, mtp_uchar *buf,
 	return num_bytes;
 }
 
+/* The store with the longest root that path_name is in, 0 if none */
 mtp_uint32 _entity_get_store_id_by_path(const mtp_char *path_name)
 {
 	mtp_uint32 store_id = 0;
-	char ext_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_uint32 best_len = 0;
+	mtp_uint32 len = 0;
+	mtp_int32 ii = 0;
+	mtp_store_t *store = NULL;
 
 	retv_if(NULL == path_name, FALSE);
 
-	_util_get_external_path(ext_path);
+	for (ii = 0; ii < g_device->num_stores; ii++) {
+		store = &(g_device->store_list[ii]);
+		if (store->root_path == NULL)
+			continue;
+
+		len = strlen(store->root_path);
+		if (len <= best_len || strncmp(path_name, store->root_path, len))
+			continue;
+
+		if (path_name[len] != '\0' && path_name[len] != '/')
+			continue;
 
-	if (!strncmp(path_name, ext_path,
-				strlen(ext_path))) {
-		store_id = MTP_EXTERNAL_STORE_ID;
+		best_len = len;
+		store_id = store->store_id;
 	}
 
 	DBG_SECURE("Path : %s, store_id : 0x%x\n", path_name, store_id);
@@ -166,7 +565,7 @@ mtp_uint32 _entity_get_store_id_by_path(const mtp_char *path_name)
 /* LCOV_EXCL_STOP */
 
 mtp_bool _entity_init_mtp_store(mtp_store_t *store, mtp_uint32 store_id,
-		mtp_char *store_path)
+		mtp_char *store_path, const mtp_char *store_desc)
 {
 	mtp_char temp[MTP_SERIAL_LEN_MAX + 1] = { 0 };
 	mtp_wchar wtemp[MTP_MAX_REG_STRING + 1] = { 0 };
@@ -187,25 +586,34 @@ mtp_bool _entity_init_mtp_store(mtp_store_t *store, mtp_uint32 store_id,
 	g_snprintf(serial, sizeof(serial), "%s-%x", temp, store_id);
 	_util_utf8_to_utf16(wserial, sizeof(wserial) / WCHAR_SIZ, serial);
 
-	switch (store_id) {
-	case MTP_EXTERNAL_STORE_ID:
-	/* LCOV_EXCL_START */
-		store->is_hidden = FALSE;
-		_util_utf8_to_utf16(wtemp, sizeof(wtemp) / WCHAR_SIZ,
-				MTP_STORAGE_DESC_EXT);
-		__init_store_info_params(&(store->store_info),
-				store->store_info.capacity,
-				PTP_STORAGETYPE_FIXEDRAM,
-				PTP_FILESYSTEMTYPE_HIERARCHICAL,
-				PTP_STORAGEACCESS_RWD, wtemp, wserial);
-		break;
-
-	default:
-		ERR("store initialization Fail\n");
-		return FALSE;
-	}
-	/* LCOV_EXCL_STOP */
+	store->is_hidden = FALSE;
+	_util_utf8_to_utf16(wtemp, sizeof(wtemp) / WCHAR_SIZ,
+			store_desc ? store_desc : MTP_STORAGE_DESC_EXT);
+	__init_store_info_params(&(store->store_info),
+			store->store_info.capacity,
+			PTP_STORAGETYPE_FIXEDRAM,
+			PTP_FILESYSTEMTYPE_HIERARCHICAL,
+			PTP_STORAGEACCESS_RWD, wtemp, wserial);
+
 	_util_init_list(&(store->obj_list));
+	store->handle_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	store->shadowed_index = NULL;
+	store->path_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+	store->format_index = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL, __destroy_format_bucket);
+	_prop_init_ptparray(&(store->root_children), UINT32_TYPE);
+	store->root_generation = 0;
+	store->generation = 0;
+	store->handles_cache = g_hash_table_new_full(g_int64_hash,
+			g_int64_equal, NULL, __destroy_handles_cache);
+	store->is_root_enumerated = FALSE;
+	store->root_mtime = 0;
+	store->saved_generation = 0;
+	store->reserved_space = 0;
+	g_atomic_int_set(&store->is_space_dirty, FALSE);
+	store->space_time = g_get_monotonic_time();
+	store->is_ready = FALSE;
 
 	return TRUE;
 }
@@ -267,6 +675,7 @@ mtp_bool _entity_add_object_to_store(mtp_store_t *store, mtp_obj_t *obj)
 
 	retvm_if(!_util_add_node(&(store->obj_list), obj), FALSE,
 		"Node add to list Fail\n");
+	__index_object(store, obj);
 
 	/* references */
 	if (PTP_OBJECTHANDLE_ROOT != obj->obj_info->h_parent) {
@@ -278,80 +687,91 @@ mtp_bool _entity_add_object_to_store(mtp_store_t *store, mtp_obj_t *obj)
 	return TRUE;
 }
 
-mtp_obj_t *_entity_get_object_from_store(mtp_store_t *store, mtp_uint32 handle)
+/*
+ * Unlinks obj from the store list and indexes without freeing it.
+ * The caller owns obj afterwards.
+ */
+mtp_bool _entity_detach_object_from_store(mtp_store_t *store, mtp_obj_t *obj)
 {
-	mtp_obj_t *obj = NULL;
-	slist_iterator *iter = NULL;
+	slist_node_t *node = NULL;
 
-	retv_if(NULL == store, NULL);
+	retv_if(store == NULL, FALSE);
+	retv_if(obj == NULL, FALSE);
 
-	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
-	retvm_if(!iter, NULL, "Iterator init Fail, Store id = [0x%x]\n", store->store_id);
+	__unindex_object(store, obj);
 
-	while (UTIL_CHECK_LIST_NEXT(iter) == TRUE) {
-		obj = (mtp_obj_t *)_util_get_list_next(iter);
+	node = _util_delete_node(&(store->obj_list), obj);
+	retvm_if(!node, FALSE, "Object [%u] is not in store [0x%x]\n",
+			obj->obj_handle, store->store_id);
+	g_free(node);
 
-		if (obj && obj->obj_handle == handle) {
-			g_free(iter);
-			return obj;
-		}
-	}
+	return TRUE;
+}
 
-	ERR("Object not found in the list handle [%d] in store[0x%x]\n", handle, store->store_id);
-	g_free(iter);
-	return NULL;
+mtp_bool _entity_set_object_path_in_store(mtp_store_t *store, mtp_obj_t *obj,
+		mtp_char *file_path)
+{
+	retv_if(obj == NULL, FALSE);
+	retv_if(file_path == NULL, FALSE);
+
+	if (store)
+		__unindex_object_path(store, obj);
+
+	_entity_set_object_file_path(obj, file_path, CHAR_TYPE);
+
+	if (store)
+		__index_object_path(store, obj);
+
+	return TRUE;
 }
 
-/* LCOV_EXCL_START */
-mtp_obj_t *_entity_get_last_object_from_store(mtp_store_t *store,
-		mtp_uint32 handle)
+mtp_obj_t *_entity_get_object_from_store(mtp_store_t *store, mtp_uint32 handle)
 {
 	mtp_obj_t *obj = NULL;
-	mtp_obj_t *temp_obj = NULL;
-	slist_iterator *iter = NULL;
 
 	retv_if(NULL == store, NULL);
+	retvm_if(!store->handle_index, NULL, "Handle index is NULL, Store id = [0x%x]\n",
+			store->store_id);
 
-	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
-	retvm_if(!iter, NULL, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
+	obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(handle));
+	if (obj == NULL)
+		ERR("Object not found in the list handle [%d] in store[0x%x]\n", handle, store->store_id);
 
-	while (UTIL_CHECK_LIST_NEXT(iter) == TRUE) {
+	return obj;
+}
 
-		temp_obj = (mtp_obj_t *)_util_get_list_next(iter);
-		if (temp_obj && temp_obj->obj_handle == handle)
-			obj = temp_obj;
-	}
+/* LCOV_EXCL_START */
+/*
+ * Handles may be duplicated while a folder is copied with keep_handle.
+ * The handle index always points at the most recently added object,
+ * which is the one this function is expected to return.
+ */
+mtp_obj_t *_entity_get_last_object_from_store(mtp_store_t *store,
+		mtp_uint32 handle)
+{
+	retv_if(NULL == store, NULL);
+	retv_if(NULL == store->handle_index, NULL);
 
-	g_free(iter);
-	return obj;
+	return (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+			GUINT_TO_POINTER(handle));
 }
 
 mtp_obj_t *_entity_get_object_from_store_by_path(mtp_store_t *store,
 		const mtp_char *file_path)
 {
 	mtp_obj_t *obj = NULL;
-	slist_iterator *iter = NULL;
 
 	retv_if(NULL == store, NULL);
+	retv_if(NULL == file_path, NULL);
+	retvm_if(!store->path_index, NULL, "Path index is NULL Store id = [0x%x]\n",
+			store->store_id);
 
-	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
-	retvm_if(!iter, NULL, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
-
-	while (UTIL_CHECK_LIST_NEXT(iter) == TRUE) {
-		obj = (mtp_obj_t *)_util_get_list_next(iter);
-		if (obj == NULL) {
-			ERR("Object is NULL\n");
-			continue;
-		}
+	obj = (mtp_obj_t *)g_hash_table_lookup(store->path_index, file_path);
+	if (obj == NULL)
+		ERR_SECURE("Object [%s] not found in the list\n", file_path);
 
-		if (!g_strcmp0(file_path, obj->file_path)) {
-			g_free(iter);
-			return obj;
-		}
-	}
-	ERR_SECURE("Object [%s] not found in the list\n", file_path);
-	g_free(iter);
-	return NULL;
+	return obj;
 }
 
 /*
@@ -371,6 +791,9 @@ mtp_uint32 _entity_get_objects_from_store(mtp_store_t *store,
 	retvm_if(obj_handle != PTP_OBJECTHANDLE_ALL, 0, 
 		"Object Handle is not PTP_OBJECTHANDLE_ALL\n");
 
+	if (fmt != PTP_FORMATCODE_ALL && fmt != PTP_FORMATCODE_NOTUSED)
+		return _entity_get_objects_from_store_by_format(store, fmt, obj_arr);
+
 	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
 	retvm_if(!iter, 0, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
 
@@ -399,6 +822,7 @@ mtp_uint32 _entity_get_objects_from_store_till_depth(mtp_store_t *store,
 	retv_if(obj_arr == NULL, 0);
 
 	if (PTP_OBJECTHANDLE_ALL == obj_handle) {
+		_entity_store_recursive_enum_folder_objects(store, NULL);
 		_entity_get_objects_from_store(store, obj_handle, fmt_code,
 				obj_arr);
 		DBG("Number of object filled [%u]\n", obj_arr->num_ele);
@@ -424,6 +848,17 @@ mtp_uint32 _entity_get_objects_from_store_till_depth(mtp_store_t *store,
 
 		depth--;
 
+		if (PTP_OBJECTHANDLE_ROOT == obj_handle) {
+			_entity_store_enum_folder_objects(store, NULL);
+		} else {
+			mtp_obj_t *obj = _entity_get_object_from_store(store,
+					obj_handle);
+
+			if (obj && obj->obj_info &&
+					obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION)
+				_entity_store_enum_folder_objects(store, obj);
+		}
+
 		_entity_get_child_handles_with_same_format(store, obj_handle,
 				fmt_code, child_arr);
 		ptr = child_arr->array_entry;
@@ -445,10 +880,29 @@ mtp_uint32 _entity_get_objects_from_store_by_format(mtp_store_t *store,
 {
 	mtp_obj_t *obj = NULL;
 	slist_iterator *iter = NULL;
+	ptp_array_t *bucket = NULL;
 
 	retv_if(store == NULL, 0);
 	retv_if(obj_arr == NULL, 0);
 
+	if (format != PTP_FORMATCODE_NOTUSED && format != PTP_FORMATCODE_ALL) {
+		retv_if(store->format_index == NULL, obj_arr->num_ele);
+
+		bucket = (ptp_array_t *)g_hash_table_lookup(store->format_index,
+				GUINT_TO_POINTER(format));
+		if (bucket != NULL && bucket->num_ele > 0) {
+			retvm_if(!_prop_grow_ptparray(obj_arr,
+				obj_arr->num_ele + bucket->num_ele), obj_arr->num_ele,
+				"grow ptp Array Fail\n");
+			memcpy((mtp_uint32 *)obj_arr->array_entry + obj_arr->num_ele,
+					bucket->array_entry,
+					bucket->num_ele * sizeof(mtp_uint32));
+			obj_arr->num_ele += bucket->num_ele;
+		}
+		return obj_arr->num_ele;
+	}
+
+	/* Every object (but folders for FORMATCODE_ALL) matches, walk the list */
 	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
 	retvm_if(!iter, 0, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
 
@@ -458,10 +912,7 @@ mtp_uint32 _entity_get_objects_from_store_by_format(mtp_store_t *store,
 		if (obj == NULL || obj->obj_info == NULL)
 			continue;
 		if ((format == PTP_FORMATCODE_NOTUSED) ||
-				(format == obj->obj_info->obj_fmt) ||
-				((format == PTP_FORMATCODE_ALL) &&
-				 (obj->obj_info->obj_fmt !=
-				  PTP_FMT_ASSOCIATION))) {
+				(obj->obj_info->obj_fmt != PTP_FMT_ASSOCIATION)) {
 			_prop_append_ele_ptparray(obj_arr,
 					(mtp_uint32)obj->obj_handle);
 		}
@@ -475,8 +926,8 @@ mtp_uint32 _entity_get_objects_from_store_by_format(mtp_store_t *store,
 mtp_uint32 _entity_get_child_handles(mtp_store_t *store, mtp_uint32 h_parent,
 		ptp_array_t *child_arr)
 {
-	mtp_obj_t *obj = NULL;
-	slist_iterator *iter = NULL;
+	mtp_uint32 ii = 0;
+	mtp_uint32 *ptr32 = NULL;
 	mtp_obj_t *parent_obj = NULL;
 
 	retv_if(store == NULL, 0);
@@ -486,70 +937,480 @@ mtp_uint32 _entity_get_child_handles(mtp_store_t *store, mtp_uint32 h_parent,
 
 	retvm_if(!parent_obj, FALSE, "parent object is NULL\n");
 
-	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
-	retvm_if(!iter, 0, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
-
-	while (UTIL_CHECK_LIST_NEXT(iter) == TRUE) {
-
-		obj = (mtp_obj_t *)_util_get_list_next(iter);
-		if (obj == NULL || obj->obj_info == NULL)
-			continue;
-
-		if (obj->obj_info->h_parent == h_parent)
-			_prop_append_ele_ptparray(child_arr, obj->obj_handle);
-	}
+	ptr32 = parent_obj->children.array_entry;
+	for (ii = 0; ii < parent_obj->children.num_ele; ii++)
+		_prop_append_ele_ptparray(child_arr, ptr32[ii]);
 
-	g_free(iter);
 	return child_arr->num_ele;
 }
 
 mtp_uint32 _entity_get_child_handles_with_same_format(mtp_store_t *store,
 		mtp_uint32 h_parent, mtp_uint32 format, ptp_array_t *child_arr)
 {
+	mtp_uint32 ii = 0;
+	mtp_uint32 *ptr32 = NULL;
 	mtp_obj_t *obj = NULL;
-	slist_iterator *iter = NULL;
+	ptp_array_t *children = NULL;
 
 	retv_if(store == NULL, 0);
 	retv_if(child_arr == NULL, 0);
 
-	iter = (slist_iterator *)_util_init_list_iterator(&(store->obj_list));
-	retvm_if(!iter, 0, "Iterator init Fail Store id = [0x%x]\n", store->store_id);
+	children = __get_children_array(store, h_parent);
+	if (children == NULL)
+		return child_arr->num_ele;
 
-	while (UTIL_CHECK_LIST_NEXT(iter) == TRUE) {
+	ptr32 = children->array_entry;
+	for (ii = 0; ii < children->num_ele; ii++) {
+		if (format == PTP_FORMATCODE_NOTUSED) {
+			_prop_append_ele_ptparray(child_arr, ptr32[ii]);
+			continue;
+		}
 
-		obj = (mtp_obj_t *)_util_get_list_next(iter);
+		obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+				GUINT_TO_POINTER(ptr32[ii]));
 		if (obj == NULL || obj->obj_info == NULL)
 			continue;
 
-		if ((obj->obj_info->h_parent == h_parent) &&
-				((obj->obj_info->obj_fmt == format) ||
-				 (format == PTP_FORMATCODE_NOTUSED))) {
-
-			_prop_append_ele_ptparray(child_arr, obj->obj_handle);
-		}
-
+		if (obj->obj_info->obj_fmt == format)
+			_prop_append_ele_ptparray(child_arr, ptr32[ii]);
 	}
 
-	g_free(iter);
 	return child_arr->num_ele;
 }
 
-mtp_bool _entity_remove_object_mtp_store(mtp_store_t *store, mtp_obj_t *obj,
-		mtp_uint32 format, mtp_uint16 *response, mtp_bool *atleast_one,
-		mtp_bool read_only)
+/* Deletes the file of a non-association object */
+static mtp_bool __remove_object_file(mtp_store_t *store, mtp_obj_t *obj,
+		mtp_uint16 *response)
 {
-	mtp_uint64 size = 0;
-	mtp_bool all_del = TRUE;
-	mtp_uint32 h_parent = 0;
-	obj_info_t *objinfo = NULL;
-	mtp_int32 ret = MTP_ERROR_NONE;
+	obj_info_t *objinfo = obj->obj_info;
 
-	retv_if(store == NULL, 0);
+	if (objinfo->protcn_status ==
+			PTP_PROTECTIONSTATUS_READONLY ||
+			objinfo->protcn_status ==
+			MTP_PROTECTIONSTATUS_READONLY_DATA) {
+		*response = PTP_RESPONSE_OBJ_WRITEPROTECTED;
+		return FALSE;
+	}
 
-	if (TRUE == g_status->cancel_intialization ||
-			TRUE == g_status->is_usb_discon) {
-		ERR("Delete operation cancelled or USB is disconnected\n");
-		*response = PTP_RESPONSE_PARTIAL_DELETION;
+	/* delete the real file */
+	g_snprintf(g_last_deleted, MTP_MAX_PATHNAME_SIZE + 1,
+			"%s", obj->file_path);
+	if (remove(obj->file_path) < 0) {
+		memset(g_last_deleted, 0,
+				MTP_MAX_PATHNAME_SIZE + 1);
+		*response = PTP_RESPONSE_GEN_ERROR;
+		if (EACCES == errno)
+			*response = PTP_RESPONSE_ACCESSDENIED;
+		return FALSE;
+	}
+
+	/* Upate store's available space */
+	_entity_update_store_free_space(store, (mtp_int64)objinfo->file_size);
+	*response = PTP_RESPONSE_OK;
+
+	return TRUE;
+}
+
+/* Drops the handles found in batch from arr, keeping the order */
+static void __compact_handles(ptp_array_t *arr, GHashTable *batch)
+{
+	mtp_uint32 *ptr32 = arr->array_entry;
+	mtp_uint32 ii = 0;
+	mtp_uint32 kept = 0;
+
+	for (ii = 0; ii < arr->num_ele; ii++) {
+		if (!g_hash_table_contains(batch, GUINT_TO_POINTER(ptr32[ii])))
+			ptr32[kept++] = ptr32[ii];
+	}
+	arr->num_ele = kept;
+}
+
+/*
+ * Takes every object of batch (obj_handle -> mtp_obj_t) out of the store
+ * and frees it. Each index and the object list are walked once for the
+ * whole batch instead of once per object.
+ */
+static void __detach_objects_from_store(mtp_store_t *store, GHashTable *batch)
+{
+	GHashTableIter iter;
+	gpointer key = NULL;
+	gpointer value = NULL;
+	GHashTable *parents = NULL;
+	GHashTable *formats = NULL;
+	mtp_obj_t *obj = NULL;
+	mtp_obj_t *parent_obj = NULL;
+	ptp_array_t *arr = NULL;
+	slist_node_t *node = NULL;
+	slist_node_t *prev = NULL;
+	slist_node_t *next = NULL;
+
+	ret_if(g_hash_table_size(batch) == 0);
+
+	/* children array -> parent handle */
+	parents = g_hash_table_new(g_direct_hash, g_direct_equal);
+	formats = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* Parents are found while every path is still indexed */
+	g_hash_table_iter_init(&iter, batch);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		obj = (mtp_obj_t *)value;
+		if (obj->obj_info == NULL)
+			continue;
+
+		/* Children of removed folders go with their parent */
+		parent_obj = __get_parent_object(store, obj);
+		arr = __get_siblings_array(store, obj);
+		if (arr != NULL && (parent_obj == NULL ||
+					g_hash_table_lookup(batch,
+						GUINT_TO_POINTER(parent_obj->obj_handle)) !=
+					parent_obj))
+			g_hash_table_insert(parents, arr,
+					GUINT_TO_POINTER(obj->obj_info->h_parent));
+		g_hash_table_add(formats,
+				GUINT_TO_POINTER(obj->obj_info->obj_fmt));
+	}
+
+	g_hash_table_iter_init(&iter, batch);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		obj = (mtp_obj_t *)value;
+		__unindex_object_path(store, obj);
+		__unindex_object_handle(store, obj);
+	}
+
+	g_hash_table_iter_init(&iter, parents);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		__compact_handles((ptp_array_t *)key, batch);
+		__bump_generation(store, GPOINTER_TO_UINT(value));
+	}
+
+	g_hash_table_iter_init(&iter, formats);
+	while (store->format_index && g_hash_table_iter_next(&iter, &key, NULL)) {
+		arr = (ptp_array_t *)g_hash_table_lookup(store->format_index, key);
+		if (arr == NULL)
+			continue;
+
+		__compact_handles(arr, batch);
+		if (arr->num_ele == 0)
+			g_hash_table_remove(store->format_index, key);
+	}
+
+	for (node = store->obj_list.start; node != NULL; node = next) {
+		next = node->link;
+		obj = (mtp_obj_t *)node->value;
+		if (g_hash_table_lookup(batch,
+					GUINT_TO_POINTER(obj->obj_handle)) != obj) {
+			prev = node;
+			continue;
+		}
+
+		if (prev)
+			prev->link = next;
+		else
+			store->obj_list.start = next;
+		if (store->obj_list.end == node)
+			store->obj_list.end = prev;
+		store->obj_list.nnodes--;
+		g_free(node);
+	}
+
+	g_hash_table_iter_init(&iter, batch);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		_entity_dealloc_mtp_obj((mtp_obj_t *)value);
+
+	g_hash_table_destroy(formats);
+	g_hash_table_destroy(parents);
+}
+
+/* Adds obj and everything the child index holds below it */
+static void __collect_object_tree(mtp_store_t *store, mtp_obj_t *obj,
+		GHashTable *batch)
+{
+	mtp_uint32 *ptr32 = obj->children.array_entry;
+	mtp_obj_t *child_obj = NULL;
+	mtp_uint32 ii = 0;
+
+	g_hash_table_insert(batch, GUINT_TO_POINTER(obj->obj_handle), obj);
+
+	for (ii = 0; ii < obj->children.num_ele; ii++) {
+		child_obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+				GUINT_TO_POINTER(ptr32[ii]));
+		if (child_obj == NULL || child_obj->obj_info == NULL)
+			continue;
+
+		__collect_object_tree(store, child_obj, batch);
+	}
+}
+
+static mtp_bool __is_tree_write_protected(GHashTable *batch)
+{
+	GHashTableIter iter;
+	gpointer value = NULL;
+	mtp_obj_t *obj = NULL;
+
+	g_hash_table_iter_init(&iter, batch);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		obj = (mtp_obj_t *)value;
+		if (obj->obj_info->obj_fmt != PTP_FMT_ASSOCIATION &&
+				(obj->obj_info->protcn_status ==
+				 PTP_PROTECTIONSTATUS_READONLY ||
+				 obj->obj_info->protcn_status ==
+				 MTP_PROTECTIONSTATUS_READONLY_DATA))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Keeps in batch only the objects whose file is gone */
+static gboolean __is_object_file_kept(gpointer key, gpointer value,
+		gpointer user_data)
+{
+	struct stat stat_buf = { 0 };
+
+	return lstat(((mtp_obj_t *)value)->file_path, &stat_buf) == 0;
+}
+
+/* Child trees of a folder being deleted, detached about once a second */
+typedef struct {
+	mtp_store_t *store;
+	const mtp_char *dir_path;
+	GHashTable *batch;	/* obj_handle -> mtp_obj_t, removed from disk */
+	gint64 last_flush;
+	mtp_uint32 n_objs;	/* Detached so far */
+} delete_batch_t;
+
+/*
+ * Detaches the batch and sends ObjectRemoved for the top of each tree in
+ * it, so that the host sees a long deletion progress.
+ */
+static void __flush_delete_batch(delete_batch_t *del)
+{
+	GHashTableIter iter;
+	gpointer value = NULL;
+	mtp_obj_t *obj = NULL;
+
+	del->last_flush = g_get_monotonic_time();
+	if (g_hash_table_size(del->batch) == 0)
+		return;
+
+	/* Folders kept for their read-only files stay */
+	g_hash_table_foreach_remove(del->batch, __is_object_file_kept, NULL);
+
+	g_hash_table_iter_init(&iter, del->batch);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		obj = (mtp_obj_t *)value;
+		if (!g_hash_table_contains(del->batch,
+					GUINT_TO_POINTER(obj->obj_info->h_parent)))
+			_eh_send_event_req_to_eh_thread(EVENT_OBJECT_REMOVED,
+					obj->obj_handle, 0, NULL);
+	}
+
+	del->n_objs += g_hash_table_size(del->batch);
+	__detach_objects_from_store(del->store, del->batch);
+	g_hash_table_remove_all(del->batch);
+}
+
+static void __add_removed_child(const mtp_char *name, void *user_data)
+{
+	delete_batch_t *del = (delete_batch_t *)user_data;
+	mtp_obj_t *obj = NULL;
+	mtp_char *path = NULL;
+
+	path = g_strconcat(del->dir_path, "/", name, NULL);
+	obj = (mtp_obj_t *)g_hash_table_lookup(del->store->path_index, path);
+	g_free(path);
+
+	if (obj != NULL && obj->obj_info != NULL)
+		__collect_object_tree(del->store, obj, del->batch);
+
+	if (g_get_monotonic_time() - del->last_flush >= G_USEC_PER_SEC)
+		__flush_delete_batch(del);
+}
+
+/*
+ * Deletes obj, a whole folder tree if it is an association, and takes it
+ * out of the store. The tree is removed from disk directory by directory
+ * without going through its objects, which are detached in batches as
+ * the child trees of obj go. Trees holding write protected objects go through
+ * _entity_remove_object_mtp_store() one object at a time instead.
+ */
+static mtp_bool __delete_object_tree(mtp_store_t *store, mtp_obj_t *obj,
+		mtp_bool read_only, mtp_uint16 *response, mtp_bool *atleast_one)
+{
+	GHashTable *batch = NULL;
+	delete_batch_t del = { 0 };
+	mtp_uint32 num_of_deleted_file = 0;
+	mtp_uint32 num_of_file = 0;
+	mtp_int32 ret = MTP_ERROR_NONE;
+	mtp_bool all_del = FALSE;
+	gint64 start = g_get_monotonic_time();
+
+	if (TRUE == g_status->cancel_intialization ||
+			TRUE == g_status->is_usb_discon) {
+		ERR("Delete operation cancelled or USB is disconnected\n");
+		*response = PTP_RESPONSE_PARTIAL_DELETION;
+		return FALSE;
+	}
+
+	if (obj->obj_info == NULL) {
+		*response = PTP_RESPONSE_UNDEFINED;
+		return FALSE;
+	}
+
+	batch = g_hash_table_new(g_direct_hash, g_direct_equal);
+	__collect_object_tree(store, obj, batch);
+
+#ifdef MTP_SUPPORT_SET_PROTECTION
+	/* Delete readonly files/folder */
+	if (!read_only) {
+		obj->obj_info->protcn_status = PTP_PROTECTIONSTATUS_NOPROTECTION;
+		_entity_invalidate_obj_info(obj);
+	}
+#endif /* MTP_SUPPORT_SET_PROTECTION */
+
+	if (obj->obj_info->obj_fmt != PTP_FMT_ASSOCIATION ||
+			(read_only && __is_tree_write_protected(batch))) {
+		g_hash_table_destroy(batch);
+		if (!_entity_remove_object_mtp_store(store, obj,
+					PTP_FORMATCODE_NOTUSED, response,
+					atleast_one, read_only))
+			return FALSE;
+
+		_entity_detach_object_from_store(store, obj);
+		_entity_dealloc_mtp_obj(obj);
+		return TRUE;
+	}
+
+	/* Collected again below, the child trees go away meanwhile */
+	g_hash_table_remove_all(batch);
+
+	del.store = store;
+	del.dir_path = obj->file_path;
+	del.batch = batch;
+	del.last_flush = start;
+	ret = _util_remove_dir_children_notify(obj->file_path,
+			&num_of_deleted_file, &num_of_file, read_only,
+			__add_removed_child, &del);
+	__flush_delete_batch(&del);
+	if (MTP_ERROR_GENERAL == ret || MTP_ERROR_ACCESS_DENIED == ret) {
+		ERR_SECURE("directory children deletion Fail [%s]\n",
+				obj->file_path);
+		*response = (MTP_ERROR_ACCESS_DENIED == ret) ?
+			PTP_RESPONSE_ACCESSDENIED : PTP_RESPONSE_GEN_ERROR;
+		g_hash_table_destroy(batch);
+		return FALSE;
+	}
+
+	if (MTP_ERROR_OBJECT_WRITE_PROTECTED != ret) {
+		g_snprintf(g_last_deleted, MTP_MAX_PATHNAME_SIZE + 1, "%s",
+				obj->file_path);
+		if (rmdir(obj->file_path) == 0) {
+			all_del = TRUE;
+		} else {
+			memset(g_last_deleted, 0, MTP_MAX_PATHNAME_SIZE + 1);
+			*response = (EACCES == errno) ? PTP_RESPONSE_ACCESSDENIED :
+				PTP_RESPONSE_GEN_ERROR;
+		}
+	}
+
+	if (num_of_deleted_file > 0)
+		*atleast_one = TRUE;
+
+	/* obj, and what was not in the listing or is still there */
+	__collect_object_tree(store, obj, batch);
+
+	if (all_del) {
+		*response = PTP_RESPONSE_OK;
+	} else {
+		/* Read-only files and their folders stay */
+		g_hash_table_foreach_remove(batch, __is_object_file_kept, NULL);
+		if (MTP_ERROR_OBJECT_WRITE_PROTECTED == ret)
+			*response = (*atleast_one) ? PTP_RESPONSE_PARTIAL_DELETION :
+				PTP_RESPONSE_OBJ_WRITEPROTECTED;
+	}
+
+	DBG("Deleted [%u] of [%u] entries, [%u] objects in [%lld] ms\n",
+			num_of_deleted_file, num_of_file,
+			del.n_objs + g_hash_table_size(batch),
+			(long long)((g_get_monotonic_time() - start) / 1000));
+
+	__detach_objects_from_store(store, batch);
+	g_hash_table_destroy(batch);
+
+	/* Files unknown to the store went too, let statfs() tell */
+	g_atomic_int_set(&store->is_space_dirty, TRUE);
+
+	return all_del;
+}
+
+/*
+ * Deletes the objects of one format, or all files for PTP_FORMATCODE_ALL,
+ * from a whole store, then detaches those that are gone in one pass.
+ */
+static mtp_uint16 __delete_objects_by_format(mtp_store_t *store,
+		mtp_uint32 fmt, mtp_bool read_only, mtp_bool *all_del,
+		mtp_bool *atleast_one)
+{
+	GHashTable *batch = NULL;
+	slist_node_t *node = NULL;
+	mtp_obj_t *obj = NULL;
+	mtp_uint16 response = PTP_RESPONSE_OK;
+
+	batch = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (node = store->obj_list.start; node != NULL; node = node->link) {
+		if (TRUE == g_status->cancel_intialization ||
+				TRUE == g_status->is_usb_discon) {
+			ERR("USB is disconnected format\
+					operation is cancelled.\n");
+			response = PTP_RESPONSE_GEN_ERROR;
+			break;
+		}
+
+		obj = (mtp_obj_t *)node->value;
+		if (obj == NULL || obj->obj_info == NULL ||
+				obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION)
+			continue;
+		if (fmt != PTP_FORMATCODE_ALL && obj->obj_info->obj_fmt != fmt)
+			continue;
+
+#ifdef MTP_SUPPORT_SET_PROTECTION
+		if (!read_only)
+			obj->obj_info->protcn_status =
+				PTP_PROTECTIONSTATUS_NOPROTECTION;
+#endif /* MTP_SUPPORT_SET_PROTECTION */
+
+		if (__remove_object_file(store, obj, &response)) {
+			*atleast_one = TRUE;
+			g_hash_table_insert(batch,
+					GUINT_TO_POINTER(obj->obj_handle), obj);
+		} else if (PTP_RESPONSE_OBJ_WRITEPROTECTED == response ||
+				PTP_RESPONSE_ACCESSDENIED == response) {
+			*all_del = FALSE;
+		}
+	}
+
+	__detach_objects_from_store(store, batch);
+	g_hash_table_destroy(batch);
+
+	return response;
+}
+
+mtp_bool _entity_remove_object_mtp_store(mtp_store_t *store, mtp_obj_t *obj,
+		mtp_uint32 format, mtp_uint16 *response, mtp_bool *atleast_one,
+		mtp_bool read_only)
+{
+	mtp_bool all_del = TRUE;
+	mtp_uint32 h_parent = 0;
+	obj_info_t *objinfo = NULL;
+	mtp_int32 ret = MTP_ERROR_NONE;
+
+	retv_if(store == NULL, 0);
+
+	if (TRUE == g_status->cancel_intialization ||
+			TRUE == g_status->is_usb_discon) {
+		ERR("Delete operation cancelled or USB is disconnected\n");
+		*response = PTP_RESPONSE_PARTIAL_DELETION;
 		return FALSE;
 	}
 
@@ -589,6 +1450,12 @@ mtp_bool _entity_remove_object_mtp_store(mtp_store_t *store, mtp_obj_t *obj,
 		ptp_array_t child_arr = { 0 };
 		mtp_obj_t *child_obj = NULL;
 
+		/* Only some children are known, pick up the rest so that
+		 * the folder can be emptied through the store
+		 */
+		if (!obj->is_enumerated && obj->children.num_ele > 0)
+			_entity_store_enum_folder_objects(store, obj);
+
 		_prop_init_ptparray(&child_arr, UINT32_TYPE);
 		_entity_get_child_handles(store, obj->obj_handle, &child_arr);
 
@@ -615,10 +1482,8 @@ mtp_bool _entity_remove_object_mtp_store(mtp_store_t *store, mtp_obj_t *obj,
 				if (_entity_remove_object_mtp_store(store, child_obj,
 							format, response, atleast_one,
 							read_only)) {
-					slist_node_t *node;
-					node = _util_delete_node(&(store->obj_list),
+					_entity_detach_object_from_store(store,
 							child_obj);
-					g_free(node);
 					*atleast_one = TRUE;
 					_entity_dealloc_mtp_obj(child_obj);
 				} else {
@@ -689,33 +1554,9 @@ mtp_bool _entity_remove_object_mtp_store(mtp_store_t *store, mtp_obj_t *obj,
 			ERR("all member in this folder is not deleted.\n");
 		}
 	} else {
-#ifdef MTP_SUPPORT_SET_PROTECTION
-		size = objinfo->file_size;
-#endif /* MTP_SUPPORT_SET_PROTECTION */
-
-		if (objinfo->protcn_status ==
-				PTP_PROTECTIONSTATUS_READONLY ||
-				objinfo->protcn_status ==
-				MTP_PROTECTIONSTATUS_READONLY_DATA) {
-			*response = PTP_RESPONSE_OBJ_WRITEPROTECTED;
-			return FALSE;
-		}
-
-		/* delete the real file */
-		g_snprintf(g_last_deleted, MTP_MAX_PATHNAME_SIZE + 1,
-				"%s", obj->file_path);
-		if (remove(obj->file_path) < 0) {
-			memset(g_last_deleted, 0,
-					MTP_MAX_PATHNAME_SIZE + 1);
-			*response = PTP_RESPONSE_GEN_ERROR;
-			if (EACCES == errno)
-				*response = PTP_RESPONSE_ACCESSDENIED;
+		if (!__remove_object_file(store, obj, response))
 			return FALSE;
-		}
 		*atleast_one = TRUE;
-
-		/* Upate store's available space */
-		store->store_info.free_space += size;
 	}
 
 	if (all_del) {
@@ -754,36 +1595,55 @@ mtp_uint16 _entity_delete_obj_mtp_store(mtp_store_t *store,
 	retvm_if(PTP_STORAGEACCESS_R == store->store_info.access,
 		PTP_RESPONSE_STORE_READONLY, "Read only store\n");
 
-	if (PTP_OBJECTHANDLE_ALL == obj_handle) {
-		slist_node_t *node = NULL;
-		node = store->obj_list.start;
-		while (NULL != node) {
+	if (PTP_OBJECTHANDLE_ALL == obj_handle &&
+			fmt != PTP_FORMATCODE_NOTUSED &&
+			fmt != PTP_FMT_ASSOCIATION) {
+		response = __delete_objects_by_format(store, fmt, read_only,
+				&all_del, &atleas_one);
+		if (PTP_RESPONSE_GEN_ERROR == response)
+			return response;
+	} else if (PTP_OBJECTHANDLE_ALL == obj_handle) {
+		ptp_array_t top_arr = { 0 };
+		mtp_uint32 *ptr32 = NULL;
+		mtp_uint32 ii = 0;
+
+		if (!store->is_root_enumerated)
+			_entity_store_enum_folder_objects(store, NULL);
+
+		/* Each top level tree goes at once, children included */
+		_prop_init_ptparray(&top_arr, UINT32_TYPE);
+		_entity_get_child_handles(store, PTP_OBJECTHANDLE_ROOT, &top_arr);
+		ptr32 = top_arr.array_entry;
+
+		for (ii = 0; ii < top_arr.num_ele; ii++) {
 			if (TRUE == g_status->cancel_intialization ||
 					TRUE == g_status->is_usb_discon) {
 				ERR("USB is disconnected format\
 						operation is cancelled.\n");
-				response = PTP_RESPONSE_GEN_ERROR;
-				return response;
-			}
-			/* protect from disconnect USB */
-			if (NULL == store || NULL == node ||
-					NULL == node->value) {
+				_prop_deinit_ptparray(&top_arr);
 				response = PTP_RESPONSE_GEN_ERROR;
 				return response;
 			}
 
-			obj = (mtp_obj_t *)node->value;
-			if (_entity_remove_object_mtp_store(store, obj,
-						fmt, &response, &atleas_one, read_only)) {
+			obj = _entity_get_object_from_store(store, ptr32[ii]);
+			if (obj == NULL || obj->obj_info == NULL)
+				continue;
 
-				slist_node_t *temp = NULL;
+			/* Associations only, as before: files are skipped */
+			if (fmt == PTP_FMT_ASSOCIATION &&
+					obj->obj_info->obj_fmt != PTP_FMT_ASSOCIATION)
+				continue;
 
-				node = node->link;
-				temp = _util_delete_node(&(store->obj_list), obj);
-				g_free(temp);
-				_entity_dealloc_mtp_obj(obj);
+			if (fmt == PTP_FMT_ASSOCIATION) {
+				if (_entity_remove_object_mtp_store(store, obj,
+							fmt, &response, &atleas_one,
+							read_only)) {
+					_entity_detach_object_from_store(store, obj);
+					_entity_dealloc_mtp_obj(obj);
+				}
 			} else {
-				node = node->link;
+				__delete_object_tree(store, obj, read_only,
+						&response, &atleas_one);
 			}
 
 			switch (response) {
@@ -798,22 +1658,16 @@ mtp_uint16 _entity_delete_obj_mtp_store(mtp_store_t *store,
 			default:
 				break;
 			}
-
 		}
+		_prop_deinit_ptparray(&top_arr);
 	} else {
 		DBG("object handle is not PTP_OBJECTHANDLE_ALL. [%u]\n",
 				obj_handle);
 		obj = _entity_get_object_from_store(store, obj_handle);
 
 		if (NULL != obj) {
-			if (_entity_remove_object_mtp_store(store, obj, PTP_FORMATCODE_NOTUSED,
-						&response, &atleas_one, read_only)) {
-				slist_node_t *temp = NULL;
-
-				temp = _util_delete_node(&(store->obj_list), obj);
-				g_free(temp);
-				_entity_dealloc_mtp_obj(obj);
-			} else {
+			if (!__delete_object_tree(store, obj, read_only,
+						&response, &atleas_one)) {
 				switch (response) {
 				case PTP_RESPONSE_PARTIAL_DELETION:
 					all_del = FALSE;
@@ -850,20 +1704,14 @@ mtp_uint32 _entity_get_object_tree_size(mtp_store_t *store, mtp_obj_t *obj)
 	if (obj->obj_info->obj_fmt != PTP_FMT_ASSOCIATION) {
 		size = obj->obj_info->file_size;
 	} else {
-		ptp_array_t child_arr = { 0 };
+		mtp_uint32 *ptr32 = obj->children.array_entry;
 		mtp_obj_t *child_obj = NULL;
 
-		_prop_init_ptparray(&child_arr, UINT32_TYPE);
-
-		_entity_get_child_handles(store, obj->obj_handle, &child_arr);
-
-		for (i = 0; i < child_arr.num_ele; i++) {
-			mtp_uint32 *ptr32 = child_arr.array_entry;
+		for (i = 0; i < obj->children.num_ele; i++) {
 			child_obj = _entity_get_object_from_store(store,
 					ptr32[i]);
 			size += _entity_get_object_tree_size(store, child_obj);
 		}
-		_prop_deinit_ptparray(&child_arr);
 	}
 
 	return size;
@@ -873,20 +1721,19 @@ mtp_bool _entity_check_if_B_parent_of_A(mtp_store_t *store,
 		mtp_uint32 handleA, mtp_uint32 handleB)
 {
 	mtp_uint32 i = 0;
+	mtp_uint32 *ptr32 = NULL;
 	mtp_obj_t *obj = NULL;
-	ptp_array_t child_arr = {0};
+	mtp_obj_t *parent_obj = NULL;
 
 	retv_if(store == NULL, FALSE);
 
-	_prop_init_ptparray(&child_arr, UINT32_TYPE);
-	_entity_get_child_handles(store, handleB, &child_arr);
+	parent_obj = _entity_get_object_from_store(store, handleB);
+	retv_if(parent_obj == NULL, FALSE);
 
-	for (i = 0; i < child_arr.num_ele; i++) {
-		mtp_uint32 *ptr32 = child_arr.array_entry;
-		if (handleA == ptr32[i]) {
-			_prop_deinit_ptparray(&child_arr);
+	ptr32 = parent_obj->children.array_entry;
+	for (i = 0; i < parent_obj->children.num_ele; i++) {
+		if (handleA == ptr32[i])
 			return TRUE;
-		}
 
 		obj = _entity_get_object_from_store(store, ptr32[i]);
 		if (obj == NULL || obj->obj_info == NULL ||
@@ -894,12 +1741,9 @@ mtp_bool _entity_check_if_B_parent_of_A(mtp_store_t *store,
 				PTP_FMT_ASSOCIATION) {
 			continue;
 		}
-		if (_entity_check_if_B_parent_of_A(store, handleA, ptr32[i])) {
-			_prop_deinit_ptparray(&child_arr);
+		if (_entity_check_if_B_parent_of_A(store, handleA, ptr32[i]))
 			return TRUE;
-		}
 	}
-	_prop_deinit_ptparray(&child_arr);
 	return FALSE;
 }
 
@@ -921,41 +1765,415 @@ void _entity_destroy_mtp_store(mtp_store_t *store)
 	}
 
 	_util_init_list(&(store->obj_list));
+
+	if (store->handle_index) {
+		g_hash_table_destroy(store->handle_index);
+		store->handle_index = NULL;
+	}
+	__free_shadowed_index(store);
+	if (store->path_index) {
+		g_hash_table_destroy(store->path_index);
+		store->path_index = NULL;
+	}
+	if (store->format_index) {
+		g_hash_table_destroy(store->format_index);
+		store->format_index = NULL;
+	}
+	if (store->handles_cache) {
+		g_hash_table_destroy(store->handles_cache);
+		store->handles_cache = NULL;
+	}
+	_prop_deinit_ptparray(&(store->root_children));
+	store->is_root_enumerated = FALSE;
+	store->is_ready = FALSE;
 }
 /* LCOV_EXCL_STOP */
 
-void _entity_store_recursive_enum_folder_objects(mtp_store_t *store,
-		mtp_obj_t *pobj)
+static scan_dir_t *__new_scan_dir(mtp_char *path)
 {
-	DIR *h_dir = 0;
+	scan_dir_t *dir = g_new0(scan_dir_t, 1);
+
+	dir->path = g_strdup(path);
+	dir->entries = g_array_new(FALSE, FALSE, sizeof(scan_entry_t));
+	return dir;
+}
+
+static void __init_scan_ctx(scan_ctx_t *ctx, mtp_uint32 n_queues)
+{
+	mtp_uint32 ii = 0;
+
+	pthread_mutex_init(&ctx->lock, NULL);
+	pthread_cond_init(&ctx->work_cond, NULL);
+	pthread_cond_init(&ctx->read_cond, NULL);
+	for (ii = 0; ii < n_queues; ii++) {
+		pthread_mutex_init(&ctx->queues[ii].lock, NULL);
+		g_queue_init(&ctx->queues[ii].dirs);
+	}
+	ctx->n_queues = n_queues;
+	ctx->n_pending = 0;
+	ctx->stop = FALSE;
+}
+
+static void __deinit_scan_ctx(scan_ctx_t *ctx)
+{
+	mtp_uint32 ii = 0;
+
+	for (ii = 0; ii < ctx->n_queues; ii++) {
+		g_queue_clear(&ctx->queues[ii].dirs);
+		pthread_mutex_destroy(&ctx->queues[ii].lock);
+	}
+	pthread_cond_destroy(&ctx->read_cond);
+	pthread_cond_destroy(&ctx->work_cond);
+	pthread_mutex_destroy(&ctx->lock);
+}
+
+static void __free_scan_dir(scan_dir_t *dir)
+{
+	mtp_uint32 ii = 0;
+	scan_entry_t *se = NULL;
+
+	ret_if(dir == NULL);
+
+	for (ii = 0; ii < dir->entries->len; ii++) {
+		se = &g_array_index(dir->entries, scan_entry_t, ii);
+		__free_scan_dir(se->dir);
+		g_free(se->path);
+	}
+	g_array_free(dir->entries, TRUE);
+	g_free(dir->path);
+	g_free(dir);
+}
+
+/*
+ * Reads one directory without touching the store, so that it can run on
+ * any scan thread. Sub-directories go to the reader's queue in reverse
+ * order, which makes the next one to be merged the first one it picks up.
+ */
+static void __scan_read_dir(scan_ctx_t *ctx, scan_dir_t *dir,
+		mtp_uint32 qidx)
+{
+	scan_queue_t *queue = &(ctx->queues[qidx]);
+	mtp_dir_t *h_dir = NULL;
+	dir_entry_t entry = { { 0 }, 0 };
+	mtp_char file_name[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	scan_entry_t se = { 0 };
+	mtp_bool is_complete = FALSE;
+	mtp_int32 ii = 0;
+
+	if (!_util_ifind_first(dir->path, &h_dir, &entry))
+		goto DONE;
+
+	do {
+		if (TRUE == g_status->is_usb_discon)
+			break;
+
+		_util_get_file_name(entry.filename, file_name);
+		if (file_name[0] == '\0' || file_name[0] == '.')
+			continue;
+
+		if (entry.type != MTP_DIR_TYPE && entry.type != MTP_FILE_TYPE)
+			continue;
+
+		se.path = g_strdup(entry.filename);
+		se.type = entry.type;
+		se.attrs = entry.attrs;
+		se.dir = (entry.type == MTP_DIR_TYPE) ?
+			__new_scan_dir(entry.filename) : NULL;
+		g_array_append_val(dir->entries, se);
+	} while (_util_ifind_next(dir->path, h_dir, &entry));
+
+	/* Entries past a read error are unknown, so it is read again later */
+	is_complete = (TRUE != g_status->is_usb_discon && h_dir->error == 0);
+	dir->mtime = h_dir->mtime;
+
+	_util_ifind_close(h_dir);
+
+DONE:
+	pthread_mutex_lock(&queue->lock);
+	for (ii = (mtp_int32)dir->entries->len - 1; ii >= 0; ii--) {
+		scan_entry_t *child = &g_array_index(dir->entries,
+				scan_entry_t, ii);
+
+		if (child->dir) {
+			g_queue_push_tail(&queue->dirs, child->dir);
+			g_atomic_int_inc(&ctx->n_pending);
+		}
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	pthread_mutex_lock(&ctx->lock);
+	dir->is_complete = is_complete;
+	dir->is_read = TRUE;
+	pthread_cond_broadcast(&ctx->work_cond);
+	pthread_cond_broadcast(&ctx->read_cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/*
+ * Takes a directory nobody has claimed: the newest of queue idx, else the
+ * oldest of another queue. Directories the merging thread read itself
+ * are dropped on the way.
+ */
+static scan_dir_t *__scan_take_dir(scan_ctx_t *ctx, mtp_uint32 idx)
+{
+	scan_queue_t *queue = NULL;
+	scan_dir_t *dir = NULL;
+	mtp_uint32 ii = 0;
+
+	for (ii = 0; ii < ctx->n_queues; ii++) {
+		queue = &(ctx->queues[(idx + ii) % ctx->n_queues]);
+
+		pthread_mutex_lock(&queue->lock);
+		do {
+			dir = (ii == 0) ? g_queue_pop_tail(&queue->dirs) :
+				g_queue_pop_head(&queue->dirs);
+			if (dir == NULL)
+				break;
+			g_atomic_int_add(&ctx->n_pending, -1);
+		} while (!g_atomic_int_compare_and_exchange(&dir->is_taken,
+					FALSE, TRUE));
+		pthread_mutex_unlock(&queue->lock);
+
+		if (dir != NULL)
+			return dir;
+	}
+
+	return NULL;
+}
+
+static void *__scan_worker(void *arg)
+{
+	scan_worker_t *worker = (scan_worker_t *)arg;
+	scan_ctx_t *ctx = worker->ctx;
+	scan_dir_t *dir = NULL;
+	mtp_bool stop = FALSE;
+
+	while (!stop) {
+		dir = __scan_take_dir(ctx, worker->idx);
+		if (dir != NULL) {
+			__scan_read_dir(ctx, dir, worker->idx);
+			continue;
+		}
+
+		pthread_mutex_lock(&ctx->lock);
+		while (!ctx->stop && g_atomic_int_get(&ctx->n_pending) == 0)
+			pthread_cond_wait(&ctx->work_cond, &ctx->lock);
+		stop = ctx->stop;
+		pthread_mutex_unlock(&ctx->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Adds the entries of dir to the store, then merges its sub-directories
+ * one by one. Handles are therefore assigned in the same depth-first
+ * order as a single threaded scan, whatever order the threads read in.
+ * A directory nobody has picked up yet is read by the merging thread.
+ */
+static void __scan_merge_dir(scan_ctx_t *ctx, mtp_store_t *store,
+		mtp_obj_t *pobj, scan_dir_t *dir, mtp_bool recursive)
+{
+	dir_entry_t entry = { { 0 }, 0 };
+	mtp_char file_name[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_uint32 h_parent = pobj ? pobj->obj_handle : PTP_OBJECTHANDLE_ROOT;
+	mtp_bool do_read = FALSE;
+	scan_entry_t *se = NULL;
+	mtp_obj_t *obj = NULL;
+	mtp_uint32 ii = 0;
+
+	do_read = g_atomic_int_compare_and_exchange(&dir->is_taken, FALSE,
+			TRUE);
+	pthread_mutex_lock(&ctx->lock);
+	while (!do_read && !dir->is_read)
+		pthread_cond_wait(&ctx->read_cond, &ctx->lock);
+	pthread_mutex_unlock(&ctx->lock);
+
+	if (do_read)
+		__scan_read_dir(ctx, dir, ctx->n_queues - 1);
+
+	for (ii = 0; ii < dir->entries->len; ii++) {
+		if (TRUE == g_status->is_usb_discon)
+			return;
+
+		se = &g_array_index(dir->entries, scan_entry_t, ii);
+
+		/* Added earlier by the host or by an inotify event */
+		obj = (mtp_obj_t *)g_hash_table_lookup(store->path_index,
+				se->path);
+		if (obj == NULL) {
+			g_strlcpy(entry.filename, se->path, sizeof(entry.filename));
+			entry.type = se->type;
+			entry.attrs = se->attrs;
+			_util_get_file_name(se->path, file_name);
+
+			if (se->type == MTP_DIR_TYPE)
+				obj = _entity_add_folder_to_store(store, h_parent,
+						entry.filename, file_name, &entry);
+			else
+				_entity_add_file_to_store(store, h_parent,
+						entry.filename, file_name, &entry);
+		}
+
+		if (recursive && se->dir && obj)
+			__scan_merge_dir(ctx, store, obj, se->dir, TRUE);
+	}
+
+	if (!dir->is_complete)
+		return;
+
+	if (pobj) {
+		pobj->is_enumerated = TRUE;
+		pobj->dir_mtime = dir->mtime;
+	} else {
+		store->is_root_enumerated = TRUE;
+		store->root_mtime = dir->mtime;
+	}
+
+#ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
+	_inoti_add_watch_for_fs_events(dir->path);
+#endif /*MTP_SUPPORT_OBJECTADDDELETE_EVENT*/
+}
+
+static mtp_uint32 __get_scan_threads(void)
+{
+	long n_cpus = 0;
+
+	if (g_conf.scan_threads > 0)
+		return MIN((mtp_uint32)g_conf.scan_threads, MTP_MAX_SCAN_THREADS);
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1)
+		return 1;
+
+	return MIN((mtp_uint32)n_cpus, MTP_MAX_SCAN_THREADS);
+}
+
+/*
+ * Scans the whole tree below folder_name with n_threads reader threads.
+ * Returns FALSE if no thread could be started, nothing is added then.
+ */
+static mtp_bool __scan_tree(mtp_store_t *store, mtp_obj_t *pobj,
+		mtp_char *folder_name, mtp_uint32 n_threads)
+{
+	scan_ctx_t ctx;
+	scan_dir_t *root = NULL;
+	pthread_t tids[MTP_MAX_SCAN_THREADS];
+	scan_worker_t workers[MTP_MAX_SCAN_THREADS];
+	mtp_uint32 n_started = 0;
+	mtp_uint32 ii = 0;
+
+	n_threads = MIN(n_threads, MTP_MAX_SCAN_THREADS);
+	__init_scan_ctx(&ctx, n_threads + 1);
+
+	/* The root is read by whoever gets to it first */
+	root = __new_scan_dir(folder_name);
+	g_queue_push_tail(&ctx.queues[0].dirs, root);
+	ctx.n_pending = 1;
+
+	for (ii = 0; ii < n_threads; ii++) {
+		workers[n_started].ctx = &ctx;
+		workers[n_started].idx = n_started;
+		if (!_util_thread_create(&tids[n_started], "scan thread",
+					PTHREAD_CREATE_JOINABLE, __scan_worker,
+					(void *)&workers[n_started])) {
+			ERR("scan thread creation Fail\n");
+			break;
+		}
+		n_started++;
+	}
+
+	if (n_started > 0)
+		__scan_merge_dir(&ctx, store, pobj, root, TRUE);
+
+	pthread_mutex_lock(&ctx.lock);
+	ctx.stop = TRUE;
+	pthread_cond_broadcast(&ctx.work_cond);
+	pthread_mutex_unlock(&ctx.lock);
+
+	for (ii = 0; ii < n_started; ii++)
+		_util_thread_join(tids[ii], NULL);
+
+	__free_scan_dir(root);
+	__deinit_scan_ctx(&ctx);
+
+	return (n_started > 0) ? TRUE : FALSE;
+}
+
+/*
+ * Scans the folder of pobj (the store root if pobj is NULL) and adds the
+ * entries that are not in the store yet. Folders already scanned are not
+ * read again; with recursive set their sub-folders are still visited.
+ */
+static void __enum_folder_objects(mtp_store_t *store, mtp_obj_t *pobj,
+		mtp_bool recursive)
+{
+	mtp_dir_t *h_dir = NULL;
 	mtp_char file_name[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 	mtp_bool status = FALSE;
 	mtp_obj_t *obj = NULL;
 	dir_entry_t entry = { { 0 }, 0 };
 	mtp_char *folder_name;
 	mtp_uint32 h_parent;
+	ptp_array_t *children = NULL;
+	mtp_bool *is_enumerated = NULL;
+	mtp_int64 *dir_mtime = NULL;
+	mtp_uint32 ii = 0;
 
 	ret_if(NULL == store);
 
 	if (!pobj) {
 		folder_name = store->root_path;
 		h_parent = PTP_OBJECTHANDLE_ROOT;
+		children = &(store->root_children);
+		is_enumerated = &(store->is_root_enumerated);
+		dir_mtime = &(store->root_mtime);
 	} else {
 		folder_name = pobj->file_path;
 		h_parent = pobj->obj_handle;
+		children = &(pobj->children);
+		is_enumerated = &(pobj->is_enumerated);
+		dir_mtime = &(pobj->dir_mtime);
+	}
+
+	if (*is_enumerated) {
+		if (!recursive)
+			return;
+
+		for (ii = 0; ii < children->num_ele; ii++) {
+			mtp_uint32 *ptr32 = children->array_entry;
+
+			if (TRUE == g_status->is_usb_discon)
+				return;
+
+			obj = _entity_get_object_from_store(store, ptr32[ii]);
+			if (obj && obj->obj_info &&
+					obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION)
+				__enum_folder_objects(store, obj, TRUE);
+		}
+		return;
 	}
 
 	retm_if(folder_name == NULL || folder_name[0] != '/',
 		"foldername has no root slash!!\n");
 
+	/*
+	 * The folder was never read through, but the host or a file system
+	 * event may have added entries to it, sub-folders included. The
+	 * scan reads the whole subtree and the merge skips whatever the
+	 * path index already holds.
+	 */
+	if (recursive && __get_scan_threads() > 1 &&
+			__scan_tree(store, pobj, folder_name, __get_scan_threads()))
+		return;
+
 	retm_if(!_util_ifind_first(folder_name, &h_dir, &entry), "No more files\n");
 
 	do {
 		if (TRUE == g_status->is_usb_discon) {
 			/* LCOV_EXCL_START */
 			DBG("USB is disconnected\n");
-			if (closedir(h_dir) < 0)
-				ERR("Close directory Fail\n");
+			_util_ifind_close(h_dir);
 
 			return;
 			/* LCOV_EXCL_STOP */
@@ -969,19 +2187,29 @@ void _entity_store_recursive_enum_folder_objects(mtp_store_t *store,
 
 		if (file_name[0] == '.') {
 			DBG_SECURE("Hidden file [%s]\n", entry.filename);
-		} else if (entry.type == MTP_DIR_TYPE) {
-			obj = _entity_add_folder_to_store(store, h_parent,
-					entry.filename, file_name, &entry);
+			goto NEXT;
+		}
+
+		/* Added earlier by the host or by an inotify event */
+		obj = (mtp_obj_t *)g_hash_table_lookup(store->path_index,
+				entry.filename);
+
+		if (entry.type == MTP_DIR_TYPE) {
+			if (NULL == obj)
+				obj = _entity_add_folder_to_store(store, h_parent,
+						entry.filename, file_name, &entry);
 
 			if (NULL == obj) {
 				ERR("pObject is NULL\n");
 				goto NEXT;
 			}
 
-			_entity_store_recursive_enum_folder_objects(store, obj);
+			if (recursive)
+				__enum_folder_objects(store, obj, TRUE);
 		} else if (entry.type == MTP_FILE_TYPE) {
-			_entity_add_file_to_store(store, h_parent,
-					entry.filename, file_name, &entry);
+			if (NULL == obj)
+				_entity_add_file_to_store(store, h_parent,
+						entry.filename, file_name, &entry);
 		} else {
 			DBG("UNKNOWN TYPE\n");
 		}
@@ -990,14 +2218,259 @@ NEXT:
 				&entry);
 	} while (status);
 
-	if (closedir(h_dir) < 0)
-		ERR("close directory fail\n");
+	if (h_dir->error != 0) {
+		/* Left unenumerated, so the next listing reads it again */
+		ERR_SECURE("Reading [%s] Fail : %d\n", folder_name, h_dir->error);
+		_util_ifind_close(h_dir);
+		return;
+	}
+
+	*dir_mtime = h_dir->mtime;
+	_util_ifind_close(h_dir);
+
+	*is_enumerated = TRUE;
 
 #ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
 	_inoti_add_watch_for_fs_events(folder_name);
 #endif /*MTP_SUPPORT_OBJECTADDDELETE_EVENT*/
 }
 
+/*
+ * Full scan of the tree below pobj, used when the host asks for every
+ * object of a store.
+ */
+void _entity_store_recursive_enum_folder_objects(mtp_store_t *store,
+		mtp_obj_t *pobj)
+{
+	mtp_uint32 n_objs = 0;
+	gint64 start = 0;
+	gint64 elapsed = 0;
+
+	ret_if(NULL == store);
+
+	n_objs = store->obj_list.nnodes;
+	start = g_get_monotonic_time();
+
+	__enum_folder_objects(store, pobj, TRUE);
+
+	n_objs = store->obj_list.nnodes - n_objs;
+	elapsed = g_get_monotonic_time() - start;
+	if (n_objs > 0)
+		DBG("Scanned [%u] objects in [%lld] ms, [%lld] objects/s\n",
+				n_objs, (long long)(elapsed / 1000),
+				(long long)(n_objs * G_USEC_PER_SEC / MAX(elapsed, 1)));
+}
+
+/*
+ * On-demand scan of a single folder level, used when the host lists the
+ * children of pobj (the store root if pobj is NULL).
+ */
+void _entity_store_enum_folder_objects(mtp_store_t *store, mtp_obj_t *pobj)
+{
+	__enum_folder_objects(store, pobj, FALSE);
+}
+
+/*
+ * Startup listing of the store root. The folder is read without the
+ * store lock, which is only taken to add what was found, so a slow
+ * volume does not hold up the requests on the other stores.
+ */
+void _entity_store_prefetch_root(mtp_store_t *store)
+{
+	scan_ctx_t ctx;
+	scan_dir_t *root = NULL;
+	mtp_bool is_enumerated = FALSE;
+
+	ret_if(NULL == store);
+
+	UTIL_READ_LOCK(&g_store_lock);
+	is_enumerated = store->is_root_enumerated;
+	if (!is_enumerated)
+		root = __new_scan_dir(store->root_path);
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	if (is_enumerated)
+		return;
+
+	__init_scan_ctx(&ctx, 1);
+	root->is_taken = TRUE;
+	__scan_read_dir(&ctx, root, 0);
+
+	UTIL_WRITE_LOCK(&g_store_lock);
+	/* The host may have listed it meanwhile, entries are not added twice */
+	if (!store->is_root_enumerated)
+		__scan_merge_dir(&ctx, store, NULL, root, FALSE);
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	__free_scan_dir(root);
+	__deinit_scan_ctx(&ctx);
+}
+
+/* An object as last seen by the store, checked by _entity_store_resync() */
+typedef struct {
+	mtp_uint32 handle;
+	mtp_char *path;
+	mtp_bool is_folder;
+	mtp_bool is_enumerated;
+	mtp_int64 mtime;	/* Folders: dir_mtime */
+	mtp_uint64 size;	/* Files */
+	mtp_bool is_gone;
+	mtp_bool is_changed;
+} resync_item_t;
+
+/* Reads the folder again and tells the host about its new entries */
+static void __rescan_folder(mtp_store_t *store, mtp_obj_t *pobj)
+{
+	ptp_array_t *children = pobj ? &(pobj->children) :
+		&(store->root_children);
+	mtp_uint32 n_known = children->num_ele;
+	mtp_uint32 *ptr32 = NULL;
+	mtp_uint32 ii = 0;
+
+	if (pobj)
+		pobj->is_enumerated = FALSE;
+	else
+		store->is_root_enumerated = FALSE;
+	__enum_folder_objects(store, pobj, FALSE);
+
+	/* New entries are appended */
+	ptr32 = children->array_entry;
+	for (ii = n_known; ii < children->num_ele; ii++)
+		_eh_send_event_req_to_eh_thread(EVENT_OBJECT_ADDED, ptr32[ii],
+				0, NULL);
+}
+
+/*
+ * Brings the store back in line with the file system after change events
+ * were lost. Every object is stat'ed without the store lock. Objects
+ * whose file is gone are dropped, files whose size changed are updated
+ * and folders whose mtime changed are read again. The host is told of
+ * what was added and removed.
+ */
+void _entity_store_resync(mtp_store_t *store)
+{
+	GHashTableIter iter;
+	gpointer value = NULL;
+	GArray *items = NULL;
+	resync_item_t item = { 0 };
+	resync_item_t *cur = NULL;
+	delete_batch_t del = { 0 };
+	mtp_obj_t *obj = NULL;
+	mtp_char *root_path = NULL;
+	mtp_int64 root_mtime = 0;
+	mtp_bool is_root_changed = FALSE;
+	struct stat stat_buf = { 0 };
+	mtp_int64 mtime = 0;
+	mtp_uint32 ii = 0;
+
+	ret_if(NULL == store);
+
+	items = g_array_new(FALSE, TRUE, sizeof(resync_item_t));
+
+	UTIL_READ_LOCK(&g_store_lock);
+	if (store->is_ready && store->handle_index) {
+		if (store->is_root_enumerated) {
+			root_path = g_strdup(store->root_path);
+			root_mtime = store->root_mtime;
+		}
+
+		g_hash_table_iter_init(&iter, store->handle_index);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			obj = (mtp_obj_t *)value;
+			if (obj->obj_info == NULL || obj->file_path == NULL)
+				continue;
+
+			memset(&item, 0, sizeof(item));
+			item.handle = obj->obj_handle;
+			item.path = g_strdup(obj->file_path);
+			item.is_folder = (obj->obj_info->obj_fmt ==
+					PTP_FMT_ASSOCIATION);
+			item.is_enumerated = obj->is_enumerated;
+			item.mtime = obj->dir_mtime;
+			item.size = obj->obj_info->file_size;
+			g_array_append_val(items, item);
+		}
+	}
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	for (ii = 0; ii < items->len; ii++) {
+		cur = &g_array_index(items, resync_item_t, ii);
+		if (lstat(cur->path, &stat_buf) < 0) {
+			cur->is_gone = TRUE;
+			continue;
+		}
+
+		mtime = (mtp_int64)stat_buf.st_mtim.tv_sec * 1000000000LL +
+			stat_buf.st_mtim.tv_nsec;
+		if (cur->is_folder) {
+			cur->is_changed = cur->is_enumerated && mtime != cur->mtime;
+		} else if (cur->size != (mtp_uint64)stat_buf.st_size) {
+			cur->size = (mtp_uint64)stat_buf.st_size;
+			cur->is_changed = TRUE;
+		}
+	}
+
+	if (root_path && stat(root_path, &stat_buf) == 0)
+		is_root_changed = root_mtime !=
+			(mtp_int64)stat_buf.st_mtim.tv_sec * 1000000000LL +
+			stat_buf.st_mtim.tv_nsec;
+
+	UTIL_WRITE_LOCK(&g_store_lock);
+	if (!store->is_ready || store->handle_index == NULL)
+		goto DONE;
+
+	del.store = store;
+	del.batch = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (ii = 0; ii < items->len; ii++) {
+		cur = &g_array_index(items, resync_item_t, ii);
+		if (!cur->is_gone)
+			continue;
+
+		/* Not replaced meanwhile by an object of the same handle */
+		obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+				GUINT_TO_POINTER(cur->handle));
+		if (obj && obj->obj_info && !g_strcmp0(obj->file_path, cur->path))
+			__collect_object_tree(store, obj, del.batch);
+	}
+	__flush_delete_batch(&del);
+	g_hash_table_destroy(del.batch);
+
+	for (ii = 0; ii < items->len; ii++) {
+		cur = &g_array_index(items, resync_item_t, ii);
+		if (!cur->is_changed)
+			continue;
+
+		obj = (mtp_obj_t *)g_hash_table_lookup(store->handle_index,
+				GUINT_TO_POINTER(cur->handle));
+		if (obj == NULL || obj->obj_info == NULL ||
+				g_strcmp0(obj->file_path, cur->path))
+			continue;
+
+		if (cur->is_folder) {
+			__rescan_folder(store, obj);
+		} else {
+			obj->obj_info->file_size = cur->size;
+			_prop_invalidate_obj_propvals(obj, PROP_CACHE_CONTENT);
+			_entity_invalidate_obj_info(obj);
+		}
+	}
+
+	if (is_root_changed)
+		__rescan_folder(store, NULL);
+
+	g_atomic_int_set(&store->is_space_dirty, TRUE);
+	DBG("Store [0x%x] checked again : [%u] objects\n", store->store_id,
+			items->len);
+
+DONE:
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	for (ii = 0; ii < items->len; ii++)
+		g_free(g_array_index(items, resync_item_t, ii).path);
+	g_array_free(items, TRUE);
+	g_free(root_path);
+}
+
 /* LCOV_EXCL_START */
 void _entity_copy_store_data(mtp_store_t *dst, mtp_store_t *src)
 {
@@ -1006,8 +2479,83 @@ void _entity_copy_store_data(mtp_store_t *dst, mtp_store_t *src)
 	dst->is_hidden = src->is_hidden;
 
 	memcpy(&(dst->obj_list), &(src->obj_list), sizeof(slist_t));
-	_entity_update_store_info_run_time(&(dst->store_info), dst->root_path);
+	dst->handle_index = src->handle_index;
+	dst->shadowed_index = src->shadowed_index;
+	dst->path_index = src->path_index;
+	dst->format_index = src->format_index;
+	dst->handles_cache = src->handles_cache;
+	dst->root_generation = src->root_generation;
+	dst->generation = src->generation;
+	dst->is_root_enumerated = src->is_root_enumerated;
+	dst->root_mtime = src->root_mtime;
+	dst->saved_generation = src->saved_generation;
+	dst->reserved_space = src->reserved_space;
+	dst->is_space_dirty = src->is_space_dirty;
+	dst->space_time = src->space_time;
+	dst->is_ready = src->is_ready;
+	memcpy(&(dst->root_children), &(src->root_children), sizeof(ptp_array_t));
+	dst->store_info.capacity = src->store_info.capacity;
+	dst->store_info.free_space = src->store_info.free_space;
 	_prop_copy_ptpstring(&(dst->store_info.store_desc), &(src->store_info.store_desc));
 	_prop_copy_ptpstring(&(dst->store_info.vol_label), &(src->store_info.vol_label));
 }
 /* LCOV_EXCL_STOP */
+
+/*
+ * Looks up a packed GetObjectHandles result for h_parent/format.
+ * h_parent is PTP_OBJECTHANDLE_ALL for queries spanning the whole store.
+ * On success *data points into the cache and stays valid until the store
+ * is modified.
+ */
+mtp_bool _entity_get_cached_handles(mtp_store_t *store, mtp_uint32 h_parent,
+		mtp_uint32 format, mtp_uchar **data, mtp_uint32 *data_sz)
+{
+	mtp_uint64 key = ((mtp_uint64)h_parent << 32) | format;
+	mtp_uint32 generation = 0;
+	handles_cache_t *entry = NULL;
+
+	retv_if(store == NULL || store->handles_cache == NULL, FALSE);
+	retv_if(data == NULL || data_sz == NULL, FALSE);
+
+	entry = (handles_cache_t *)g_hash_table_lookup(store->handles_cache, &key);
+	retv_if(entry == NULL, FALSE);
+
+	if (!__get_scope_generation(store, h_parent, &generation) ||
+			generation != entry->generation) {
+		g_hash_table_remove(store->handles_cache, &key);
+		return FALSE;
+	}
+
+	*data = entry->data;
+	*data_sz = entry->data_sz;
+	return TRUE;
+}
+
+void _entity_cache_handles(mtp_store_t *store, mtp_uint32 h_parent,
+		mtp_uint32 format, mtp_uchar *data, mtp_uint32 data_sz)
+{
+	mtp_uint32 generation = 0;
+	handles_cache_t *entry = NULL;
+
+	ret_if(store == NULL || store->handles_cache == NULL);
+	ret_if(data == NULL);
+
+	if (!__get_scope_generation(store, h_parent, &generation))
+		return;
+
+	if (g_hash_table_size(store->handles_cache) >=
+			MTP_MAX_HANDLES_CACHE_ENTRIES) {
+		DBG("Handles cache is full, dropping [%u] entries\n",
+				g_hash_table_size(store->handles_cache));
+		g_hash_table_remove_all(store->handles_cache);
+	}
+
+	entry = g_malloc(sizeof(handles_cache_t));
+	entry->key = ((mtp_uint64)h_parent << 32) | format;
+	entry->generation = generation;
+	entry->data_sz = data_sz;
+	entry->data = g_malloc(data_sz);
+	memcpy(entry->data, data, data_sz);
+
+	g_hash_table_replace(store->handles_cache, &(entry->key), entry);
+}
@@ -37,7 +37,8 @@
  */
 extern mtp_mgr_t g_mtp_mgr;
 extern mtp_bool g_is_full_enum;
-extern pthread_mutex_t g_cmd_inoti_mutex;
+extern pthread_rwlock_t g_store_lock;
+static mtp_bool g_cmd_lock_shared = FALSE;	/* Mode g_store_lock is held in */
 extern mtp_config_t g_conf;
 extern mtp_char g_copy_src_file[MTP_MAX_PATHNAME_SIZE + 1];
 extern mtp_char g_copy_dst_file[MTP_MAX_PATHNAME_SIZE + 1];
@@ -59,6 +60,7 @@ mtp_bool g_is_send_object = FALSE;
 
 
 static void __get_object_prop_desc(mtp_handler_t *hdlr);
+static void __get_object_prop_list(mtp_handler_t *hdlr);
 
 /*
  * FUNCTIONS
@@ -105,10 +107,9 @@ static void __get_object_prop_desc(mtp_handler_t *hdlr)
 {
 	mtp_uint32 prop_id = 0;
 	mtp_uint32 fmt = 0;
-	obj_prop_desc_t prop = { { 0 }, };
 	data_blk_t blk = { 0, };
-	mtp_uint32 num_bytes = 0;
-	mtp_uchar *ptr = NULL;
+	mtp_uint32 blk_len = 0;
+	mtp_uchar *prebuilt = NULL;
 
 	if (_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2)) {
 		_cmd_hdlr_send_response_code(hdlr,
@@ -119,31 +120,182 @@ static void __get_object_prop_desc(mtp_handler_t *hdlr)
 	prop_id = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 0);
 	fmt = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1);
 
-	if (MTP_ERROR_NONE != _hutil_get_prop_desc(fmt, prop_id, &prop)) {
+	if (!_prop_get_packed_obj_prop_desc(fmt, prop_id, &prebuilt,
+				&blk_len)) {
 		_cmd_hdlr_send_response_code(hdlr,
 				PTP_RESPONSE_PROP_NOTSUPPORTED);
 		return;
 	}
 
+	/* The description was packed once, blk does not own it */
 	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
-	num_bytes = _prop_size_obj_prop_desc(&prop);
-	ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
+	_hdlr_set_prebuilt_data_container(&blk, prebuilt, blk_len);
 
-	if (num_bytes == _prop_pack_obj_prop_desc(&prop, ptr, num_bytes)) {
-		_device_set_phase(DEVICE_PHASE_DATAIN);
-		if (_hdlr_send_data_container(&blk)) {
-			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
-		} else {
-			/* Host Cancelled data-in transfer */
-			_device_set_phase(DEVICE_PHASE_NOTREADY);
-		}
+	_device_set_phase(DEVICE_PHASE_DATAIN);
+	if (_hdlr_send_data_container(&blk)) {
+		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
 	} else {
-		_cmd_hdlr_send_response_code(hdlr,
-				PTP_RESPONSE_GEN_ERROR);
+		/* Host Cancelled data-in transfer */
+		_device_set_phase(DEVICE_PHASE_NOTREADY);
 	}
+}
 
-	g_free(blk.data);
-	return;
+/* Data phase of GetObjectPropList, sent one packet at a time */
+typedef struct {
+	data_blk_t blk;
+	mtp_uint32 used;	/* Bytes of blk.data waiting to be sent */
+} prop_list_stream_t;
+
+static mtp_bool __flush_prop_list_stream(prop_list_stream_t *stream)
+{
+	if (stream->used == 0)
+		return TRUE;
+
+	if (PTP_EVENTCODE_CANCELTRANSACTION == _transport_get_control_event() ||
+			FALSE == _hdlr_send_bulk_data(stream->blk.data,
+				stream->used)) {
+		ERR("ObjectPropList packet send Fail\n");
+		return FALSE;
+	}
+
+	stream->used = 0;
+	return TRUE;
+}
+
+static mtp_bool __write_prop_list_stream(void *data, mtp_uchar *buf,
+		mtp_uint32 size)
+{
+	prop_list_stream_t *stream = (prop_list_stream_t *)data;
+	mtp_uint32 len = 0;
+
+	while (size > 0) {
+		len = MIN(size, stream->blk.len - stream->used);
+		memcpy(stream->blk.data + stream->used, buf, len);
+		stream->used += len;
+		buf += len;
+		size -= len;
+
+		if (stream->used == stream->blk.len &&
+				!__flush_prop_list_stream(stream))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * The list is sized in a first walk over the objects and then packed
+ * quadruple by quadruple into a buffer of one transfer, which is sent
+ * whenever it fills up.
+ */
+static void __get_object_prop_list(mtp_handler_t *hdlr)
+{
+	mtp_uint32 obj_handle = 0;
+	mtp_uint32 fmt = 0;
+	mtp_uint32 prop_code = 0;
+	mtp_uint32 group_code = 0;
+	mtp_uint32 depth = 0;
+	GPtrArray *objs = NULL;
+	prop_list_stream_t stream = { { 0 }, 0 };
+	mtp_uint32 num_quads = 0;
+	mtp_uint64 num_bytes = sizeof(mtp_uint32);
+	mtp_uint64 total_len = 0;
+	mtp_uint32 packet_len = 0;
+	mtp_uint16 resp = PTP_RESPONSE_OK;
+	mtp_uint32 ii = 0;
+
+	obj_handle = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 0);
+	fmt = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1);
+	prop_code = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2);
+	group_code = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 3);
+	depth = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 4);
+
+	DBG("handle[0x%x] format[0x%x] prop[0x%x] group[0x%x] depth[%u]\n",
+			obj_handle, fmt, prop_code, group_code, depth);
+
+	objs = g_ptr_array_new();
+	switch (_hutil_get_object_prop_list(obj_handle, fmt, prop_code,
+				group_code, depth, objs)) {
+	case MTP_ERROR_INVALID_OBJECTHANDLE:
+		resp = PTP_RESPONSE_INVALID_OBJ_HANDLE;
+		break;
+	case MTP_ERROR_INVALID_OBJ_PROP_CODE:
+		resp = MTP_RESPONSE_INVALIDOBJPROPCODE;
+		break;
+	case MTP_ERROR_INVALID_PARAM:
+		resp = MTP_RESPONSE_INVALIDOBJGROUPCODE;
+		break;
+	case MTP_ERROR_NO_SPEC_BY_FORMAT:
+		resp = PTP_RESPONSE_NOSPECIFICATIONBYFORMAT;
+		break;
+	case MTP_ERROR_NONE:
+		resp = PTP_RESPONSE_OK;
+		break;
+	default:
+		resp = PTP_RESPONSE_GEN_ERROR;
+	}
+
+	if (resp != PTP_RESPONSE_OK) {
+		g_ptr_array_free(objs, TRUE);
+		_cmd_hdlr_send_response_code(hdlr, resp);
+		return;
+	}
+
+	for (ii = 0; ii < objs->len; ii++) {
+		num_quads += _prop_size_obj_proplist(g_ptr_array_index(objs, ii),
+				prop_code, group_code, &num_bytes);
+	}
+	DBG("[%u] objects, [%u] quadruples, [%llu] bytes\n", objs->len,
+			num_quads, (unsigned long long)num_bytes);
+
+	total_len = num_bytes + sizeof(header_container_t);
+	packet_len = total_len < g_conf.read_file_size ? num_bytes :
+		(g_conf.read_file_size - sizeof(header_container_t));
+
+	_hdlr_init_data_container(&stream.blk, hdlr->usb_cmd.code,
+			hdlr->usb_cmd.tid);
+	if (NULL == _hdlr_alloc_buf_data_container(&stream.blk, packet_len,
+				num_bytes)) {
+		ERR("_hdlr_alloc_buf_data_container() Fail\n");
+		g_ptr_array_free(objs, TRUE);
+		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
+		return;
+	}
+	stream.used = sizeof(header_container_t);
+
+	_device_set_phase(DEVICE_PHASE_DATAIN);
+#ifdef __BIG_ENDIAN__
+	_util_conv_byte_order(&num_quads, sizeof(num_quads));
+#endif /* __BIG_ENDIAN__ */
+	if (!__write_prop_list_stream(&stream, (mtp_uchar *)&num_quads,
+				sizeof(num_quads)))
+		goto Incomplete;
+
+	for (ii = 0; ii < objs->len; ii++) {
+		if (!_prop_write_obj_proplist(g_ptr_array_index(objs, ii),
+					prop_code, group_code,
+					__write_prop_list_stream, &stream))
+			goto Incomplete;
+	}
+
+	if (!__flush_prop_list_stream(&stream))
+		goto Incomplete;
+
+#ifdef MTP_SEND_ZLP_FROM_GET_OBJECT
+	if (total_len % ((mtp_uint64)_transport_get_usb_packet_len()) == 0)
+		_transport_send_zlp();
+#endif
+	goto Done;
+
+Incomplete:
+	/* Host cancelled the data-in transfer or it failed midway */
+	_device_set_phase(DEVICE_PHASE_NOTREADY);
+	resp = PTP_RESPONSE_INCOMPLETETRANSFER;
+
+Done:
+	g_ptr_array_free(objs, TRUE);
+	g_free(stream.blk.data);
+	_cmd_hdlr_send_response_code(hdlr, resp);
 }
 
 static void __get_device_info(mtp_handler_t *hdlr)
@@ -171,28 +323,27 @@ static void __get_device_info(mtp_handler_t *hdlr)
 		return;
 	}
 
-	/*Build the data block for device info.*/
+	/* The device info was packed at init time, blk does not own it */
 	data_blk_t blk = { 0 };
-	mtp_uint32 num_bytes = 0;
-	mtp_uchar *buf_ptr = NULL;
+	mtp_uint32 blk_len = 0;
+	mtp_uchar *prebuilt = NULL;
 
-	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
-	num_bytes = _get_device_info_size();
-	buf_ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
-	if (num_bytes == _pack_device_info(buf_ptr, num_bytes)) {
-		_device_set_phase(DEVICE_PHASE_DATAIN);
-		if (_hdlr_send_data_container(&blk)) {
-			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
-		} else {
-			/* Host Cancelled data-in transfer */
-			_device_set_phase(DEVICE_PHASE_NOTREADY);
-			DBG("Device phase is set to DEVICE_PHASE_NOTREADY\n");
-		}
-	} else {
+	if (!_get_packed_device_info(&prebuilt, &blk_len)) {
 		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
+		return;
 	}
 
-	g_free(blk.data);
+	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
+	_hdlr_set_prebuilt_data_container(&blk, prebuilt, blk_len);
+
+	_device_set_phase(DEVICE_PHASE_DATAIN);
+	if (_hdlr_send_data_container(&blk)) {
+		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
+	} else {
+		/* Host Cancelled data-in transfer */
+		_device_set_phase(DEVICE_PHASE_NOTREADY);
+		DBG("Device phase is set to DEVICE_PHASE_NOTREADY\n");
+	}
 }
 
 static void __get_storage_ids(mtp_handler_t *hdlr)
@@ -292,16 +443,40 @@ static void __get_object_handles(mtp_handler_t *hdlr)
 	data_blk_t blk = { 0 };
 	mtp_uint32 num_bytes = 0;
 	mtp_uchar *ptr = NULL;
+	mtp_uchar *cached = NULL;
 	mtp_uint16 resp = 0;
 
-	_prop_init_ptparray(&handle_arr, UINT32_TYPE);
-
 	store_id = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 0);
 	fmt = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1);
 	h_parent = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2);
 
 	DBG("store_id = [0x%x], Format Code = [0x%x], parent handle = [0x%x]\n",
 			store_id, fmt, h_parent);
+
+	if (_hutil_get_cached_object_handles(store_id, fmt, h_parent,
+				&cached, &num_bytes)) {
+		_hdlr_init_data_container(&blk, hdlr->usb_cmd.code,
+				hdlr->usb_cmd.tid);
+		ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
+		if (NULL == ptr) {
+			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
+			return;
+		}
+
+		memcpy(ptr, cached, num_bytes);
+		_device_set_phase(DEVICE_PHASE_DATAIN);
+		if (_hdlr_send_data_container(&blk)) {
+			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
+		} else {
+			/*Host Cancelled data-in transfer.*/
+			_device_set_phase(DEVICE_PHASE_NOTREADY);
+			DBG("DEVICE_PHASE_NOTREADY!!\n");
+		}
+		g_free(blk.data);
+		return;
+	}
+
+	_prop_init_ptparray(&handle_arr, UINT32_TYPE);
 	switch (_hutil_get_object_handles(store_id, fmt, h_parent,
 				&handle_arr)) {
 	case MTP_ERROR_INVALID_STORE:
@@ -335,6 +510,7 @@ static void __get_object_handles(mtp_handler_t *hdlr)
 	if (NULL != ptr) {
 		_prop_pack_ptparray(&handle_arr, ptr, num_bytes);
 		_prop_deinit_ptparray(&handle_arr);
+		_hutil_cache_object_handles(store_id, fmt, h_parent, ptr, num_bytes);
 		_device_set_phase(DEVICE_PHASE_DATAIN);
 		if (_hdlr_send_data_container(&blk)) {
 			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
@@ -357,10 +533,8 @@ static void __get_object_info(mtp_handler_t *hdlr)
 	data_blk_t blk = { 0 };
 	mtp_uint32 num_bytes = 0;
 	mtp_uchar *ptr = NULL;
+	mtp_uchar *info = NULL;
 	mtp_obj_t *obj = NULL;
-	mtp_char f_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
-	mtp_wchar wf_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
-	ptp_string_t ptp_string = { 0 };
 
 	if (_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1) ||
 			_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2)) {
@@ -376,16 +550,15 @@ static void __get_object_info(mtp_handler_t *hdlr)
 		return;
 	}
 
-	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
-
-	_util_get_file_name(obj->file_path, f_name);
-	_util_utf8_to_utf16(wf_name, sizeof(wf_name) / WCHAR_SIZ, f_name);
-	_prop_copy_char_to_ptpstring(&ptp_string, wf_name, WCHAR_TYPE);
+	if (!_entity_get_packed_obj_info(obj, &info, &num_bytes)) {
+		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
+		return;
+	}
 
-	num_bytes = _entity_get_object_info_size(obj, &ptp_string);
+	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
 	ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
-	if (num_bytes == _entity_pack_obj_info(obj, &ptp_string, ptr,
-				num_bytes)) {
+	if (ptr != NULL) {
+		memcpy(ptr, info, num_bytes);
 		_device_set_phase(DEVICE_PHASE_DATAIN);
 		if (_hdlr_send_data_container(&blk)) {
 			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_OK);
@@ -398,6 +571,7 @@ static void __get_object_info(mtp_handler_t *hdlr)
 		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
 	}
 
+	g_free(info);
 	g_free(blk.data);
 }
 
@@ -442,7 +616,7 @@ static void __get_object(mtp_handler_t *hdlr)
 	}
 #endif /* MTP_SUPPORT_SET_PROTECTION */
 
-	path = obj->file_path;
+	path = g_strdup(obj->file_path);
 	num_bytes = obj->obj_info->file_size;
 	total_len = num_bytes + sizeof(header_container_t);
 	packet_len = total_len < g_conf.read_file_size ? num_bytes :
@@ -454,6 +628,7 @@ static void __get_object(mtp_handler_t *hdlr)
 		ERR("_hdlr_alloc_buf_data_container() Fail\n");
 		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
 		g_free(blk.data);
+		g_free(path);
 		return;
 	}
 
@@ -466,13 +641,21 @@ static void __get_object(mtp_handler_t *hdlr)
 			_cmd_hdlr_send_response_code(hdlr,
 					PTP_RESPONSE_ACCESSDENIED);
 			g_free(blk.data);
+			g_free(path);
 			return;
 		}
 		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
 		g_free(blk.data);
+		g_free(path);
 		return;
 	}
 
+	/*
+	 * Nothing below looks at the store, so let inotify and the other
+	 * threads in while the file is streamed to the host.
+	 */
+	UTIL_RW_UNLOCK(&g_store_lock);
+
 	_util_file_read(h_file, ptr, packet_len, &read_len);
 	if (0 == read_len) {
 		ERR("_util_file_read() Fail\n");
@@ -525,6 +708,13 @@ static void __get_object(mtp_handler_t *hdlr)
 Done:
 	_util_file_close(h_file);
 
+	if (g_cmd_lock_shared) {
+		UTIL_READ_LOCK(&g_store_lock);
+	} else {
+		UTIL_WRITE_LOCK(&g_store_lock);
+	}
+
+	g_free(path);
 	g_free(blk.data);
 	_cmd_hdlr_send_response_code(hdlr, resp);
 }
@@ -722,10 +912,134 @@ static void __send_object_info(mtp_handler_t *hdlr)
 	}
 }
 
+/*
+ * SendObjectPropList announces the object like SendObjectInfo does, but
+ * with its size in two parameters, so objects of 4GB and more get their
+ * real size, and with only the properties the host cares about.
+ */
+static void __send_object_prop_list(mtp_handler_t *hdlr)
+{
+	mtp_uint16 resp = PTP_RESPONSE_UNDEFINED;
+	mtp_uint32 store_id = 0;
+	mtp_uint32 h_parent = 0;
+	mtp_uint16 format = 0;
+	mtp_uint64 obj_sz = 0;
+	data_blk_t blk = { 0 };
+	mtp_uint32 resp_param[4] = { 0 };
+	mtp_uint32 err_idx = 0;
+	mtp_obj_t *obj = NULL;
+	mtp_err_t ret = 0;
+	obj_data_t obdata = { 0 };
+
+	store_id = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 0);
+	h_parent = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1);
+	format = _hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2);
+	obj_sz = ((mtp_uint64)_hdlr_get_param_cmd_container(&(hdlr->usb_cmd),
+				3) << 32) |
+		_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 4);
+
+	DBG("store_id[0x%x] parent[0x%x] format[0x%x] size[%llu]\n",
+			store_id, h_parent, format, obj_sz);
+
+	_device_set_phase(DEVICE_PHASE_DATAOUT);
+	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
+	if (_hdlr_rcv_data_container(&blk,
+				MAX_SIZE_IN_BYTES_OF_PROP_LIST) == FALSE) {
+		_device_set_phase(DEVICE_PHASE_NOTREADY);
+	} else {
+		if (TRUE == hdlr->data4_send_obj.is_valid) {
+			obdata.store_id = hdlr->data4_send_obj.store_id;
+			obdata.obj_size = hdlr->data4_send_obj.file_size;
+			obdata.obj = hdlr->data4_send_obj.obj;
+			hdlr->data4_send_obj.obj = NULL;
+		}
+		ret = _hutil_construct_object_entry_prop_list(store_id,
+				h_parent, format, obj_sz,
+				((hdlr->data4_send_obj.is_valid == TRUE) ? (&obdata)
+				 : (NULL)), &obj, _hdlr_get_payload_data(&blk),
+				_hdlr_get_payload_size(&blk), &err_idx);
+		hdlr->data4_send_obj.is_valid = FALSE;
+		switch (ret) {
+		case MTP_ERROR_NONE:
+			hdlr->data4_send_obj.obj_handle = obj->obj_handle;
+			hdlr->data4_send_obj.h_parent = obj->obj_info->h_parent;
+			hdlr->data4_send_obj.store_id = obj->obj_info->store_id;
+			if (obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION) {
+				hdlr->data4_send_obj.obj = NULL;
+			} else {
+				hdlr->data4_send_obj.is_valid = TRUE;
+				hdlr->data4_send_obj.obj = obj;
+				hdlr->data4_send_obj.file_size =
+					obj->obj_info->file_size;
+			}
+			resp = PTP_RESPONSE_OK;
+			break;
+		case MTP_ERROR_STORE_NOT_AVAILABLE:
+			resp = PTP_RESPONSE_STORENOTAVAILABLE;
+			break;
+		case MTP_ERROR_INVALID_PARAM:
+			resp = PTP_RESPONSE_PARAM_NOTSUPPORTED;
+			break;
+		case MTP_ERROR_INVALID_STORE:
+			resp = PTP_RESPONSE_INVALID_STORE_ID;
+			break;
+		case MTP_ERROR_STORE_READ_ONLY:
+			resp = PTP_RESPONSE_STORE_READONLY;
+			break;
+		case MTP_ERROR_STORE_FULL:
+			resp = PTP_RESPONSE_STOREFULL;
+			break;
+		case MTP_ERROR_INVALID_DATASET:
+			resp = MTP_RESPONSECODE_INVALIDDATASET;
+			resp_param[3] = err_idx;
+			break;
+		case MTP_ERROR_INVALID_OBJ_PROP_CODE:
+			resp = MTP_RESPONSE_INVALIDOBJPROPCODE;
+			resp_param[3] = err_idx;
+			break;
+		case MTP_ERROR_INVALID_OBJECT_PROP_FORMAT:
+			resp = MTP_RESPONSE_INVALIDOBJPROPFORMAT;
+			resp_param[3] = err_idx;
+			break;
+		case MTP_ERROR_INVALID_OBJECTHANDLE:
+			resp = PTP_RESPONSE_INVALID_OBJ_HANDLE;
+			break;
+		case MTP_ERROR_INVALID_PARENT:
+			resp = PTP_RESPONSE_INVALIDPARENT;
+			break;
+		case MTP_ERROR_ACCESS_DENIED:
+			resp = PTP_RESPONSE_ACCESSDENIED;
+			break;
+		default:
+			resp = PTP_RESPONSE_GEN_ERROR;
+			break;
+		}
+		DBG("SendObjectPropList response[0x%x]\n", resp);
+	}
+
+	g_free(blk.data);
+	if (g_device->phase == DEVICE_PHASE_NOTREADY)
+		return;
+
+	if (resp != PTP_RESPONSE_OK) {
+		/* The last parameter is the index of the failed property */
+		_cmd_hdlr_send_response(hdlr, resp, 4, resp_param);
+		return;
+	}
+
+	hdlr->last_fmt_code = obj->obj_info->obj_fmt;
+	resp_param[0] = hdlr->data4_send_obj.store_id;
+	resp_param[1] = (hdlr->data4_send_obj.h_parent != PTP_OBJECTHANDLE_ROOT) ?
+		hdlr->data4_send_obj.h_parent : 0xFFFFFFFF;
+	resp_param[2] = hdlr->data4_send_obj.obj_handle;
+	_cmd_hdlr_send_response(hdlr, resp, 3, resp_param);
+}
+
 static void __send_object(mtp_handler_t *hdlr)
 {
 	data_blk_t blk = { 0 };
 	mtp_uint16 resp = PTP_RESPONSE_OK;
+	mtp_err_t ret = MTP_ERROR_NONE;
 	mtp_char temp_fpath[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 
 	if (_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 0) ||
@@ -751,8 +1065,18 @@ static void __send_object(mtp_handler_t *hdlr)
 		return;
 	}
 
-	switch (_hutil_write_file_data(hdlr->data4_send_obj.store_id,
-				hdlr->data4_send_obj.obj, temp_fpath)) {
+	ret = _hutil_write_file_data(hdlr->data4_send_obj.store_id,
+			hdlr->data4_send_obj.obj, temp_fpath);
+
+	/* The reservation is used by the file, or given back */
+	if (hdlr->data4_send_obj.is_valid) {
+		_entity_release_store_space(
+				_device_get_store(hdlr->data4_send_obj.store_id),
+				hdlr->data4_send_obj.file_size,
+				ret == MTP_ERROR_NONE);
+	}
+
+	switch (ret) {
 
 	case MTP_ERROR_INVALID_OBJECT_INFO:
 		resp = PTP_RESPONSE_NOVALID_OBJINFO;
@@ -1034,6 +1358,7 @@ static void __get_interdep_prop_desc(mtp_handler_t *hdlr)
 	data_blk_t blk = { 0 };
 	mtp_uint32 num_bytes = 0;
 	mtp_uchar *ptr = NULL;
+	mtp_uchar *prebuilt = NULL;
 
 	if (_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 1) ||
 			_hdlr_get_param_cmd_container(&(hdlr->usb_cmd), 2)) {
@@ -1051,15 +1376,20 @@ static void __get_interdep_prop_desc(mtp_handler_t *hdlr)
 	}
 
 	_hdlr_init_data_container(&blk, hdlr->usb_cmd.code, hdlr->usb_cmd.tid);
-	_hutil_get_interdep_prop_config_list_size(&num_bytes, fmt);
-	ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
+	if (_prop_get_packed_interdep_proplist(&prebuilt, &num_bytes)) {
+		/* Same for every format and packed once, blk does not own it */
+		_hdlr_set_prebuilt_data_container(&blk, prebuilt, num_bytes);
+	} else {
+		_hutil_get_interdep_prop_config_list_size(&num_bytes, fmt);
+		ptr = _hdlr_alloc_buf_data_container(&blk, num_bytes, num_bytes);
 
-	if (MTP_ERROR_NONE != _hutil_get_interdep_prop_config_list_data(ptr,
-				num_bytes, fmt)) {
-		ERR("_hutil_get_interdep_prop_config_list_data() Fail\n");
-		_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
-		g_free(blk.data);
-		return;
+		if (MTP_ERROR_NONE != _hutil_get_interdep_prop_config_list_data(ptr,
+					num_bytes, fmt)) {
+			ERR("_hutil_get_interdep_prop_config_list_data() Fail\n");
+			_cmd_hdlr_send_response_code(hdlr, PTP_RESPONSE_GEN_ERROR);
+			g_free(blk.data);
+			return;
+		}
 	}
 
 	_device_set_phase(DEVICE_PHASE_DATAIN);
@@ -1070,7 +1400,8 @@ static void __get_interdep_prop_desc(mtp_handler_t *hdlr)
 		_device_set_phase(DEVICE_PHASE_NOTREADY);
 	}
 
-	g_free(blk.data);
+	if (blk.data != prebuilt)
+		g_free(blk.data);
 }
 
 void __close_session(mtp_handler_t *hdlr)
@@ -1167,6 +1498,12 @@ static void __print_command(mtp_uint16 code)
 	case MTP_OPCODE_GETOBJECTPROPDESC:
 		DBG("COMMAND ======== GET OBJECT PROP DESC ==========");
 		break;
+	case MTP_OPCODE_GETOBJECTPROPLIST:
+		DBG("COMMAND ======== GET OBJECT PROP LIST ==========\n");
+		break;
+	case MTP_OPCODE_SENDOBJECTPROPLIST:
+		DBG("COMMAND ======== SEND OBJECT PROP LIST ==========\n");
+		break;
 	default:
 		DBG("======== UNKNOWN COMMAND ==========\n");
 		break;
@@ -1247,6 +1584,9 @@ static void __process_commands(mtp_handler_t *hdlr, cmd_blk_t *cmd)
 	case MTP_OPCODE_GETOBJECTPROPDESC:
 		__get_object_prop_desc(hdlr);
 		break;
+	case MTP_OPCODE_GETOBJECTPROPLIST:
+		__get_object_prop_list(hdlr);
+		break;
 #ifdef MTP_SUPPORT_SET_PROTECTION
 	case PTP_OPCODE_SETOBJECTPROTECTION:
 		__set_object_protection(hdlr);
@@ -1263,6 +1603,7 @@ static void __process_commands(mtp_handler_t *hdlr, cmd_blk_t *cmd)
 		break;
 
 	case PTP_OPCODE_SENDOBJECTINFO:
+	case MTP_OPCODE_SENDOBJECTPROPLIST:
 	case PTP_OPCODE_SENDOBJECT:
 	case MTP_OPCODE_SETOBJECTPROPVALUE:
 		/* DATA_HANDLE_PHASE: Send operation will be blocked
@@ -1295,6 +1636,9 @@ static void __process_commands(mtp_handler_t *hdlr, cmd_blk_t *cmd)
 		case PTP_OPCODE_SENDOBJECTINFO:
 			__send_object_info(hdlr);
 			break;
+		case MTP_OPCODE_SENDOBJECTPROPLIST:
+			__send_object_prop_list(hdlr);
+			break;
 		case PTP_OPCODE_SENDOBJECT:
 			__send_object(hdlr);
 			g_is_send_object = FALSE;
@@ -1334,7 +1678,8 @@ static void __process_commands(mtp_handler_t *hdlr, cmd_blk_t *cmd)
 		break;
 	}
 DONE:
-	if ((hdlr->last_opcode == PTP_OPCODE_SENDOBJECTINFO) &&
+	if ((hdlr->last_opcode == PTP_OPCODE_SENDOBJECTINFO ||
+			hdlr->last_opcode == MTP_OPCODE_SENDOBJECTPROPLIST) &&
 			((hdlr->last_fmt_code != PTP_FMT_ASSOCIATION) &&
 			 (hdlr->last_fmt_code != PTP_FMT_UNDEF))) {
 		DBG("Processed, last_opcode[0x%x], last_fmt_code[%d]\n",
@@ -1346,11 +1691,9 @@ DONE:
 
 			DBG("Processed, COMMAND[0x%x]!!\n", hdlr->usb_cmd.code);
 			store = _device_get_store(hdlr->data4_send_obj.store_id);
-			if (store != NULL) {
-				/*Restore reserved space*/
-				store->store_info.free_space +=
-					hdlr->data4_send_obj.file_size;
-			}
+			/*Restore reserved space*/
+			_entity_release_store_space(store,
+					hdlr->data4_send_obj.file_size, FALSE);
 
 			if (hdlr->data4_send_obj.obj) {
 				_entity_dealloc_mtp_obj(hdlr->data4_send_obj.obj);
@@ -1363,6 +1706,47 @@ DONE:
 	hdlr->last_opcode = hdlr->usb_cmd.code;	/* Last operation code*/
 }
 
+/*
+ * Commands that only look objects up share the store lock with each
+ * other; anything else, and the command following SendObjectInfo or
+ * SendObjectPropList whose cleanup may drop the pending object, holds
+ * it exclusively.
+ */
+static mtp_bool __is_lookup_command(mtp_handler_t *hdlr, mtp_uint16 code)
+{
+	if (hdlr->last_opcode == PTP_OPCODE_SENDOBJECTINFO ||
+			hdlr->last_opcode == MTP_OPCODE_SENDOBJECTPROPLIST)
+		return FALSE;
+
+	switch (code) {
+	case PTP_OPCODE_GETDEVICEINFO:
+	case PTP_OPCODE_GETSTORAGEIDS:
+	case PTP_OPCODE_GETOBJECTINFO:
+	case PTP_OPCODE_GETOBJECT:
+	case PTP_OPCODE_GETPARTIALOBJECT:
+	case PTP_OC_ANDROID_GETPARTIALOBJECT:
+	case MTP_OPCODE_GETOBJECTPROPDESC:
+	case MTP_OPCODE_GETINTERDEPPROPDESC:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void __process_commands_locked(mtp_handler_t *hdlr, cmd_blk_t *cmd)
+{
+	g_cmd_lock_shared = __is_lookup_command(hdlr, cmd->code);
+	if (g_cmd_lock_shared) {
+		UTIL_READ_LOCK(&g_store_lock);
+	} else {
+		UTIL_WRITE_LOCK(&g_store_lock);
+	}
+
+	__process_commands(hdlr, cmd);
+
+	UTIL_RW_UNLOCK(&g_store_lock);
+}
+
 mtp_bool _cmd_hdlr_send_response(mtp_handler_t *hdlr, mtp_uint16 resp,
 		mtp_uint32 num_param, mtp_uint32 *params)
 {
@@ -1424,9 +1808,7 @@ static void __finish_receiving_file_packets(mtp_char *data, mtp_int32 data_len)
 	_hdlr_conv_cmd_container_byte_order(&cmd);
 #endif /* __BIG_ENDIAN__ */
 
-	UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
-	__process_commands(&g_mtp_mgr.hdlr, &cmd);
-	UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+	__process_commands_locked(&g_mtp_mgr.hdlr, &cmd);
 
 	DBG("MTP device phase[%d], processing Command is complete\n",
 			g_device->phase);
@@ -1490,8 +1872,15 @@ static mtp_bool __receive_temp_file_first_packet(mtp_char *data,
 	/* consider header size */
 	memcpy(&g_mtp_mgr.ftemp_st.header_buf, data, sizeof(header_container_t));
 
-	g_mtp_mgr.ftemp_st.file_size = ((header_container_t *)data)->len -
-		sizeof(header_container_t);
+	/* Objects of 4GB and more only give their size in the operation */
+	if (((header_container_t *)data)->len == 0xFFFFFFFF &&
+			g_mtp_mgr.hdlr.data4_send_obj.is_valid) {
+		g_mtp_mgr.ftemp_st.file_size =
+			g_mtp_mgr.hdlr.data4_send_obj.file_size;
+	} else {
+		g_mtp_mgr.ftemp_st.file_size = ((header_container_t *)data)->len -
+			sizeof(header_container_t);
+	}
 	*data_sz = data_len - sizeof(header_container_t);
 
 	/* check whether last data packet */
@@ -1664,9 +2053,7 @@ void _receive_mq_data_cb(mtp_char *buffer, mtp_int32 buf_len)
 		_hdlr_conv_cmd_container_byte_order(&cmd);
 #endif /* __BIG_ENDIAN__ */
 
-		UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
-		__process_commands(&g_mtp_mgr.hdlr, &cmd);
-		UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+		__process_commands_locked(&g_mtp_mgr.hdlr, &cmd);
 	} else if (g_device->phase == DEVICE_PHASE_DATAOUT) {
 		if (g_mtp_mgr.ftemp_st.data_count == 0)
 			__receive_temp_file_first_packet(buffer, buf_len);
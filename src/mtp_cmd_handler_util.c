@@ -61,9 +61,7 @@ mtp_err_t _hutil_get_storage_entry(mtp_uint32 store_id, store_info_t *info)
 	retvm_if(!store, MTP_ERROR_GENERAL, "Not able to retrieve store\n");
 
 	/* LCOV_EXCL_START */
-	_entity_update_store_info_run_time(&(store->store_info),
-			store->root_path);
-
+	/* Cached, kept up to date by _device_refresh_store_space() */
 	_prop_copy_ptpstring(&(info->store_desc), &(store->store_info.store_desc));
 	_prop_copy_ptpstring(&(info->vol_label), &(store->store_info.vol_label));
 	info->access = store->store_info.access;
@@ -80,9 +78,17 @@ mtp_err_t _hutil_get_storage_ids(ptp_array_t *store_ids)
 {
 	mtp_uint32 num_elem = 0;
 	mtp_uint32 num_stores = 0;
+	mtp_store_t *store = NULL;
+	mtp_uint32 ii = 0;
 
 	num_elem = _device_get_store_ids(store_ids);
-	num_stores = g_device->num_stores;
+
+	/* Stores still loading are not listed yet */
+	for (ii = 0; ii < g_device->num_stores; ii++) {
+		store = _device_get_store_at_index(ii);
+		if (store && !store->is_hidden)
+			num_stores++;
+	}
 	if (num_elem == num_stores)
 		return MTP_ERROR_NONE;
 
@@ -158,6 +164,7 @@ mtp_err_t _hutil_add_object_entry(obj_info_t *obj_info, mtp_char *file_name,
 
 	memset(obj, 0, sizeof(mtp_obj_t));
 	obj->child_array.type = UINT32_TYPE;
+	obj->children.type = UINT32_TYPE;
 	obj->obj_handle = g_next_obj_handle++;
 	obj->obj_info = obj_info;
 
@@ -310,6 +317,7 @@ mtp_err_t _hutil_add_object_entry(obj_info_t *obj_info, mtp_char *file_name,
 		}
 
 		_entity_set_object_file_path(obj, new_f_path, CHAR_TYPE);
+		_entity_refresh_object_identity(obj);
 		if (_entity_add_object_to_store(store, obj) == FALSE) {
 			ERR("_entity_add_object_to_store Fail\n");
 			_entity_dealloc_mtp_obj(obj);
@@ -320,7 +328,7 @@ mtp_err_t _hutil_add_object_entry(obj_info_t *obj_info, mtp_char *file_name,
 		/* Reserve space for the object: Object itself, and probably
 		 * some Filesystem-specific overhead
 		 */
-		store->store_info.free_space -= obj_info->file_size;
+		_entity_reserve_store_space(store, obj_info->file_size);
 	}
 
 	*new_obj = obj;
@@ -463,6 +471,7 @@ mtp_err_t _hutil_copy_object_entries(mtp_uint32 dst_store_id,
 
 	memset(new_obj, 0, sizeof(mtp_obj_t));
 	new_obj->child_array.type = UINT32_TYPE;
+	new_obj->children.type = UINT32_TYPE;
 
 	_entity_copy_mtp_object(new_obj, obj);
 	if (new_obj->obj_info == NULL) {
@@ -511,7 +520,9 @@ mtp_err_t _hutil_copy_object_entries(mtp_uint32 dst_store_id,
 #endif /* MTP_SUPPORT_SET_PROTECTION */
 
 		/* Update the storeinfo after successfully copy of the object */
-		dst->store_info.free_space -= obj->obj_info->file_size;
+		_entity_update_store_free_space(dst,
+				-(mtp_int64)obj->obj_info->file_size);
+		_entity_refresh_object_identity(new_obj);
 
 		/* move case */
 		if (keep_handle) {
@@ -551,6 +562,7 @@ mtp_err_t _hutil_copy_object_entries(mtp_uint32 dst_store_id,
 			}
 
 			/* Add the new object to this store's object list */
+			_entity_refresh_object_identity(new_obj);
 			_entity_add_object_to_store(dst, new_obj);
 		} else {
 			DBG("Already existed association type!!\n");
@@ -572,6 +584,7 @@ mtp_err_t _hutil_copy_object_entries(mtp_uint32 dst_store_id,
 		}
 
 		/* Add the new object to this store's object list */
+		_entity_refresh_object_identity(new_obj);
 		_entity_add_object_to_store(dst, new_obj);
 	}
 
@@ -755,6 +768,7 @@ mtp_err_t _hutil_write_file_data(mtp_uint32 store_id, mtp_obj_t *obj,
 	}
 #endif /*MTP_USE_RUNTIME_GETOBJECTPROPVALUE*/
 
+	_entity_refresh_object_identity(obj);
 	_entity_add_object_to_store(store, obj);
 	/* LCOV_EXCL_STOP */
 	return MTP_ERROR_NONE;
@@ -789,6 +803,7 @@ mtp_err_t _hutil_set_protection(mtp_uint32 obj_handle, mtp_uint16 prot_status)
 
 	g_strlcpy(fname, obj->file_path, MTP_MAX_PATHNAME_SIZE + 1);
 	obj->obj_info->protcn_status = prot_status;
+	_entity_invalidate_obj_info(obj);
 
 	retvm_if(!_util_get_file_attrs(fname, &attrs), MTP_ERROR_GENERAL,
 		"Failed to get file[%s] attrs\n", fname);
@@ -808,19 +823,45 @@ mtp_err_t _hutil_set_protection(mtp_uint32 obj_handle, mtp_uint16 prot_status)
 }
 #endif /* MTP_SUPPORT_SET_PROTECTION */
 
+/*
+ * Makes sure the folders a GetObjectHandles request looks at have been
+ * scanned. Listing every object of a store needs the whole tree, listing
+ * a folder only needs that folder.
+ */
+static void __enum_objects_for_handles(mtp_store_t *store, mtp_uint32 h_parent)
+{
+	mtp_obj_t *obj = NULL;
+
+	ret_if(store == NULL);
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT) {
+		_entity_store_recursive_enum_folder_objects(store, NULL);
+		g_is_full_enum = TRUE;
+		return;
+	}
+
+	if (h_parent == PTP_OBJECTHANDLE_ALL) {
+		_entity_store_enum_folder_objects(store, NULL);
+		return;
+	}
+
+	obj = _entity_get_object_from_store(store, h_parent);
+	if (obj && obj->obj_info && obj->obj_info->obj_fmt == PTP_FMT_ASSOCIATION)
+		_entity_store_enum_folder_objects(store, obj);
+}
+
 mtp_err_t _hutil_get_object_handles(mtp_uint32 store_id, mtp_uint32 format,
 		mtp_uint32 h_parent, ptp_array_t *handle_arr)
 {
 	mtp_store_t *store = NULL;
 	mtp_int32 i = 0;
 
-	if (h_parent == PTP_OBJECTHANDLE_ALL || h_parent == PTP_OBJECTHANDLE_ROOT) {
-		for (i = 0; i < g_device->num_stores; i++) {
-			store = _device_get_store_at_index(i);
-			if (store && store->obj_list.nnodes == 0)
-				_entity_store_recursive_enum_folder_objects(store, NULL);
-		}
-		g_is_full_enum = TRUE;
+	if (store_id == PTP_STORAGEID_ALL) {
+		for (i = 0; i < g_device->num_stores; i++)
+			__enum_objects_for_handles(_device_get_store_at_index(i),
+					h_parent);
+	} else {
+		__enum_objects_for_handles(_device_get_store(store_id), h_parent);
 	}
 
 	if (store_id == PTP_STORAGEID_ALL && h_parent == PTP_OBJECTHANDLE_ROOT) {
@@ -863,42 +904,99 @@ mtp_err_t _hutil_get_object_handles(mtp_uint32 store_id, mtp_uint32 format,
 	/* LCOV_EXCL_STOP */
 }
 
+/*
+ * Maps a GetObjectHandles request onto the store and scope its result
+ * depends on, following the cases of _hutil_get_object_handles().
+ * Requests spanning every store are not cached.
+ */
+static mtp_store_t *__get_object_handles_scope(mtp_uint32 store_id,
+		mtp_uint32 h_parent, mtp_uint32 *scope)
+{
+	mtp_store_t *store = NULL;
+
+	retv_if(store_id == PTP_STORAGEID_ALL, NULL);
+
+	store = _device_get_store(store_id);
+	retv_if(store == NULL, NULL);
+
+	if (h_parent == PTP_OBJECTHANDLE_ROOT)
+		*scope = PTP_OBJECTHANDLE_ALL;
+	else if (h_parent == PTP_OBJECTHANDLE_ALL)
+		*scope = PTP_OBJECTHANDLE_ROOT;
+	else
+		*scope = h_parent;
+
+	return store;
+}
+
+mtp_bool _hutil_get_cached_object_handles(mtp_uint32 store_id,
+		mtp_uint32 format, mtp_uint32 h_parent, mtp_uchar **data,
+		mtp_uint32 *data_sz)
+{
+	mtp_uint32 scope = 0;
+	mtp_store_t *store = NULL;
+
+	store = __get_object_handles_scope(store_id, h_parent, &scope);
+	retv_if(store == NULL, FALSE);
+
+	return _entity_get_cached_handles(store, scope, format, data, data_sz);
+}
+
+void _hutil_cache_object_handles(mtp_uint32 store_id, mtp_uint32 format,
+		mtp_uint32 h_parent, mtp_uchar *data, mtp_uint32 data_sz)
+{
+	mtp_uint32 scope = 0;
+	mtp_store_t *store = NULL;
+
+	store = __get_object_handles_scope(store_id, h_parent, &scope);
+	ret_if(store == NULL);
+
+	_entity_cache_handles(store, scope, format, data, data_sz);
+}
+
+/*
+ * Applies the defaults of SendObjectInfo and SendObjectPropList to the
+ * destination given by the host.
+ */
+static mtp_err_t __resolve_send_target(mtp_uint32 *store_id,
+		mtp_uint32 *h_parent)
+{
+	if (*store_id) {
+		if (!*h_parent)
+			*h_parent = g_device->default_hparent;
+		else if (*h_parent == 0xFFFFFFFF)
+			*h_parent = PTP_OBJECTHANDLE_ROOT;
+		return MTP_ERROR_NONE;
+	}
+
+	*store_id = g_device->default_store_id;
+	retvm_if(!*store_id, MTP_ERROR_STORE_NOT_AVAILABLE, "_device_get_default_store_id Fail\n");
+
+	/* If the second parameter is used, the first must also be used. */
+	retv_if(*h_parent, MTP_ERROR_INVALID_PARAM);
+
+	*h_parent = g_device->default_hparent;
+	return MTP_ERROR_NONE;
+}
+
 mtp_err_t _hutil_construct_object_entry(mtp_uint32 store_id,
 		mtp_uint32 h_parent, obj_data_t *objdata, mtp_obj_t **obj, void *data,
 		mtp_uint32 data_sz)
 {
+	mtp_err_t resp = MTP_ERROR_NONE;
 	mtp_store_t *store = NULL;
 	mtp_obj_t *tobj = NULL;
 	obj_info_t *obj_info = NULL;
 	mtp_char file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
 
-	if (store_id) {
-		if (!h_parent)
-			h_parent = g_device->default_hparent;
-		else if (h_parent == 0xFFFFFFFF)
-			h_parent = PTP_OBJECTHANDLE_ROOT;
-	} else {
-		store_id = g_device->default_store_id;
-
-		retvm_if(!store_id, MTP_ERROR_STORE_NOT_AVAILABLE, "_device_get_default_store_id Fail\n");
-
-		if (h_parent) {
-			/* If the second parameter is used,
-			 * the first must also be used.
-			 */
-			return MTP_ERROR_INVALID_PARAM;
-		} else {
-			h_parent = g_device->default_hparent;
-		}
-	}
+	resp = __resolve_send_target(&store_id, &h_parent);
+	if (resp != MTP_ERROR_NONE)
+		return resp;
 
 	if (objdata != NULL) {
+		/* The previous object was never sent, give its space back */
 		store = _device_get_store(objdata->store_id);
-		if (store != NULL) {
-			DBG("check free size instead of re-calculation\n");
-			_entity_update_store_info_run_time(&(store->store_info),
-					(store->root_path));
-		}
+		_entity_release_store_space(store, objdata->obj_size, FALSE);
 
 		/* Delete and invalidate the old obj_info for send object */
 		if (objdata->obj != NULL)
@@ -952,6 +1050,32 @@ mtp_err_t _hutil_construct_object_entry(mtp_uint32 store_id,
 	return MTP_ERROR_NONE;
 }
 
+/* Size of a property value as packed by the host, 0 if it is cut short */
+static mtp_uint32 __size_raw_prop_value(prop_info_t *propinfo,
+		mtp_uchar *buf, mtp_int32 buf_sz)
+{
+	mtp_uint32 num_ele = 0;
+	mtp_uint64 size = 0;
+
+	retv_if(buf_sz <= 0, 0);
+
+	if (propinfo->data_type == PTP_DATATYPE_STRING) {
+		size = 1 + buf[0] * sizeof(mtp_wchar);
+	} else if ((propinfo->data_type & PTP_DATATYPE_ARRAYMASK) ==
+			PTP_DATATYPE_ARRAY) {
+		retv_if(buf_sz < (mtp_int32)sizeof(mtp_uint32), 0);
+		memcpy(&num_ele, buf, sizeof(mtp_uint32));
+#ifdef __BIG_ENDIAN__
+		_util_conv_byte_order(&num_ele, sizeof(mtp_uint32));
+#endif /* __BIG_ENDIAN__ */
+		size = sizeof(mtp_uint32) + (mtp_uint64)num_ele * propinfo->dts_size;
+	} else {
+		size = propinfo->dts_size;
+	}
+
+	return (size <= (mtp_uint64)buf_sz) ? (mtp_uint32)size : 0;
+}
+
 mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		mtp_uint32 h_parent, mtp_uint16 format, mtp_uint64 obj_sz,
 		obj_data_t *obj_data, mtp_obj_t **obj_ptr, void *data,
@@ -964,6 +1088,7 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 	obj_prop_val_t *prop_val = NULL;
 	mtp_uint32 num_elem = 0;
 	mtp_int32 quad_sz = 0;
+	mtp_uint32 val_sz = 0;
 	mtp_uint32 obj_handle = 0;
 	mtp_uint16 prop_code = 0;
 	mtp_uint16 data_type = 0;
@@ -974,14 +1099,15 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 
 	mtp_char file_name[MTP_MAX_FILENAME_SIZE + 1] = { 0 };
 
+	resp = __resolve_send_target(&store_id, &h_parent);
+	if (resp != MTP_ERROR_NONE)
+		return resp;
+
 	if (obj_data != NULL && obj_data->obj != NULL) {
 		/* LCOV_EXCL_START */
+		/* The previous object was never sent, give its space back */
 		store = _device_get_store(obj_data->store_id);
-		if (store != NULL) {
-			DBG("check free size instead of re-calculation\n");
-			_entity_update_store_info_run_time(&(store->store_info),
-					(store->root_path));
-		}
+		_entity_release_store_space(store, obj_data->obj_size, FALSE);
 		_entity_dealloc_mtp_obj(obj_data->obj);
 		/* LCOV_EXCL_STOP */
 	}
@@ -1032,7 +1158,6 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		if (MTP_PHONE_USB_DISCONNECTED == g_ph_status->usb_state ||
 				TRUE == g_status->is_usb_discon) {
 			/* seems usb is disconnected, stop */
-			_entity_dealloc_obj_info(obj_info);
 			resp = MTP_ERROR_GENERAL;
 			goto ERROR_EXIT;
 		}
@@ -1040,7 +1165,6 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		*err_idx = index;
 		if (bytes_left < quad_sz) {
 			/* seems invalid dataset received: Stops parsing */
-			_entity_dealloc_obj_info(obj_info);
 			resp = MTP_ERROR_INVALID_DATASET;
 			goto ERROR_EXIT;
 		}
@@ -1053,7 +1177,6 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		temp += sizeof(mtp_uint32);
 		bytes_left -= sizeof(mtp_uint32);
 		if (obj_handle != 0x00000000) {
-			_entity_dealloc_obj_info(obj_info);
 			resp = MTP_ERROR_INVALID_OBJECTHANDLE;
 			goto ERROR_EXIT;
 		}
@@ -1067,7 +1190,6 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		bytes_left -= sizeof(mtp_uint16);
 		prop_desc = _prop_get_obj_prop_desc(obj_info->obj_fmt, prop_code);
 		if (prop_desc == NULL) {
-			_entity_dealloc_obj_info(obj_info);
 			ERR("property may be unsupported!!\n");
 			resp = MTP_ERROR_INVALID_OBJ_PROP_CODE;
 			goto ERROR_EXIT;
@@ -1080,7 +1202,6 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 				(prop_code == MTP_OBJ_PROPERTYCODE_PARENT) ||
 				(prop_code == MTP_OBJ_PROPERTYCODE_OBJECTFORMAT) ||
 				(prop_code == MTP_OBJ_PROPERTYCODE_OBJECTSIZE)) {
-			_entity_dealloc_obj_info(obj_info);
 			resp = MTP_ERROR_INVALID_DATASET;
 			goto ERROR_EXIT;
 		}
@@ -1093,17 +1214,26 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 		temp += sizeof(mtp_uint16);
 		bytes_left -= sizeof(mtp_uint16);
 		if (data_type != prop_desc->propinfo.data_type) {
-			_entity_dealloc_obj_info(obj_info);
 			resp = MTP_ERROR_INVALID_OBJECT_PROP_FORMAT;
 			goto ERROR_EXIT;
 		}
 
+		val_sz = __size_raw_prop_value(&(prop_desc->propinfo), temp,
+				bytes_left);
+		if (val_sz == 0) {
+			/* seems invalid dataset received: Stops parsing */
+			resp = MTP_ERROR_INVALID_DATASET;
+			goto ERROR_EXIT;
+		}
+
 		/* Acquire object information related data. */
 		prop_val = _prop_alloc_obj_propval(prop_desc);
-		if (prop_val == NULL)
-			continue;
+		if (prop_val == NULL) {
+			resp = MTP_ERROR_GENERAL;
+			goto ERROR_EXIT;
+		}
 
-		_prop_set_current_array_val(prop_val, temp, bytes_left);
+		_prop_set_current_array_val(prop_val, temp, val_sz);
 		switch (prop_code) {
 		case MTP_OBJ_PROPERTYCODE_WIDTH:
 			// TODO: find mechanism to save (integer)
@@ -1148,7 +1278,8 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 			/* empty metadata folder problem
 			 * emtpy file name
 			 */
-			if (prop_val->current_val.str->num_chars == 0) {
+			if (prop_val->current_val.str == NULL ||
+					prop_val->current_val.str->num_chars == 0) {
 				g_strlcpy(file_name, MTP_UNKNOWN_METADATA, sizeof(file_name));
 			} else {
 				_util_utf16_to_utf8(file_name, sizeof(file_name),
@@ -1182,18 +1313,19 @@ mtp_err_t _hutil_construct_object_entry_prop_list(mtp_uint32 store_id,
 			break;
 		}
 
-		temp += _prop_size_obj_propval(prop_val);
-		bytes_left -= _prop_size_obj_propval(prop_val);
+		temp += val_sz;
+		bytes_left -= val_sz;
 		_prop_destroy_obj_propval(prop_val);
 	}
 
 	obj_info->store_id = store_id;
 	obj_info->h_parent = h_parent;
 
-	if ((resp = _hutil_add_object_entry(obj_info, file_name, &obj)) !=
-			MTP_ERROR_NONE) {
+	resp = _hutil_add_object_entry(obj_info, file_name, &obj);
+	/* obj_info now belongs to the object, or was freed on failure */
+	obj_info = NULL;
+	if (resp != MTP_ERROR_NONE)
 		goto ERROR_EXIT;
-	}
 
 	*obj_ptr = obj;
 
@@ -1209,7 +1341,6 @@ ERROR_EXIT:
 mtp_err_t _hutil_get_object_prop_value(mtp_uint32 obj_handle,
 		mtp_uint32 prop_code, obj_prop_val_t *prop_val, mtp_obj_t **obj)
 {
-	obj_prop_val_t *tprop = NULL;
 	mtp_obj_t *tobj = NULL;
 
 	tobj = _device_get_object_with_handle(obj_handle);
@@ -1217,9 +1348,7 @@ mtp_err_t _hutil_get_object_prop_value(mtp_uint32 obj_handle,
 		"requested handle does not exist[0x%x]\n", obj_handle);
 
 	/* LCOV_EXCL_START */
-	tprop = _prop_get_prop_val(tobj, prop_code);
-	if (tprop != NULL) {
-		memcpy(prop_val, tprop, sizeof(obj_prop_val_t));
+	if (_prop_get_prop_val(tobj, prop_code, prop_val)) {
 		*obj = tobj;
 		return MTP_ERROR_NONE;
 	}
@@ -1319,8 +1448,9 @@ mtp_err_t _hutil_update_object_property(mtp_uint32 obj_handle,
 			}
 
 			/* Finally assign new handle and update full path */
-			_entity_set_object_file_path(obj, dest_fpath,
-					CHAR_TYPE);
+			_entity_set_object_path_in_store(
+					_device_get_store(obj_info->store_id),
+					obj, dest_fpath);
 
 			/* FILE RENAME */
 			retvm_if(!_entity_set_child_object_path(obj, orig_fpath, dest_fpath),
@@ -1335,6 +1465,7 @@ mtp_err_t _hutil_update_object_property(mtp_uint32 obj_handle,
 		p_size = _prop_size_ptpstring(&fname);
 	} else if (prop_code == MTP_OBJ_PROPERTYCODE_ASSOCIATIONTYPE) {
 		memcpy(&obj_info->association_type, buf, sizeof(mtp_uint16));
+		_entity_invalidate_obj_info(obj);
 		p_size = sizeof(mtp_uint16);
 	} else {
 		ERR("Propert [0x%x] is GETONLY\n", prop_code);
@@ -1346,18 +1477,6 @@ mtp_err_t _hutil_update_object_property(mtp_uint32 obj_handle,
 	return MTP_ERROR_NONE;
 }
 
-mtp_err_t _hutil_get_prop_desc(mtp_uint32 format, mtp_uint32 prop_code,
-		void *data)
-{
-	obj_prop_desc_t *prop = NULL;
-
-	prop = _prop_get_obj_prop_desc(format, prop_code);
-	retvm_if(!prop, MTP_ERROR_GENERAL, "pProperty is NULL\n");
-
-	memcpy(data, prop, sizeof(obj_prop_desc_t));
-	return MTP_ERROR_NONE;
-}
-
 mtp_err_t _hutil_get_object_prop_supported(mtp_uint32 format,
 		ptp_array_t	*prop_arr)
 {
@@ -1365,30 +1484,49 @@ mtp_err_t _hutil_get_object_prop_supported(mtp_uint32 format,
 	return MTP_ERROR_NONE;
 }
 
-#ifndef MTP_USE_RUNTIME_GETOBJECTPROPVALUE
-mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
-		mtp_uint32 prop_code, mtp_uint32 group_code, mtp_uint32 depth,
-		obj_proplist_t *prop_list)
-#else /* MTP_USE_RUNTIME_GETOBJECTPROPVALUE */
-mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
-		mtp_uint32 prop_code, mtp_uint32 group_code, mtp_uint32 depth,
-		obj_proplist_t *prop_list, ptp_array_t *obj_arr)
-#endif /* MTP_USE_RUNTIME_GETOBJECTPROPVALUE */
+static void __collect_objects_till_depth(mtp_store_t *store,
+		mtp_uint32 obj_handle, mtp_uint32 format, mtp_uint32 depth,
+		GPtrArray *objs)
 {
-#ifndef MTP_USE_RUNTIME_GETOBJECTPROPVALUE
 	ptp_array_t obj_arr = { 0 };
-#endif /*MTP_USE_RUNTIME_GETOBJECTPROPVALUE*/
+	mtp_uint32 *handles = NULL;
 	mtp_obj_t *obj = NULL;
 	mtp_uint32 i = 0;
-	mtp_uint32 ii = 0;
+
+	_prop_init_ptparray(&obj_arr, UINT32_TYPE);
+	_entity_get_objects_from_store_till_depth(store, obj_handle, format,
+			depth, &obj_arr);
+
+	handles = obj_arr.array_entry;
+	for (i = 0; i < obj_arr.num_ele; i++) {
+		obj = _entity_get_object_from_store(store, handles[i]);
+		if (obj)
+			g_ptr_array_add(objs, obj);
+	}
+	_prop_deinit_ptparray(&obj_arr);
+}
+
+/*
+ * Collects the objects a GetObjectPropList covers. The properties are
+ * not looked at here, the caller encodes them straight into the data
+ * phase.
+ */
+mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
+		mtp_uint32 prop_code, mtp_uint32 group_code, mtp_uint32 depth,
+		GPtrArray *objs)
+{
 	mtp_store_t *store = NULL;
+	mtp_uint32 ii = 0;
+
+	retv_if(objs == NULL, MTP_ERROR_INVALID_PARAM);
 
 	if ((obj_handle != PTP_OBJECTHANDLE_UNDEFINED) &&
 			(obj_handle != PTP_OBJECTHANDLE_ALL)) {
 		/* Is this object handle valid? */
 		/* LCOV_EXCL_START */
 		store = _device_get_store_containing_obj(obj_handle);
-		retvm_if(!store, MTP_ERROR_INVALID_OBJECTHANDLE, "invalid object handle\n");
+		retvm_if(!store || !store->is_ready, MTP_ERROR_INVALID_OBJECTHANDLE,
+				"invalid object handle\n");
 		/* LCOV_EXCL_STOP */
 	}
 
@@ -1397,6 +1535,10 @@ mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
 		 * is not specified.
 		 * */
 		retvm_if(group_code == 0x0, MTP_ERROR_INVALID_PARAM, "PropGroupCode is zero\n");
+	} else if (prop_code != PTP_PROPERTY_ALL) {
+		retvm_if(!_prop_get_obj_prop_desc(format, prop_code),
+				MTP_ERROR_INVALID_OBJ_PROP_CODE,
+				"property[0x%x] is not supported\n", prop_code);
 	}
 
 	/* LCOV_EXCL_START */
@@ -1407,46 +1549,19 @@ mtp_err_t _hutil_get_object_prop_list(mtp_uint32 obj_handle, mtp_uint32 format,
 				"both object handle and format code is specified!\
 				return nospecification by format\n");
 
-	if (prop_list == NULL)
-		return MTP_ERROR_INVALID_PARAM;
-
-	_util_init_list(&(prop_list->prop_quad_list));
-	_prop_init_ptparray(obj_arr, UINT32_TYPE);
-
 	if (store != NULL) {
-		_entity_get_objects_from_store_till_depth(store, obj_handle,
-				format, depth, obj_arr);
-	} else {
-		for (ii = 0; ii < g_device->num_stores; ii++) {
-			store = _device_get_store_at_index(ii);
-			_entity_get_objects_from_store_till_depth(store,
-					obj_handle, format, depth, obj_arr);
-		}
+		__collect_objects_till_depth(store, obj_handle, format, depth,
+				objs);
+		return MTP_ERROR_NONE;
 	}
 
-	if (obj_arr->num_ele != 0) {
-		mtp_uint32 *obj_handles = obj_arr->array_entry;
-
-		for (i = 0; i < obj_arr->num_ele; i++) {
-			obj = _entity_get_object_from_store(store, obj_handles[i]);
-			if (!obj)
-				continue;
-
-			if (_prop_get_obj_proplist(obj, prop_code, group_code,
-						prop_list) == FALSE) {
-				ERR("Fail to create Proplist\n");
-#ifndef MTP_USE_RUNTIME_GETOBJECTPROPVALUE
-				_prop_deinit_ptparray(&obj_arr);
-#endif /*MTP_USE_RUNTIME_GETOBJECTPROPVALUE*/
-				return MTP_ERROR_GENERAL;
-			}
-		}
-	/* LCOV_EXCL_STOP */
+	for (ii = 0; ii < g_device->num_stores; ii++) {
+		store = _device_get_store_at_index(ii);
+		if (store)
+			__collect_objects_till_depth(store, obj_handle, format,
+					depth, objs);
 	}
-
-#ifndef MTP_USE_RUNTIME_GETOBJECTPROPVALUE
-	prop_deinit_ptparray(&obj_arr);
-#endif /*MTP_USE_RUNTIME_GETOBJECTPROPVALUE*/
+	/* LCOV_EXCL_STOP */
 
 	return MTP_ERROR_NONE;
 }
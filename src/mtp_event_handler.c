@@ -17,6 +17,7 @@
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 #include <signal.h>
 #include <glib.h>
 #include "mtp_event_handler.h"
@@ -26,11 +27,13 @@
 #include "mtp_init.h"
 #include "mtp_usb_driver.h"
 #include "mtp_transport.h"
+#include "mtp_device.h"
 
 /*
  * GLOBAL AND EXTERN VARIABLES
  */
 extern mtp_mgr_t g_mtp_mgr;
+extern pthread_rwlock_t g_store_lock;
 pthread_t g_eh_thrd;	/* event handler thread */
 mtp_int32 g_pipefd[2];
 
@@ -60,6 +63,13 @@ static mtp_bool __send_events_from_device_to_pc(mtp_dword store_id,
 				0, param1 , 0);
 		break;
 
+	case PTP_EVENTCODE_STOREADDED:
+		DBG("case PTP_EVENTCODE_STOREADDED\n");
+		DBG("param1 [0x%x]\n", param1);
+		_hdlr_init_event_container(&event, PTP_EVENTCODE_STOREADDED,
+				0, param1, 0);
+		break;
+
 	default:
 		DBG("Event not supported\n");
 		return FALSE;
@@ -99,16 +109,38 @@ static mtp_bool __process_event_request(mtp_event_t *evt)
 		_eh_handle_usb_events(USB_REMOVED);
 		break;
 
+	case EVENT_USB_DISCONNECTED:
+		_eh_handle_usb_events(USB_DISCONNECTED);
+		break;
+
+	case EVENT_USB_CONNECTED:
+		_eh_handle_usb_events(USB_CONNECTED);
+		break;
+
 	case EVENT_OBJECT_ADDED:
+		/* No host to tell, it lists the folder on reconnection */
+		if (g_status->is_usb_discon)
+			break;
 		__send_events_from_device_to_pc(0, PTP_EVENTCODE_OBJECTADDED,
 				evt->param1, 0);
 		break;
 
 	case EVENT_OBJECT_REMOVED:
+		if (g_status->is_usb_discon)
+			break;
 		__send_events_from_device_to_pc(0,
 				PTP_EVENTCODE_OBJECTREMOVED, evt->param1, 0);
 		break;
 
+	case EVENT_STORE_ADDED:
+		/* Stores ready before the USB are listed by GetStorageIDs */
+		if (g_status->is_usb_discon ||
+				g_status->mtp_op_state < MTP_STATE_ONSERVICE)
+			break;
+		__send_events_from_device_to_pc(evt->param1,
+				PTP_EVENTCODE_STOREADDED, evt->param1, 0);
+		break;
+
 	case EVENT_CLOSE:
 		break;
 
@@ -191,6 +223,32 @@ void _eh_send_event_req_to_eh_thread(event_code_t action, mtp_ulong param1,
 	}
 }
 
+static void __remove_temp_file(void)
+{
+	/*
+	 * Temp file should be deleted after usb usb read/write threads
+	 * are terminated. Because data receive thread tries to
+	 * write the temp file until sink thread is terminated.
+	 */
+	if (g_mtp_mgr.ftemp_st.filepath != NULL &&
+			(access(g_mtp_mgr.ftemp_st.filepath, F_OK) == 0)) {
+		DBG("USB disconnected but temp file is remaind.\
+				It will be deleted.\n");
+
+		if (g_mtp_mgr.ftemp_st.fhandle != NULL) {
+			DBG("handle is found. At first close file\n");
+			_util_file_close(g_mtp_mgr.ftemp_st.fhandle);
+			g_mtp_mgr.ftemp_st.fhandle = NULL;
+		}
+		if (remove(g_mtp_mgr.ftemp_st.filepath) < 0) {
+			ERR_SECURE("remove(%s) Fail\n", g_mtp_mgr.ftemp_st.filepath);
+			_util_print_error();
+		}
+		g_free(g_mtp_mgr.ftemp_st.filepath);
+		g_mtp_mgr.ftemp_st.filepath = NULL;
+	}
+}
+
 mtp_bool _eh_handle_usb_events(mtp_uint32 type)
 {
 	mtp_state_t state;
@@ -198,6 +256,7 @@ mtp_bool _eh_handle_usb_events(mtp_uint32 type)
 	/* Prevent repeated USB insert/remove mal-function */
 	static mtp_int32 is_usb_inserted = 0;
 	static mtp_int32 is_usb_removed = 0;
+	static mtp_int32 is_usb_suspended = 0;
 
 	state = g_status->mtp_op_state;
 
@@ -247,34 +306,63 @@ mtp_bool _eh_handle_usb_events(mtp_uint32 type)
 		_transport_usb_finalize();
 		g_status->mtp_op_state = MTP_STATE_STOPPED;
 
-		/*
-		 * Temp file should be deleted after usb usb read/write threads
-		 * are terminated. Because data receive thread tries to
-		 * write the temp file until sink thread is terminated.
-		 */
-		if (g_mtp_mgr.ftemp_st.filepath != NULL &&
-				(access(g_mtp_mgr.ftemp_st.filepath, F_OK) == 0)) {
-			DBG("USB disconnected but temp file is remaind.\
-					It will be deleted.\n");
-
-			if (g_mtp_mgr.ftemp_st.fhandle != NULL) {
-				DBG("handle is found. At first close file\n");
-				_util_file_close(g_mtp_mgr.ftemp_st.fhandle);
-				g_mtp_mgr.ftemp_st.fhandle = NULL;
-			}
-			if (remove(g_mtp_mgr.ftemp_st.filepath) < 0) {
-				ERR_SECURE("remove(%s) Fail\n", g_mtp_mgr.ftemp_st.filepath);
-				_util_print_error();
-			}
-			g_free(g_mtp_mgr.ftemp_st.filepath);
-			g_mtp_mgr.ftemp_st.filepath = NULL;
-		}
+		__remove_temp_file();
 
 		_mtp_deinit();
 		_device_uninstall_storage();
 		_eh_send_event_req_to_eh_thread(EVENT_CLOSE, 1, 0, NULL);
 		break;
 
+	case USB_DISCONNECTED:
+		retvm_if(is_usb_removed == 1, TRUE, "USB is already removed\n");
+		retvm_if(is_usb_suspended == 1, TRUE, "USB is already disconnected\n");
+		retvm_if(state == MTP_STATE_STOPPED || state == MTP_STATE_INITIALIZING,
+				TRUE, "MTP is not in service\n");
+
+		/*
+		 * Only the data path and the session go away. The stores,
+		 * their indexes and the inotify watches are kept, so that a
+		 * reconnection does not scan the storage again.
+		 */
+		DBG("USB is disconnected, waiting for the host\n");
+
+		g_status->is_usb_discon = TRUE;
+
+		/* cancel all transaction */
+		g_status->ctrl_event_code = PTP_EVENTCODE_CANCELTRANSACTION;
+
+		_transport_suspend_interfaces();
+		g_status->mtp_op_state = MTP_STATE_READY_SERVICE;
+		is_usb_suspended = 1;
+
+		__remove_temp_file();
+
+		UTIL_WRITE_LOCK(&g_store_lock);
+		_cmd_hdlr_reset_cmd(&g_mtp_mgr.hdlr);
+		UTIL_RW_UNLOCK(&g_store_lock);
+
+		_device_save_store_snapshots();
+		break;
+
+	case USB_CONNECTED:
+		/* The first connection is handled by EVENT_START_MAIN_OP */
+		if (is_usb_suspended == 0 || is_usb_removed == 1)
+			break;
+
+		DBG("USB is reconnected\n");
+
+		g_status->is_usb_discon = FALSE;
+		g_status->ctrl_event_code = 0;
+
+		if (FALSE == _transport_resume_interfaces()) {
+			ERR("USB resume fail\n");
+			kill(getpid(), SIGTERM);
+			break;
+		}
+		is_usb_suspended = 0;
+		g_status->mtp_op_state = MTP_STATE_ONSERVICE;
+		break;
+
 	default:
 		ERR("can be ignored notify [0x%x]\n", type);
 		break;
@@ -37,7 +37,7 @@
  * GLOBAL AND EXTERN VARIABLES
  */
 extern pthread_t g_eh_thrd;
-extern pthread_mutex_t g_cmd_inoti_mutex;
+extern pthread_rwlock_t g_store_lock;
 extern mtp_bool g_is_sync_estab;
 extern phone_state_t *g_ph_status;
 
@@ -54,8 +54,51 @@ static mtp_mgr_t *g_mgr = &g_mtp_mgr;
  */
 
 /* LCOV_EXCL_START */
+/*
+ * Parses "<path>[,<description>]" of a storage entry. Later entries get
+ * the higher store IDs, so the order of the file must stay stable.
+ */
+static void __add_storage_conf(char *value)
+{
+	mtp_storage_conf_t *storage = NULL;
+	char *desc = NULL;
+	size_t len = 0;
+
+	retm_if(g_conf.num_storages == MTP_MAX_STORAGES,
+		"Too many storages, [%s] ignored\n", value);
+
+	desc = strchr(value, ',');
+	if (desc)
+		*desc++ = '\0';
+
+	len = strlen(value);
+	while (len > 1 && value[len - 1] == '/')
+		value[--len] = '\0';
+
+	retm_if(value[0] != '/' || len > MTP_MAX_PATHNAME_SIZE,
+		"Invalid storage path [%s]\n", value);
+
+	storage = &g_conf.storages[g_conf.num_storages++];
+	g_strlcpy(storage->path, value, sizeof(storage->path));
+	g_strlcpy(storage->desc, (desc && desc[0]) ? desc :
+			MTP_STORAGE_DESC_EXT, sizeof(storage->desc));
+}
+
+static void __set_default_storage(void)
+{
+	if (g_conf.num_storages > 0)
+		return;
+
+	g_conf.num_storages = 1;
+	_util_get_external_path(g_conf.storages[0].path);
+	g_strlcpy(g_conf.storages[0].desc, MTP_STORAGE_DESC_EXT,
+			sizeof(g_conf.storages[0].desc));
+}
+
 static void __print_mtp_conf(void)
 {
+	int ii = 0;
+
 	retm_if(g_conf.is_init == false, "g_conf is not initialized\n");
 
 	DBG("MMAP_THRESHOLD : %d\n", g_conf.mmap_threshold);
@@ -67,7 +110,14 @@ static void __print_mtp_conf(void)
 	DBG("WRITE_USB_SIZE : %d\n", g_conf.write_usb_size);
 	DBG("READ_FILE_SIZE : %d\n", g_conf.read_file_size);
 	DBG("WRITE_FILE_SIZE : %d\n", g_conf.write_file_size);
-	DBG("MAX_IO_BUF_SIZE : %d\n\n", g_conf.max_io_buf_size);
+	DBG("MAX_IO_BUF_SIZE : %d\n", g_conf.max_io_buf_size);
+	DBG("SCAN_THREADS : %d\n", g_conf.scan_threads);
+	DBG("GUID_FROM_INODE : %s\n", g_conf.guid_from_inode ? "Yes" : "No");
+	DBG("USE_FANOTIFY : %s\n\n", g_conf.use_fanotify ? "Yes" : "No");
+
+	for (ii = 0; ii < g_conf.num_storages; ii++)
+		DBG("STORAGE[%d] : %s (%s)\n", ii, g_conf.storages[ii].path,
+				g_conf.storages[ii].desc);
 
 	DBG("SUPPORT_PTHEAD_SHCED : %s\n", g_conf.support_pthread_sched ? "Support" : "Not support");
 	DBG("INHERITSCHED : %c\n", g_conf.inheritsched);
@@ -99,6 +149,10 @@ static void __read_mtp_conf(void)
 
 	g_conf.max_io_buf_size = MTP_MAX_IO_BUF_SIZE;
 	g_conf.read_file_delay = MTP_READ_FILE_DELAY;
+	g_conf.scan_threads = MTP_SCAN_THREADS;
+	g_conf.guid_from_inode = MTP_GUID_FROM_INODE;
+	g_conf.use_fanotify = MTP_USE_FANOTIFY;
+	g_conf.num_storages = 0;
 
 	if (MTP_SUPPORT_PTHREAD_SCHED) {
 		g_conf.support_pthread_sched = MTP_SUPPORT_PTHREAD_SCHED;
@@ -112,6 +166,7 @@ static void __read_mtp_conf(void)
 	if (fp == NULL) {
 		/* LCOV_EXCL_START */
 		DBG("Default configuration is used\n");
+		__set_default_storage();
 		g_conf.is_init = true;
 
 		__print_mtp_conf();
@@ -212,6 +267,34 @@ static void __read_mtp_conf(void)
 
 			g_conf.read_file_delay = atoi(token);
 
+		} else if (strcasecmp(token, "scan_threads") == 0) {
+			token = strtok_r(NULL, "=", &saveptr);
+			if (token == NULL)
+				continue;	//	LCOV_EXCL_LINE
+
+			g_conf.scan_threads = atoi(token);
+
+		} else if (strcasecmp(token, "guid_from_inode") == 0) {
+			token = strtok_r(NULL, "=", &saveptr);
+			if (token == NULL)
+				continue;	//	LCOV_EXCL_LINE
+
+			g_conf.guid_from_inode = atoi(token) ? true : false;
+
+		} else if (strcasecmp(token, "use_fanotify") == 0) {
+			token = strtok_r(NULL, "=", &saveptr);
+			if (token == NULL)
+				continue;	//	LCOV_EXCL_LINE
+
+			g_conf.use_fanotify = atoi(token) ? true : false;
+
+		} else if (strcasecmp(token, "storage") == 0) {
+			token = strtok_r(NULL, "=", &saveptr);
+			if (token == NULL)
+				continue;	//	LCOV_EXCL_LINE
+
+			__add_storage_conf(token);
+
 		} else if (strcasecmp(token, "support_pthread_sched") == 0) {
 			/* LCOV_EXCL_START */
 			token = strtok_r(NULL, "=", &saveptr);
@@ -253,6 +336,7 @@ static void __read_mtp_conf(void)
 		}
 	}
 	fclose(fp);
+	__set_default_storage();
 	g_conf.is_init = true;
 
 	__print_mtp_conf();
@@ -351,12 +435,13 @@ void _mtp_init(void)
 		}
 	}
 
-	/* External Storage */
+	/* External Storage, other storages are mount points left as they are */
 	{
 	/* LCOV_EXCL_START */
 		char ext_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 		_util_get_external_path(ext_path);
-		if (access(ext_path, F_OK) < 0) {
+		if (!g_strcmp0(g_conf.storages[0].path, ext_path) &&
+				access(ext_path, F_OK) < 0) {
 			if (FALSE == _util_dir_create((const mtp_char *)ext_path, &error)) {
 				ERR("Cannot make directory!! [%s]\n",
 						ext_path);
@@ -378,6 +463,9 @@ void _mtp_init(void)
 	_inoti_init_filesystem_evnts();
 #endif /*MTP_SUPPORT_OBJECTADDDELETE_EVENT*/
 
+	/* After inotify, restored folders get their watches back */
+	_device_enumerate_stores();
+
 	return;
 
 MTP_INIT_FAIL:
@@ -412,19 +500,34 @@ void mtp_end_event(void)
 }
 /* LCOV_EXCL_STOP */
 
-static inline int _main_init()
+/* Periodic snapshot of the stores, so that a crash loses little */
+static gboolean __save_snapshots_cb(gpointer user_data)
+{
+	if (g_status->mtp_op_state != MTP_STATE_ONSERVICE)
+		return TRUE;
+
+	_device_save_store_snapshots();
+
+	return TRUE;
+}
+
+static gboolean __refresh_space_cb(gpointer user_data)
 {
-	pthread_mutexattr_t mutex_attr;
+	if (g_status->mtp_op_state < MTP_STATE_READY_SERVICE)
+		return TRUE;
 
-	pthread_mutexattr_init(&mutex_attr);
-	pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
-	if (0 != pthread_mutex_init(&g_cmd_inoti_mutex, &mutex_attr)) {
-		ERR("pthread_mutex_init() Fail\n");
+	_device_refresh_store_space();
+
+	return TRUE;
+}
+
+static inline int _main_init()
+{
+	if (0 != pthread_rwlock_init(&g_store_lock, NULL)) {
+		ERR("pthread_rwlock_init() Fail\n");
 		_util_print_error();
-		pthread_mutexattr_destroy(&mutex_attr);
 		return MTP_ERROR_GENERAL;
 	}
-	pthread_mutexattr_destroy(&mutex_attr);
 
 	retvm_if(!_eh_handle_usb_events(USB_INSERTED), MTP_ERROR_GENERAL,
 		"_eh_handle_usb_events() Fail\n");
@@ -432,6 +535,9 @@ static inline int _main_init()
 	g_mainloop = g_main_loop_new(NULL, FALSE);
 	retvm_if(!g_mainloop, MTP_ERROR_GENERAL, "g_mainloop is NULL\n");
 
+	g_timeout_add_seconds(MTP_SNAPSHOT_INTERVAL, __save_snapshots_cb, NULL);
+	g_timeout_add_seconds(MTP_SPACE_REFRESH_CHECK, __refresh_space_cb, NULL);
+
 	return MTP_ERROR_NONE;
 }
 
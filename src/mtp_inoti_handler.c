@@ -14,10 +14,14 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <glib.h>
 #include <glib/gprintf.h>
 #include "mtp_thread.h"
@@ -30,7 +34,8 @@
 /*
  * GLOBAL AND STATIC VARIABLES
  */
-pthread_mutex_t g_cmd_inoti_mutex;
+pthread_rwlock_t g_store_lock;
+extern mtp_config_t g_conf;
 
 #ifdef MTP_SUPPORT_OBJECTADDDELETE_EVENT
 mtp_char g_last_created_dir[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
@@ -42,115 +47,276 @@ mtp_char g_copy_dst_file[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 mtp_bool g_is_send_partial_object = FALSE;
 
 static pthread_t g_inoti_thrd;
-static mtp_int32 g_cnt_watch_folder = 0;
 static mtp_int32 g_inoti_fd;
-static open_files_info_t *g_open_files_list;
-static inoti_watches_t g_inoti_watches[INOTI_FOLDER_COUNT_MAX];
+static GHashTable *g_open_files;	/* "wd/name" of files created, not closed yet */
 
-static mtp_int32 __get_inoti_watch_id(mtp_int32 iwd)
+/*
+ * Watched folders, by watch descriptor and by path. Watches are added by
+ * the store loading threads and looked up by the inotify thread, so both
+ * tables are only used with g_watch_lock held.
+ */
+static pthread_mutex_t g_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *g_watches_by_wd;	/* wd -> inoti_watches_t, owned */
+static GHashTable *g_watches_by_path;	/* forlder_name -> inoti_watches_t */
+static mtp_bool g_is_watch_limit_reported;
+
+#ifdef INOTI_SUPPORT_FANOTIFY
+/*
+ * With use_fanotify, one fanotify mark on the filesystem of a storage
+ * stands for the inotify watches on all of its folders. A storage that
+ * cannot be marked keeps using inotify. Guarded by g_watch_lock too.
+ */
+typedef struct {
+	mtp_bool is_tried;	/* Marking was attempted */
+	mtp_bool is_marked;
+	mtp_int32 mount_fd;	/* Storage root, for open_by_handle_at() */
+	mtp_char *real_root;	/* Canonical storage root, as events see it */
+	fsid_t fsid;
+} fanoti_store_t;
+
+static mtp_int32 g_fanoti_fd;
+static mtp_bool g_is_fanoti_tried;	/* Until the next clean up */
+static fanoti_store_t g_fanoti_stores[MTP_MAX_STORAGES];
+#endif /* INOTI_SUPPORT_FANOTIFY */
+
+static void __free_inoti_watch(gpointer data)
 {
-	mtp_int32 i = 0;
+	inoti_watches_t *watch = (inoti_watches_t *)data;
 
-	for (i = 0; i < INOTI_FOLDER_COUNT_MAX; i++) {
-		if (iwd == g_inoti_watches[i].wd)
-			break;
-	}
+	g_free(watch->forlder_name);
+	g_free(watch);
+}
 
-	retvm_if(i >= INOTI_FOLDER_COUNT_MAX, -1, "inoti_folder is not found\n");
+#ifdef INOTI_SUPPORT_FANOTIFY
+/* Needs g_watch_lock */
+static void __init_fanoti(void)
+{
+	ret_if(g_is_fanoti_tried || !g_conf.use_fanotify);
+	g_is_fanoti_tried = TRUE;
 
-	return i;
+	g_fanoti_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME,
+			O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if (g_fanoti_fd < 0) {
+		/* LCOV_EXCL_START */
+		ERR("fanotify_init() Fail, inotify is used\n");
+		_util_print_error();
+		g_fanoti_fd = 0;
+		/* LCOV_EXCL_STOP */
+	}
 }
 
-static mtp_bool __get_inoti_event_full_path(mtp_int32 wd, mtp_char *event_name,
-		mtp_char *path, mtp_int32 path_len, mtp_char *parent_path)
+/* Index of the configured storage path is in, or -1 */
+static mtp_int32 __get_storage_index(const mtp_char *path)
 {
-	mtp_int32 inoti_id = 0;
+	mtp_uint32 len = 0;
+	mtp_int32 ii = 0;
+
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		len = strlen(g_conf.storages[ii].path);
+		if (strncmp(path, g_conf.storages[ii].path, len) == 0 &&
+				(path[len] == '\0' || path[len] == '/'))
+			return ii;
+	}
 
-	retv_if(wd == 0, FALSE);
-	retv_if(path == NULL, FALSE);
-	retv_if(event_name == NULL, FALSE);
+	return -1;
+}
 
-	inoti_id = __get_inoti_watch_id(wd);
-	retvm_if(inoti_id < 0, FALSE, "FAIL to find last_inoti_id : %d\n", inoti_id);
+/* LCOV_EXCL_START */
+static mtp_bool __mark_fanoti_store(fanoti_store_t *fstore,
+		const mtp_char *root)
+{
+	struct statfs buf;
 
-	/* 2 is for / and null character */
-	if (path_len < (strlen(g_inoti_watches[inoti_id].forlder_name) +
-				strlen(event_name) + 2))
+	fstore->real_root = realpath(root, NULL);
+	retvm_if(fstore->real_root == NULL, FALSE, "realpath() Fail\n");
+
+	if (fanotify_mark(g_fanoti_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+				FANOTI_EVENT_MASK, AT_FDCWD, root) < 0 ||
+			statfs(root, &buf) < 0) {
+		ERR_SECURE("fanotify_mark() Fail, inotify is used for %s\n",
+				root);
+		_util_print_error();
+		free(fstore->real_root);
+		fstore->real_root = NULL;
 		return FALSE;
+	}
 
-	g_snprintf(path, path_len, "%s/%s",
-			g_inoti_watches[inoti_id].forlder_name, event_name);
-	g_snprintf(parent_path, path_len, "%s",
-			g_inoti_watches[inoti_id].forlder_name);
+	fstore->mount_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fstore->mount_fd < 0) {
+		ERR("open() Fail\n");
+		free(fstore->real_root);
+		fstore->real_root = NULL;
+		return FALSE;
+	}
 
+	memcpy(&(fstore->fsid), &(buf.f_fsid), sizeof(fstore->fsid));
+	DBG_SECURE("fanotify mark on the filesystem of %s [%s]\n", root,
+			fstore->real_root);
 	return TRUE;
 }
+/* LCOV_EXCL_STOP */
 
-static open_files_info_t *__find_file_in_inoti_open_files_list(mtp_int32 wd,
-		mtp_char *event_name)
+/*
+ * Rewrites a canonical path under a marked storage to one under the
+ * configured root, which may be reached through a symlink.
+ * Needs g_watch_lock.
+ */
+static mtp_bool __get_fanoti_config_path(mtp_char *path, mtp_int32 path_len)
 {
-	open_files_info_t *current_node = g_open_files_list;
+	mtp_char *rest = NULL;
+	mtp_char *tail = NULL;
+	mtp_uint32 len = 0;
+	mtp_int32 ii = 0;
 
-	while (NULL != current_node) {
-		if ((current_node->wd == wd) &&
-				(g_strcmp0(current_node->name, event_name) == 0)) {
-			return current_node;
-		}
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		if (!g_fanoti_stores[ii].is_marked)
+			continue;
+
+		len = strlen(g_fanoti_stores[ii].real_root);
+		if (strncmp(path, g_fanoti_stores[ii].real_root, len) != 0 ||
+				(path[len] != '\0' && path[len] != '/'))
+			continue;
 
-		current_node = current_node->previous;
+		rest = path + len;
+		retv_if(strlen(g_conf.storages[ii].path) + strlen(rest) + 1 >
+				path_len, FALSE);
+		tail = g_strdup(rest);
+		g_snprintf(path, path_len, "%s%s", g_conf.storages[ii].path,
+				tail);
+		g_free(tail);
+		return TRUE;
 	}
 
-	ERR("Cannot find file in open file's list\n");
-	return NULL;
+	return FALSE;
 }
 
-static mtp_bool __add_file_to_inoti_open_files_list(mtp_int32 wd,
-		mtp_char *event_name)
+/*
+ * Whether fanotify reports the changes in folder path, marking the
+ * filesystem of its storage the first time one of its folders comes.
+ * Needs g_watch_lock.
+ */
+static mtp_bool __is_fanoti_watched(const mtp_char *path)
 {
-	open_files_info_t *new_node = NULL;
+	fanoti_store_t *fstore = NULL;
+	mtp_int32 idx = 0;
 
-	new_node = (open_files_info_t *)g_malloc(sizeof(open_files_info_t));
-	retvm_if(!new_node, FALSE, "new_node is null malloc fail\n");
+	retv_if(g_fanoti_fd <= 0, FALSE);
 
-	new_node->name = g_strdup(event_name);
-	new_node->wd = wd;
+	idx = __get_storage_index(path);
+	retv_if(idx < 0, FALSE);
 
-	/* First created file */
-	if (NULL == g_open_files_list) {
-		new_node->previous = NULL;
-	} else {
-		g_open_files_list->next = new_node;
-		new_node->previous = g_open_files_list;
+	fstore = &(g_fanoti_stores[idx]);
+	if (!fstore->is_tried) {
+		fstore->is_tried = TRUE;
+		fstore->is_marked = __mark_fanoti_store(fstore,
+				g_conf.storages[idx].path);
+	}
+
+	return fstore->is_marked;
+}
+#endif /* INOTI_SUPPORT_FANOTIFY */
+
+/* Needs g_watch_lock */
+static mtp_bool __init_inoti_watches(void)
+{
+#ifdef INOTI_SUPPORT_FANOTIFY
+	__init_fanoti();
+#endif /* INOTI_SUPPORT_FANOTIFY */
+
+	if (g_inoti_fd <= 0) {
+		g_inoti_fd = inotify_init();
+		if (g_inoti_fd < 0) {
+			ERR("inotify_init() Fail : g_inoti_fd = %d\n", g_inoti_fd);
+			g_inoti_fd = 0;
+			return FALSE;
+		}
+	}
+
+	if (g_watches_by_wd == NULL) {
+		g_watches_by_wd = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, __free_inoti_watch);
+		g_watches_by_path = g_hash_table_new(g_str_hash, g_str_equal);
 	}
-	new_node->next = NULL;
-	g_open_files_list = new_node;
 
 	return TRUE;
 }
 
-static void __remove_file_from_inoti_open_files_list(open_files_info_t *node)
+/* Needs g_watch_lock */
+static void __remove_watch_entry(inoti_watches_t *watch)
+{
+	inotify_rm_watch(g_inoti_fd, watch->wd);
+	g_hash_table_remove(g_watches_by_path, watch->forlder_name);
+	g_hash_table_remove(g_watches_by_wd, GINT_TO_POINTER(watch->wd));
+	g_is_watch_limit_reported = FALSE;
+}
+
+static mtp_bool __get_inoti_event_full_path(mtp_int32 wd, mtp_char *event_name,
+		mtp_char *path, mtp_int32 path_len, mtp_char *parent_path)
 {
-	if (NULL != node->previous)
-		node->previous->next = node->next;
+	inoti_watches_t *watch = NULL;
+	mtp_bool ret = FALSE;
+
+	retv_if(wd == 0, FALSE);
+	retv_if(path == NULL, FALSE);
+	retv_if(event_name == NULL, FALSE);
+
+	pthread_mutex_lock(&g_watch_lock);
+	watch = g_watches_by_wd ?
+		g_hash_table_lookup(g_watches_by_wd, GINT_TO_POINTER(wd)) : NULL;
+
+	/* 2 is for / and null character */
+	if (watch && path_len >= (strlen(watch->forlder_name) +
+				strlen(event_name) + 2)) {
+		g_snprintf(path, path_len, "%s/%s", watch->forlder_name,
+				event_name);
+		g_snprintf(parent_path, path_len, "%s", watch->forlder_name);
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&g_watch_lock);
+
+	if (watch == NULL)
+		ERR("inoti_folder is not found, wd : %d\n", wd);
+	return ret;
+}
+
+/*
+ * Files created by someone else are added to a store once they are
+ * closed. The set is only used by the inotify thread.
+ */
+static mtp_bool __add_file_to_inoti_open_files(mtp_char *full_path)
+{
+	if (g_open_files == NULL) {
+		g_open_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, NULL);
+		retvm_if(!g_open_files, FALSE, "g_hash_table_new_full() Fail\n");
+	}
+
+	g_hash_table_add(g_open_files, g_strdup(full_path));
 
-	if (NULL != node->next)
-		node->next->previous = node->previous;
+	return TRUE;
+}
 
-	if (node == g_open_files_list)
-		g_open_files_list = node->previous;
+/* Returns TRUE if the file was in the set, which it is no longer */
+static mtp_bool __remove_file_from_inoti_open_files(mtp_char *full_path)
+{
+	retv_if(g_open_files == NULL, FALSE);
 
-	g_free(node->name);
-	g_free(node);
+	return g_hash_table_remove(g_open_files, full_path);
 }
 
+/*
+ * The file is looked at before the store lock is taken, which is then
+ * only held to add the object, so that commands are not held up by the
+ * filesystem.
+ */
 static void __process_object_added_event(mtp_char *fullpath,
 		mtp_char *file_name, mtp_char *parent_path)
 {
-	mtp_uint32 store_id = 0;
 	mtp_store_t *store = NULL;
 	mtp_obj_t *parent_obj = NULL;
 	mtp_uint32 h_parent = 0;
 	mtp_obj_t *obj = NULL;
+	mtp_uint32 obj_handle = 0;
 	struct stat stat_buf = { 0 };
 	mtp_int32 ret = 0;
 	dir_entry_t dir_info = { { 0 }, 0 };
@@ -158,26 +324,6 @@ static void __process_object_added_event(mtp_char *fullpath,
 	retm_if(g_strrstr(file_name, MTP_TEMP_FILE), "File is a temp file\n");
 	retm_if(file_name[0] == '.', "Hidden file filename=[%s]\n", file_name);
 
-	store_id = _entity_get_store_id_by_path(fullpath);
-	store = _device_get_store(store_id);
-	retm_if(!store, "store is NULL so return\n");
-
-	parent_obj = _entity_get_object_from_store_by_path(store, parent_path);
-	if (NULL == parent_obj) {
-		char ext_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-		_util_get_external_path(ext_path);
-
-		if (!g_strcmp0(parent_path, ext_path)) {
-			DBG("parent is the root folder\n");
-			h_parent = 0;
-		} else {
-			DBG("Cannot find the parent, return\n");
-			return;
-		}
-	} else {
-		h_parent = parent_obj->obj_handle;
-	}
-
 	ret = stat(fullpath, &stat_buf);
 	if (ret < 0) {
 		ERR("stat() Fail\n");
@@ -188,6 +334,8 @@ static void __process_object_added_event(mtp_char *fullpath,
 	g_strlcpy(dir_info.filename, fullpath, MTP_MAX_PATHNAME_SIZE + 1);
 	dir_info.attrs.mtime = stat_buf.st_mtime;
 	dir_info.attrs.fsize = (mtp_uint64)stat_buf.st_size;
+	dir_info.attrs.dev = (mtp_uint64)stat_buf.st_dev;
+	dir_info.attrs.ino = (mtp_uint64)stat_buf.st_ino;
 
 	/* Reset the attributes */
 	dir_info.attrs.attribute = MTP_FILE_ATTR_MODE_NONE;
@@ -205,47 +353,99 @@ static void __process_object_added_event(mtp_char *fullpath,
 					(S_IWOTH & stat_buf.st_mode))) {
 			dir_info.attrs.attribute |= MTP_FILE_ATTR_MODE_READ_ONLY;
 		}
-
-		obj = _entity_add_file_to_store(store, h_parent, fullpath,
-				file_name, &dir_info);
-		retm_if(!obj, "_entity_add_file_to_store fail.\n");
 	} else if (S_ISDIR(stat_buf.st_mode)) {
 		dir_info.type = MTP_DIR_TYPE;
 		dir_info.attrs.attribute  |= MTP_FILE_ATTR_MODE_DIR;
-		obj = _entity_add_folder_to_store(store, h_parent, fullpath,
-				file_name, &dir_info);
-		retm_if(!obj, "_entity_add_folder_to_store fail.\n");
 	} else {
 		ERR("%s type is neither DIR nor FILE.\n", fullpath);
 		return;
 	}
 
-	_eh_send_event_req_to_eh_thread(EVENT_OBJECT_ADDED,
-			obj->obj_handle, 0, NULL);
+	UTIL_WRITE_LOCK(&g_store_lock);
+
+	store = _device_get_store_by_path(fullpath);
+	if (!store) {
+		ERR("store is NULL so return\n");
+		goto DONE;
+	}
+
+	parent_obj = _entity_get_object_from_store_by_path(store, parent_path);
+	if (NULL == parent_obj) {
+		if (!g_strcmp0(parent_path, store->root_path)) {
+			DBG("parent is the root folder\n");
+			h_parent = 0;
+		} else {
+			DBG("Cannot find the parent, return\n");
+			goto DONE;
+		}
+	} else {
+		h_parent = parent_obj->obj_handle;
+	}
+
+	if (dir_info.type == MTP_FILE_TYPE)
+		obj = _entity_add_file_to_store(store, h_parent, fullpath,
+				file_name, &dir_info);
+	else
+		obj = _entity_add_folder_to_store(store, h_parent, fullpath,
+				file_name, &dir_info);
+	if (obj)
+		obj_handle = obj->obj_handle;
+	else
+		ERR("Adding [%s] to the store fail.\n", fullpath);
+
+DONE:
+	UTIL_RW_UNLOCK(&g_store_lock);
+
+	if (obj_handle)
+		_eh_send_event_req_to_eh_thread(EVENT_OBJECT_ADDED,
+				obj_handle, 0, NULL);
 }
 
-/* LCOV_EXCL_START */
-static void __remove_inoti_watch(mtp_char *path)
+/*
+ * A file known to the store was rewritten outside MTP: refresh its
+ * size and drop the property values derived from its contents.
+ */
+static void __process_object_modified_event(mtp_char *fullpath)
 {
-	mtp_int32 i = 0;
-
-	for (i = 0; i < g_cnt_watch_folder; i++) {
-		if (g_inoti_watches[i].forlder_name == NULL)
-			continue;
+	mtp_store_t *store = NULL;
+	mtp_obj_t *obj = NULL;
+	struct stat stat_buf = { 0 };
 
-		if (g_strcmp0(g_inoti_watches[i].forlder_name, path) != 0)
-			continue;
+	if (stat(fullpath, &stat_buf) < 0) {
+		ERR("stat() Fail\n");
+		_util_print_error();
+		return;
+	}
 
-		g_free(g_inoti_watches[i].forlder_name);
-		g_inoti_watches[i].forlder_name = NULL;
-		inotify_rm_watch(g_inoti_fd, g_inoti_watches[i].wd);
-		g_inoti_watches[i].wd = 0;
+	UTIL_WRITE_LOCK(&g_store_lock);
 
-		break;
+	store = _device_get_store_by_path(fullpath);
+	if (store)
+		obj = _entity_get_object_from_store_by_path(store, fullpath);
+	if (obj && obj->obj_info) {
+		obj->obj_info->file_size = (mtp_uint64)stat_buf.st_size;
+		_prop_invalidate_obj_propvals(obj, PROP_CACHE_CONTENT);
+		_entity_invalidate_obj_info(obj);
 	}
 
-	if (i == g_cnt_watch_folder)
-		ERR("Path not found in g_noti_watches\n");
+	UTIL_RW_UNLOCK(&g_store_lock);
+}
+
+/* LCOV_EXCL_START */
+static void __remove_inoti_watch(mtp_char *path)
+{
+	inoti_watches_t *watch = NULL;
+
+	pthread_mutex_lock(&g_watch_lock);
+	watch = g_watches_by_path ?
+		g_hash_table_lookup(g_watches_by_path, path) : NULL;
+	if (watch)
+		__remove_watch_entry(watch);
+	pthread_mutex_unlock(&g_watch_lock);
+
+	/* Folders fanotify reports on have no watch of their own */
+	if (watch == NULL)
+		DBG("Path not found in g_noti_watches\n");
 }
 
 /* LCOV_EXCL_STOP */
@@ -256,7 +456,6 @@ static void __delete_children_from_store_inoti(mtp_store_t *store,
 	mtp_uint32 i = 0;
 	ptp_array_t child_arr = { 0 };
 	mtp_obj_t *child_obj = NULL;
-	slist_node_t *node = NULL;
 
 	__remove_inoti_watch(obj->file_path);
 
@@ -274,8 +473,7 @@ static void __delete_children_from_store_inoti(mtp_store_t *store,
 			__delete_children_from_store_inoti(store, child_obj);
 		}
 
-		node = _util_delete_node(&(store->obj_list), child_obj);
-		g_free(node);
+		_entity_detach_object_from_store(store, child_obj);
 		_entity_dealloc_mtp_obj(child_obj);
 	}
 
@@ -288,20 +486,22 @@ static void __process_object_deleted_event(mtp_char *fullpath,
 	mtp_obj_t *obj = NULL;
 	mtp_obj_t *parent_obj = NULL;
 	mtp_store_t *store = NULL;
-	mtp_uint32 storageid = 0;
 	mtp_uint32 h_parent = 0;
 	mtp_uint32 obj_handle = 0;
-	slist_node_t *node = NULL;
 
 	retm_if(strstr(fullpath, MTP_TEMP_FILE), "File is a temp file, need to ignore\n");
 	retm_if(file_name[0] == '.', "Hidden file filename=[%s], Ignore\n", file_name);
 
-	storageid = _entity_get_store_id_by_path(fullpath);
-	store = _device_get_store(storageid);
-	retm_if(!store, "store is NULL so return\n");
+	UTIL_WRITE_LOCK(&g_store_lock);
 
-	obj = _entity_get_object_from_store_by_path(store, fullpath);
-	retm_if(!obj, "object is NULL so return\n");
+	store = _device_get_store_by_path(fullpath);
+	obj = store ? _entity_get_object_from_store_by_path(store, fullpath) :
+		NULL;
+	if (!obj) {
+		DBG("object is not in a store so return\n");
+		UTIL_RW_UNLOCK(&g_store_lock);
+		return;
+	}
 
 	obj_handle = obj->obj_handle;
 	h_parent = obj->obj_info->h_parent;
@@ -316,76 +516,61 @@ static void __process_object_deleted_event(mtp_char *fullpath,
 	if (TRUE == isdir)
 		__delete_children_from_store_inoti(store, obj);
 
-	node = _util_delete_node(&(store->obj_list), obj);
-	g_free(node);
+	_entity_detach_object_from_store(store, obj);
 	_entity_dealloc_mtp_obj(obj);
 
+	UTIL_RW_UNLOCK(&g_store_lock);
+
 	_eh_send_event_req_to_eh_thread(EVENT_OBJECT_REMOVED, obj_handle,
 			0, NULL);
 }
 
-static mtp_bool __process_inoti_event(struct inotify_event *event)
+/*
+ * Handles one change, with inotify's IN_* bits in mask whichever backend
+ * reported it. cookie pairs IN_MOVED_FROM with IN_MOVED_TO.
+ */
+static mtp_bool __process_fs_event(mtp_uint32 mask, mtp_uint32 cookie,
+		mtp_char *name, mtp_char *full_path, mtp_char *parentpath)
 {
-	static mtp_int32 last_moved_cookie = -1;
-
-	mtp_bool res = FALSE;
-	mtp_char full_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-	mtp_char parentpath[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-
-	if (event->len == 0 || event->len > MTP_MAX_FILENAME_SIZE) {
-		ERR_SECURE("Event len is invalid[%d], event->name[%s]\n", event->len,
-				event->name);
-		return FALSE;
-	} else if (event->wd < 1) {
-		ERR("invalid wd : %d\n", event->wd);
-		return FALSE;
-	}
-
-	/* start of one event */
-	res = __get_inoti_event_full_path(event->wd, event->name, full_path,
-			sizeof(full_path), parentpath);
-	retvm_if(!res, FALSE, "__get_inoti_event_full_path() Fail\n");
+	static mtp_int64 last_moved_cookie = -1;
 
 	retvm_if(!_util_is_path_len_valid(full_path), FALSE, "path len is invalid\n");
 
 	DBG_SECURE("Event full path = %s\n", full_path);
+	UTIL_READ_LOCK(&g_store_lock);
+	_device_set_store_space_dirty(full_path);
+	UTIL_RW_UNLOCK(&g_store_lock);
         memset(g_copy_dst_file, 0, MTP_MAX_PATHNAME_SIZE + 1);
         g_snprintf(g_copy_dst_file, MTP_MAX_PATHNAME_SIZE + 1, "%s", full_path);
 
-	if (event->mask & IN_MOVED_FROM) {
+	if (mask & IN_MOVED_FROM) {
 		if (!g_strcmp0(g_last_moved, full_path)) {
 			/* Ignore this case as this is generated due to MTP*/
 			DBG("[%s] is moved_from by MTP\n", full_path);
 			memset(g_last_moved, 0,
 					MTP_MAX_PATHNAME_SIZE + 1);
-			last_moved_cookie = event->cookie;
-		} else if (event->mask & IN_ISDIR) {
+			last_moved_cookie = cookie;
+		} else if (mask & IN_ISDIR) {
 			DBG("IN_MOVED_FROM --> IN_ISDIR\n");
-			UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 			__process_object_deleted_event(full_path,
-					event->name, TRUE);
-			UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+					name, TRUE);
 		} else {
 			DBG("IN_MOVED_FROM --> NOT IN_ISDIR\n");
-			UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 			__process_object_deleted_event(full_path,
-					event->name, FALSE);
-			UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+					name, FALSE);
 		}
-	} else if (event->mask & IN_MOVED_TO) {
+	} else if (mask & IN_MOVED_TO) {
 		DBG("Moved To event, path = [%s]\n", full_path);
-		if (last_moved_cookie == event->cookie) {
+		if (last_moved_cookie == cookie) {
 			/* Ignore this case as this is generated due to MTP*/
 			DBG("%s  is moved_to by MTP\n", full_path);
 			last_moved_cookie = -1;
 		} else {
-			UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 			__process_object_added_event(full_path,
-					event->name, parentpath);
-			UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+					name, parentpath);
 		}
-	} else if (event->mask & IN_CREATE) {
-		if (event->mask & IN_ISDIR) {
+	} else if (mask & IN_CREATE) {
+		if (mask & IN_ISDIR) {
 			DBG("IN_CREATE --> IN_ISDIR\n");
 			if (!g_strcmp0(g_last_created_dir, full_path)) {
 				/* Ignore this case as this is generated due to MTP*/
@@ -394,63 +579,49 @@ static mtp_bool __process_inoti_event(struct inotify_event *event)
 				memset(g_last_created_dir, 0,
 						MTP_MAX_PATHNAME_SIZE + 1);
 			} else {
-				UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 				__process_object_added_event(full_path,
-						event->name, parentpath);
-				UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+						name, parentpath);
 			}
 		} else {
-			if (FALSE == __add_file_to_inoti_open_files_list(event->wd,
-						event->name)) {
-				DBG_SECURE("__add_file_to_inoti_open_files_list fail\
-						%s\n", event->name);
+			if (FALSE == __add_file_to_inoti_open_files(full_path)) {
+				DBG_SECURE("__add_file_to_inoti_open_files fail\
+						%s\n", name);
 			}
 			DBG("IN_CREATE --> NOT IN_ISDIR\n");
 		}
-	} else if (event->mask &  IN_DELETE) {
+	} else if (mask &  IN_DELETE) {
 		if (!g_strcmp0(g_last_deleted, full_path)) {
 			/* Ignore this case as this is generated due to MTP*/
 			DBG("%s  is deleted by MTP\n", full_path);
 			memset(g_last_deleted, 0,
 					MTP_MAX_PATHNAME_SIZE + 1);
-		} else if (event->mask & IN_ISDIR) {
+		} else if (mask & IN_ISDIR) {
 			DBG("IN_DELETE --> IN_ISDIR\n");
-			UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 			__process_object_deleted_event(full_path,
-					event->name, TRUE);
-			UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+					name, TRUE);
 		} else {
 			DBG("IN_DELETE --> NOT IN_ISDIR\n");
-			UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
 			__process_object_deleted_event(full_path,
-					event->name, FALSE);
-			UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+					name, FALSE);
 		}
-	} else if (event->mask & IN_CLOSE_WRITE) {
-		DBG_SECURE("IN_CLOSE_WRITE %d, %s\n", event->wd, event->name);
+	} else if (mask & IN_CLOSE_WRITE) {
+		DBG_SECURE("IN_CLOSE_WRITE %s\n", full_path);
 		if (!g_strcmp0(g_last_copied, full_path)) {
 			/* Ignore this case as this is generated due to MTP*/
 			DBG("[%s] is copied by MTP\n", full_path);
 			memset(g_last_copied, 0,
 					MTP_MAX_PATHNAME_SIZE + 1);
                 } else if (g_is_send_partial_object) {
-                        UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
-                        __process_object_added_event(full_path, event->name, parentpath);
-                        UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
+                        __process_object_added_event(full_path, name, parentpath);
 
                         g_is_send_partial_object = false;
                         memset(g_copy_dst_file, 0, MTP_MAX_PATHNAME_SIZE + 1);
                 } else {
-			open_files_info_t *node = NULL;
-			node = __find_file_in_inoti_open_files_list(event->wd,
-					event->name);
-
-			if (node != NULL) {
-				UTIL_LOCK_MUTEX(&g_cmd_inoti_mutex);
+			if (__remove_file_from_inoti_open_files(full_path)) {
 				__process_object_added_event(full_path,
-						event->name, parentpath);
-				UTIL_UNLOCK_MUTEX(&g_cmd_inoti_mutex);
-				__remove_file_from_inoti_open_files_list(node);
+						name, parentpath);
+			} else {
+				__process_object_modified_event(full_path);
 			}
 		}
 	} else {
@@ -461,64 +632,240 @@ static mtp_bool __process_inoti_event(struct inotify_event *event)
 	return TRUE;
 }
 
-static void __destroy_inoti_open_files_list()
+static mtp_bool __process_inoti_event(struct inotify_event *event)
 {
-	open_files_info_t *current = NULL;
+	mtp_bool res = FALSE;
+	mtp_char full_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_char parentpath[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
 
-	ret_if(g_open_files_list == NULL);
+	if (event->mask & IN_Q_OVERFLOW) {
+		ERR("inotify queue overflow, stores are checked again\n");
+		_device_resync_stores();
+		return TRUE;
+	}
 
-	/* LCOV_EXCL_START */
-	while (g_open_files_list) {
-		current = g_open_files_list;
-		g_open_files_list = g_open_files_list->previous;
+	if (event->len == 0 || event->len > MTP_MAX_FILENAME_SIZE) {
+		ERR_SECURE("Event len is invalid[%d], event->name[%s]\n", event->len,
+				event->name);
+		return FALSE;
+	} else if (event->wd < 1) {
+		ERR("invalid wd : %d\n", event->wd);
+		return FALSE;
+	}
+
+	/* start of one event */
+	res = __get_inoti_event_full_path(event->wd, event->name, full_path,
+			sizeof(full_path), parentpath);
+	retvm_if(!res, FALSE, "__get_inoti_event_full_path() Fail\n");
 
-		if (g_open_files_list)
-			g_open_files_list->next = NULL;
+	return __process_fs_event(event->mask, event->cookie, event->name,
+			full_path, parentpath);
+}
+
+#ifdef INOTI_SUPPORT_FANOTIFY
+/* LCOV_EXCL_START */
+/*
+ * Finds the folder of a fanotify event from its handle. Changes outside
+ * the marked storages, elsewhere on their filesystems, are dropped here.
+ */
+static mtp_bool __get_fanoti_event_parent_path(
+		struct fanotify_event_info_fid *fid, mtp_char *parent_path,
+		mtp_int32 path_len)
+{
+	mtp_char proc_path[32] = { 0 };
+	mtp_int32 mount_fd = -1;
+	mtp_int32 dir_fd = -1;
+	mtp_int32 len = 0;
+	mtp_int32 ii = 0;
+	mtp_bool ret = FALSE;
 
-		g_free(current->name);
-		current->wd = 0;
-		current->previous = NULL;
-		current->next = NULL;
-		g_free(current);
+	pthread_mutex_lock(&g_watch_lock);
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		if (g_fanoti_stores[ii].is_marked &&
+				!memcmp(&(g_fanoti_stores[ii].fsid), &(fid->fsid),
+					sizeof(fsid_t))) {
+			mount_fd = g_fanoti_stores[ii].mount_fd;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&g_watch_lock);
+	retv_if(mount_fd < 0, FALSE);
+
+	/* The folder may be gone already */
+	dir_fd = open_by_handle_at(mount_fd, (struct file_handle *)fid->handle,
+			O_PATH | O_CLOEXEC);
+	retv_if(dir_fd < 0, FALSE);
+
+	g_snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", dir_fd);
+	len = readlink(proc_path, parent_path, path_len - 1);
+	close(dir_fd);
+	retv_if(len <= 0, FALSE);
+	parent_path[len] = '\0';
+
+	/* The link is canonical, storage roots need not be */
+	pthread_mutex_lock(&g_watch_lock);
+	ret = __get_fanoti_config_path(parent_path, path_len);
+	pthread_mutex_unlock(&g_watch_lock);
+
+	return ret;
+}
 
-	g_open_files_list = NULL;
-	/* LCOV_EXCL_STOP */
+/*
+ * Hands a fanotify event to __process_fs_event(). fanotify may merge
+ * several changes to one name into one event; they are replayed in the
+ * order they usually happen in. There are no move cookies: 0 still pairs
+ * a move made by MTP with the IN_MOVED_TO that follows it.
+ */
+static mtp_bool __process_fanoti_event(struct fanotify_event_metadata *meta)
+{
+	static const mtp_uint32 order[][2] = {
+		{ FAN_CREATE, IN_CREATE },
+		{ FAN_MOVED_FROM, IN_MOVED_FROM },
+		{ FAN_MOVED_TO, IN_MOVED_TO },
+		{ FAN_CLOSE_WRITE, IN_CLOSE_WRITE },
+		{ FAN_DELETE, IN_DELETE },
+	};
+	struct fanotify_event_info_fid *fid = NULL;
+	struct file_handle *handle = NULL;
+	mtp_char *name = NULL;
+	mtp_char full_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_char parentpath[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_uint32 isdir = (meta->mask & FAN_ONDIR) ? IN_ISDIR : 0;
+	mtp_uint32 ii = 0;
+
+	retv_if(meta->event_len < sizeof(*meta) + sizeof(*fid), FALSE);
+
+	fid = (struct fanotify_event_info_fid *)(meta + 1);
+	retv_if(fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME, FALSE);
+
+	handle = (struct file_handle *)fid->handle;
+	name = (mtp_char *)(handle->f_handle + handle->handle_bytes);
+	if (name[0] == '\0' || !strcmp(name, ".") ||
+			strlen(name) > MTP_MAX_FILENAME_SIZE) {
+		ERR_SECURE("Event name is invalid[%s]\n", name);
+		return FALSE;
+	}
+
+	if (!__get_fanoti_event_parent_path(fid, parentpath,
+				sizeof(parentpath)))
+		return FALSE;
+
+	/* 2 is for / and null character */
+	retv_if(strlen(parentpath) + strlen(name) + 2 > sizeof(full_path),
+			FALSE);
+	g_snprintf(full_path, sizeof(full_path), "%s/%s", parentpath, name);
+
+	for (ii = 0; ii < sizeof(order) / sizeof(order[0]); ii++) {
+		if (meta->mask & order[ii][0])
+			__process_fs_event(order[ii][1] | isdir, 0, name,
+					full_path, parentpath);
+	}
+
+	return TRUE;
 }
 
-static void __remove_recursive_inoti_watch(mtp_char *path)
+static mtp_bool __read_fanoti_events(void)
 {
-	mtp_int32 i = 0;
-	mtp_char *res = NULL;
+	struct fanotify_event_metadata buffer[FANOTI_BUF_LEN /
+		sizeof(struct fanotify_event_metadata)];
+	struct fanotify_event_metadata *meta = buffer;
+	mtp_int32 length = 0;
 
-	for (i = 0; i < g_cnt_watch_folder; i++) {
-		if (g_inoti_watches[i].forlder_name == NULL)
+	length = read(g_fanoti_fd, buffer, sizeof(buffer));
+	if (length < 0) {
+		ERR("read() Fail\n");
+		_util_print_error();
+		return FALSE;
+	}
+
+	for (; FAN_EVENT_OK(meta, length); meta = FAN_EVENT_NEXT(meta, length)) {
+		retvm_if(meta->vers != FANOTIFY_METADATA_VERSION, FALSE,
+				"fanotify metadata version mismatch\n");
+
+		if (meta->mask & FAN_Q_OVERFLOW) {
+			ERR("fanotify queue overflow, stores are checked again\n");
+			_device_resync_stores();
 			continue;
+		}
+		__process_fanoti_event(meta);
+	}
+
+	return TRUE;
+}
+/* LCOV_EXCL_STOP */
+#endif /* INOTI_SUPPORT_FANOTIFY */
 
-		res = strstr(g_inoti_watches[i].forlder_name, path);
-		if (res == NULL)
+static void __destroy_inoti_open_files(void)
+{
+	ret_if(g_open_files == NULL);
+
+	g_hash_table_destroy(g_open_files);
+	g_open_files = NULL;
+}
+
+/* Removes the watches on path and every folder below it, needs g_watch_lock */
+static void __remove_recursive_inoti_watch(mtp_char *path)
+{
+	GHashTableIter iter;
+	gpointer value = NULL;
+	inoti_watches_t *watch = NULL;
+	mtp_uint32 len = strlen(path);
+
+	ret_if(g_watches_by_wd == NULL);
+
+	g_hash_table_iter_init(&iter, g_watches_by_wd);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		watch = (inoti_watches_t *)value;
+		if (strncmp(watch->forlder_name, path, len) != 0 ||
+				(watch->forlder_name[len] != '\0' &&
+				 watch->forlder_name[len] != '/'))
 			continue;
 
-		g_free(g_inoti_watches[i].forlder_name);
-		g_inoti_watches[i].forlder_name = NULL;
-		inotify_rm_watch(g_inoti_fd, g_inoti_watches[i].wd);
-		g_inoti_watches[i].wd = 0;
+		inotify_rm_watch(g_inoti_fd, watch->wd);
+		g_hash_table_remove(g_watches_by_path, watch->forlder_name);
+		g_hash_table_iter_remove(&iter);
+		g_is_watch_limit_reported = FALSE;
 	}
 }
 
 static void __clean_up_inoti(void *data)
 {
-	char ext_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-	_util_get_external_path(ext_path);
+	mtp_int32 ii = 0;
 
-	__remove_recursive_inoti_watch((mtp_char *)ext_path);
-	__destroy_inoti_open_files_list();
+	pthread_mutex_lock(&g_watch_lock);
+	for (ii = 0; ii < g_conf.num_storages; ii++)
+		__remove_recursive_inoti_watch(g_conf.storages[ii].path);
+
+	if (g_watches_by_wd) {
+		g_hash_table_destroy(g_watches_by_path);
+		g_hash_table_destroy(g_watches_by_wd);
+		g_watches_by_path = NULL;
+		g_watches_by_wd = NULL;
+	}
 
 	close(g_inoti_fd);
 	g_inoti_fd = 0;
+
+#ifdef INOTI_SUPPORT_FANOTIFY
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		if (g_fanoti_stores[ii].is_marked)
+			close(g_fanoti_stores[ii].mount_fd);
+		g_fanoti_stores[ii].is_marked = FALSE;
+		g_fanoti_stores[ii].is_tried = FALSE;
+		free(g_fanoti_stores[ii].real_root);
+		g_fanoti_stores[ii].real_root = NULL;
+	}
+	if (g_fanoti_fd > 0)
+		close(g_fanoti_fd);
+	g_fanoti_fd = 0;
+	g_is_fanoti_tried = FALSE;
+#endif /* INOTI_SUPPORT_FANOTIFY */
+	pthread_mutex_unlock(&g_watch_lock);
+
+	__destroy_inoti_open_files();
 }
 
-void *_thread_inoti(void *arg)
+static mtp_bool __read_inoti_events(void)
 {
 	mtp_int32 i = 0;
 	mtp_int32 length = 0;
@@ -526,31 +873,66 @@ void *_thread_inoti(void *arg)
 	mtp_char buffer[INOTI_BUF_LEN] = { 0 };
 	struct inotify_event *event = NULL;
 
+	length = read(g_inoti_fd, buffer, sizeof(buffer));
+	/* LCOV_EXCL_START */
+	if (length < 0) {
+		ERR("read() Fail\n");
+		_util_print_error();
+		return FALSE;
+	}
+
+	while (i < length) {
+		event = (struct inotify_event *)(&buffer[i]);
+		__process_inoti_event(event);
+		temp_idx = i + event->len + INOTI_EVENT_SIZE;
+		if (temp_idx > length)
+			break;
+		else
+			i = temp_idx;
+	}
+
+	return TRUE;
+	/* LCOV_EXCL_STOP */
+}
+
+void *_thread_inoti(void *arg)
+{
+	struct pollfd fds[2] = { { 0 }, };
+	mtp_int32 nfds = 1;
+
 	pthread_cleanup_push(__clean_up_inoti, NULL);
 
 	DBG("START INOTIFY SYSTEM\n");
 
+	fds[0].fd = g_inoti_fd;
+	fds[0].events = POLLIN;
+#ifdef INOTI_SUPPORT_FANOTIFY
+	if (g_fanoti_fd > 0) {
+		fds[1].fd = g_fanoti_fd;
+		fds[1].events = POLLIN;
+		nfds = 2;
+	}
+#endif /* INOTI_SUPPORT_FANOTIFY */
+
 	while (1) {
 		pthread_testcancel();
 		errno = 0;
-		i = 0;
-		length = read(g_inoti_fd, buffer, sizeof(buffer));
 		/* LCOV_EXCL_START */
-		if (length < 0) {
-			ERR("read() Fail\n");
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ERR("poll() Fail\n");
 			_util_print_error();
 			break;
 		}
 
-		while (i < length) {
-			event = (struct inotify_event *)(&buffer[i]);
-			__process_inoti_event(event);
-			temp_idx = i + event->len + INOTI_EVENT_SIZE;
-			if (temp_idx > length)
-				break;
-			else
-				i = temp_idx;
-		}
+		if ((fds[0].revents & POLLIN) && !__read_inoti_events())
+			break;
+#ifdef INOTI_SUPPORT_FANOTIFY
+		if (nfds > 1 && (fds[1].revents & POLLIN) &&
+				!__read_fanoti_events())
+			break;
+#endif /* INOTI_SUPPORT_FANOTIFY */
 	}
 
 	DBG("Inoti thread exited\n");
@@ -560,54 +942,92 @@ void *_thread_inoti(void *arg)
 	/* LCOV_EXCL_STOP */
 }
 
-void _inoti_add_watch_for_fs_events(mtp_char *path)
+/* LCOV_EXCL_START */
+/*
+ * inotify_add_watch() failed with ENOSPC: the user is out of inotify
+ * watches. Said once, until a watch is given back.
+ */
+static void __report_inoti_watch_limit(void)
 {
-	mtp_int32 i = 0;
+	FILE *fp = NULL;
+	mtp_int32 limit = -1;
 
-	ret_if(path == NULL);
+	ret_if(g_is_watch_limit_reported);
+	g_is_watch_limit_reported = TRUE;
 
-	if (g_cnt_watch_folder == INOTI_FOLDER_COUNT_MAX) {
-		/* find empty cell */
-		/* LCOV_EXCL_START */
-		for (i = 0; i < INOTI_FOLDER_COUNT_MAX; i++) {
-			/* If not empty */
-			if (g_inoti_watches[i].wd != 0)
-				continue;
-			else
-				break;
-		}
+	fp = fopen(INOTI_MAX_USER_WATCHES_PATH, "r");
+	if (fp) {
+		if (fscanf(fp, "%d", &limit) != 1)
+			limit = -1;
+		fclose(fp);
+	}
 
-		retm_if(i == INOTI_FOLDER_COUNT_MAX,
-			"no empty space for a new inotify watch.\n");
+	ERR("inotify watch limit reached : %u folders watched, %s is %d. "
+			"New folders are not watched until it is raised\n",
+			g_hash_table_size(g_watches_by_wd),
+			INOTI_MAX_USER_WATCHES_PATH, limit);
+}
+/* LCOV_EXCL_STOP */
 
-		DBG("g_watch_folders[%d] add watch : %s\n", i, path);
-		g_inoti_watches[i].forlder_name = g_strdup(path);
-		g_inoti_watches[i].wd = inotify_add_watch(g_inoti_fd,
-				g_inoti_watches[i].forlder_name,
-				IN_CLOSE_WRITE | IN_CREATE |
-				IN_DELETE | IN_MOVED_FROM |
-				IN_MOVED_TO);
+void _inoti_add_watch_for_fs_events(mtp_char *path)
+{
+	inoti_watches_t *watch = NULL;
+	mtp_int32 wd = 0;
+
+	ret_if(path == NULL);
+
+	pthread_mutex_lock(&g_watch_lock);
+	if (!__init_inoti_watches() ||
+#ifdef INOTI_SUPPORT_FANOTIFY
+			__is_fanoti_watched(path) ||
+#endif /* INOTI_SUPPORT_FANOTIFY */
+			g_hash_table_contains(g_watches_by_path, path)) {
+		pthread_mutex_unlock(&g_watch_lock);
 		return;
-		/* LCOV_EXCL_STOP */
 	}
 
-	DBG("g_watch_folders[%d] add watch : %s\n", g_cnt_watch_folder, path);
-	g_inoti_watches[g_cnt_watch_folder].forlder_name = g_strdup(path);
-	g_inoti_watches[g_cnt_watch_folder].wd = inotify_add_watch(g_inoti_fd,
-			g_inoti_watches[g_cnt_watch_folder].forlder_name,
-			IN_CLOSE_WRITE |
+	wd = inotify_add_watch(g_inoti_fd, path, IN_CLOSE_WRITE |
 			IN_CREATE | IN_DELETE |
 			IN_MOVED_FROM |
 			IN_MOVED_TO);
-	g_cnt_watch_folder++;
+	if (wd < 0) {
+		/* LCOV_EXCL_START */
+		if (errno == ENOSPC)
+			__report_inoti_watch_limit();
+		else
+			ERR_SECURE("inotify_add_watch() Fail : %s\n", path);
+		pthread_mutex_unlock(&g_watch_lock);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* The same folder under another name, after a rename */
+	watch = g_hash_table_lookup(g_watches_by_wd, GINT_TO_POINTER(wd));
+	if (watch) {
+		g_hash_table_remove(g_watches_by_path, watch->forlder_name);
+		g_free(watch->forlder_name);
+	} else {
+		watch = g_new0(inoti_watches_t, 1);
+		watch->wd = wd;
+		g_hash_table_insert(g_watches_by_wd, GINT_TO_POINTER(wd), watch);
+	}
+	watch->forlder_name = g_strdup(path);
+	g_hash_table_insert(g_watches_by_path, watch->forlder_name, watch);
+
+	DBG("g_watch_folders[%u] add watch : %s\n",
+			g_hash_table_size(g_watches_by_wd), path);
+	pthread_mutex_unlock(&g_watch_lock);
 }
 
 mtp_bool _inoti_init_filesystem_evnts()
 {
 	mtp_bool ret = FALSE;
 
-	g_inoti_fd = inotify_init();
-	retvm_if(g_inoti_fd < 0, FALSE, "inotify_init() Fail : g_inoti_fd = %d\n", g_inoti_fd);
+	/* Storages being loaded may have set it up already */
+	pthread_mutex_lock(&g_watch_lock);
+	ret = __init_inoti_watches();
+	pthread_mutex_unlock(&g_watch_lock);
+	retv_if(!ret, FALSE);
 
 	ret = _util_thread_create(&g_inoti_thrd, "File system inotify thread\n",
 			PTHREAD_CREATE_JOINABLE, _thread_inoti, NULL);
@@ -615,7 +1035,6 @@ mtp_bool _inoti_init_filesystem_evnts()
 		/* LCOV_EXCL_START */
 		ERR("_util_thread_create() Fail\n");
 		_util_print_error();
-		close(g_inoti_fd);
 		return FALSE;
 	}
 
@@ -157,6 +157,43 @@ mtp_uchar *_hdlr_alloc_buf_data_container(data_container_t *dst,
 	return (dst->data + sizeof(header_container_t));
 }
 
+/*
+ * Allocates a data block that is packed once and sent for many
+ * transactions. The payload starts sizeof(header_container_t) bytes into
+ * the block; *blk_len is the size of the whole block.
+ */
+mtp_uchar *_hdlr_alloc_prebuilt_data(mtp_uint32 bufsz, mtp_uint32 *blk_len)
+{
+	mtp_uchar *blk = NULL;
+
+	blk = (mtp_uchar *)g_malloc0(bufsz + sizeof(header_container_t));
+	retvm_if(!blk, NULL, "g_malloc0() Fail\n");
+
+	*blk_len = bufsz + sizeof(header_container_t);
+	return blk;
+}
+
+/*
+ * Makes dst send blk, made by _hdlr_alloc_prebuilt_data(), instead of a
+ * buffer of its own. Only the header is written for this transaction;
+ * dst does not own blk, which must not be freed with it.
+ */
+void _hdlr_set_prebuilt_data_container(data_container_t *dst,
+		mtp_uchar *blk, mtp_uint32 blk_len)
+{
+	header_container_t *header = (header_container_t *)blk;
+
+	dst->data = blk;
+	dst->len = blk_len;
+	header->len = blk_len;
+#ifdef __BIG_ENDIAN__
+	_util_conv_byte_order(&(header->len), sizeof(header->len));
+#endif /* __BIG_ENDIAN__ */
+	header->type = dst->type;
+	header->code = dst->code;
+	header->tid = dst->tid;
+}
+
 /* LCOV_EXCL_START */
 mtp_bool _hdlr_send_data_container(data_container_t *dst)
 {
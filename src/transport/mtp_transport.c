@@ -42,6 +42,8 @@ static pthread_t g_tx_thrd = 0;
 static pthread_t g_rx_thrd = 0;
 static pthread_t g_ctrl_thrd = 0;
 static pthread_t g_data_rcv = 0;
+static mtp_bool g_data_started = FALSE;
+static _cmd_handler_cb g_cmd_handler = NULL;
 static msgq_id_t mtp_to_usb_mqid;
 static msgq_id_t g_usb_to_mtp_mqid;
 static status_info_t _g_status;
@@ -279,7 +281,6 @@ static mtp_err_t __transport_init_io()
 	mtp_int32 res = 0;
 	thread_func_t usb_write_thread = _transport_thread_usb_write;
 	thread_func_t usb_read_thread = _transport_thread_usb_read;
-	thread_func_t usb_control_thread = _transport_thread_usb_control;
 
 	res = _util_thread_create(&g_tx_thrd, "usb write thread",
 			PTHREAD_CREATE_JOINABLE, usb_write_thread,
@@ -297,15 +298,6 @@ static mtp_err_t __transport_init_io()
 		goto cleanup;
 	}
 
-	res = _util_thread_create(&g_ctrl_thrd, "usb control thread",
-				  PTHREAD_CREATE_JOINABLE,
-				  usb_control_thread,
-				  NULL);
-	if (FALSE == res) {
-		ERR("CTRL thread creation failed\n");
-		goto cleanup;
-	}
-
 	g_usb_threads_created = TRUE;
 
 	return MTP_ERROR_NONE;
@@ -313,11 +305,6 @@ static mtp_err_t __transport_init_io()
 cleanup:
 	_util_print_error();
 
-	if (g_ctrl_thrd) {
-		res = _util_thread_cancel(g_ctrl_thrd);
-		DBG("pthread_cancel [%d]\n", res);
-		g_ctrl_thrd = 0;
-	}
 	if (g_rx_thrd) {
 		res = _util_thread_cancel(g_rx_thrd);
 		DBG("pthread_cancel [%d]\n", res);
@@ -339,17 +326,6 @@ static void __transport_deinit_io()
 
 	errno = 0;
 
-	if (FALSE == _util_thread_cancel(g_ctrl_thrd)) {
-		ERR("Fail to cancel pthread of g_ctrl_thrd\n");
-	} else {
-		DBG("Succeed to cancel pthread of g_ctrl_thrd\n");
-	}
-
-	if (_util_thread_join(g_ctrl_thrd, 0) == FALSE)
-		ERR("pthread_join of g_ctrl_thrd failed\n");
-
-	g_ctrl_thrd = 0;
-
 	if (FALSE == _util_thread_cancel(g_rx_thrd))
 		ERR("_util_thread_cancel(rx) Fail\n");
 
@@ -369,6 +345,39 @@ static void __transport_deinit_io()
 	g_usb_threads_created = FALSE;
 }
 
+/*
+ * The control thread lives as long as the endpoints, so that it sees the
+ * host come back after a disconnect.
+ */
+static mtp_bool __transport_init_ctrl()
+{
+	if (FALSE == _util_thread_create(&g_ctrl_thrd, "usb control thread",
+				PTHREAD_CREATE_JOINABLE,
+				_transport_thread_usb_control, NULL)) {
+		ERR("CTRL thread creation failed\n");
+		g_ctrl_thrd = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void __transport_deinit_ctrl()
+{
+	ret_if(g_ctrl_thrd == 0);
+
+	if (FALSE == _util_thread_cancel(g_ctrl_thrd)) {
+		ERR("Fail to cancel pthread of g_ctrl_thrd\n");
+	} else {
+		DBG("Succeed to cancel pthread of g_ctrl_thrd\n");
+	}
+
+	if (_util_thread_join(g_ctrl_thrd, 0) == FALSE)
+		ERR("pthread_join of g_ctrl_thrd failed\n");
+
+	g_ctrl_thrd = 0;
+}
+
 static void *__transport_thread_data_rcv(void *func)
 {
 	msgq_ptr_t pkt = { 0 };
@@ -411,25 +420,20 @@ static void *__transport_thread_data_rcv(void *func)
 	return NULL;
 }
 
-mtp_bool _transport_init_interfaces(_cmd_handler_cb func)
+/*
+ * Starts the message queues, the bulk endpoint threads and the thread
+ * running the commands, on top of endpoints that are already open.
+ */
+static mtp_bool __transport_start_data(_cmd_handler_cb func)
 {
 	mtp_int32 res = 0;
-	mtp_bool ret = FALSE;
-
-	ret = _transport_init_usb_device();
-	/* mtp driver open failed */
-	retvm_if(!ret, FALSE, "_transport_init_usb_device() Fail\n");
 
-	if (_transport_mq_init(&g_usb_to_mtp_mqid, &mtp_to_usb_mqid) == FALSE) {
-		ERR("_transport_mq_init() Fail\n");
-		_transport_deinit_usb_device();
-		return FALSE;
-	}
+	retvm_if(_transport_mq_init(&g_usb_to_mtp_mqid, &mtp_to_usb_mqid) == FALSE,
+			FALSE, "_transport_mq_init() Fail\n");
 
 	if (__transport_init_io() != MTP_ERROR_NONE) {
 		ERR("__transport_init_io() Fail\n");
 		_transport_mq_deinit(&g_usb_to_mtp_mqid, &mtp_to_usb_mqid);
-		_transport_deinit_usb_device();
 		return FALSE;
 	}
 
@@ -438,22 +442,27 @@ mtp_bool _transport_init_interfaces(_cmd_handler_cb func)
 			(void *)func);
 	if (res == FALSE) {
 		ERR("_util_thread_create(data_rcv) Fail\n");
+		g_data_rcv = 0;
 		__transport_deinit_io();
 		_transport_mq_deinit(&g_usb_to_mtp_mqid, &mtp_to_usb_mqid);
-		_transport_deinit_usb_device();
 		return FALSE;
 	}
 
+	g_cmd_handler = func;
+	g_data_started = TRUE;
+
 	return TRUE;
 }
 
-void _transport_usb_finalize(void)
+static void __transport_stop_data(void)
 {
 	mtp_int32 res = 0;
 	void *th_result = NULL;
 	msgq_ptr_t pkt;
 	mtp_uint32 rx_size = g_conf.read_usb_size;
 
+	ret_if(!g_data_started);
+
 	__transport_deinit_io();
 
 	if (g_data_rcv != 0) {
@@ -473,10 +482,58 @@ void _transport_usb_finalize(void)
 		res = _util_thread_join(g_data_rcv, &th_result);
 		if (res == FALSE)
 			ERR("_util_thread_join(data_rcv) Fail\n");
+		g_data_rcv = 0;
 	}
 
 	if (_transport_mq_deinit(&g_usb_to_mtp_mqid, &mtp_to_usb_mqid) == FALSE)
 		ERR("_transport_mq_deinit() Fail\n");
 
+	g_data_started = FALSE;
+}
+
+mtp_bool _transport_init_interfaces(_cmd_handler_cb func)
+{
+	mtp_bool ret = FALSE;
+
+	ret = _transport_init_usb_device();
+	/* mtp driver open failed */
+	retvm_if(!ret, FALSE, "_transport_init_usb_device() Fail\n");
+
+	if (__transport_start_data(func) == FALSE) {
+		_transport_deinit_usb_device();
+		return FALSE;
+	}
+
+	if (__transport_init_ctrl() == FALSE) {
+		__transport_stop_data();
+		_transport_deinit_usb_device();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Stops the data path when the host goes away. The endpoints and the
+ * control thread are kept, so that the service can resume without being
+ * restarted.
+ */
+void _transport_suspend_interfaces(void)
+{
+	__transport_stop_data();
+}
+
+mtp_bool _transport_resume_interfaces(void)
+{
+	retv_if(g_data_started, TRUE);
+	retvm_if(g_cmd_handler == NULL, FALSE, "Interfaces were never started\n");
+
+	return __transport_start_data(g_cmd_handler);
+}
+
+void _transport_usb_finalize(void)
+{
+	__transport_deinit_ctrl();
+	__transport_stop_data();
 	_transport_deinit_usb_device();
 }
@@ -363,11 +363,12 @@ void *_transport_thread_usb_control(void *arg)
 		case FUNCTIONFS_ENABLE:
 			DBG("ENABLE\n");
 			g_ph_status->usb_state = MTP_PHONE_USB_CONNECTED;
+			_eh_send_event_req_to_eh_thread(EVENT_USB_CONNECTED, 0, 0, NULL);
 			break;
 		case FUNCTIONFS_DISABLE:
 			DBG("DISABLE\n");
 			g_ph_status->usb_state = MTP_PHONE_USB_DISCONNECTED;
-			_eh_send_event_req_to_eh_thread(EVENT_USB_REMOVED, 0, 0, NULL);
+			_eh_send_event_req_to_eh_thread(EVENT_USB_DISCONNECTED, 0, 0, NULL);
 			break;
 		}
 	} while (status > 0);
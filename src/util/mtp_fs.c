@@ -23,6 +23,8 @@
 #include <sys/sendfile.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <dirent.h>
 #include <glib.h>
 #include <glib/gprintf.h>
@@ -281,6 +283,7 @@ mtp_bool _util_copy_dir_children_recursive(const mtp_char *origpath,
 		memset(new_obj, 0, sizeof(mtp_obj_t));
 
 		new_obj->child_array.type = UINT32_TYPE;
+		new_obj->children.type = UINT32_TYPE;
 		_entity_copy_mtp_object(new_obj, orig_obj);
 		if (new_obj->obj_info == NULL) {
 			_entity_dealloc_mtp_obj(new_obj);
@@ -305,6 +308,7 @@ mtp_bool _util_copy_dir_children_recursive(const mtp_char *origpath,
 			}
 
 			/* The directory is created. Add object to mtp store */
+			_entity_refresh_object_identity(new_obj);
 			_entity_add_object_to_store(store, new_obj);
 
 			if (FALSE == _util_copy_dir_children_recursive(old_pathname,
@@ -345,6 +349,7 @@ mtp_bool _util_copy_dir_children_recursive(const mtp_char *origpath,
 			}
 #endif /* MTP_SUPPORT_SET_PROTECTION */
 			/* The file is created. Add object to mtp store */
+			_entity_refresh_object_identity(new_obj);
 			_entity_add_object_to_store(store, new_obj);
 		}
 DONE:
@@ -402,101 +407,6 @@ mtp_bool _util_dir_create(const mtp_char *dirname, mtp_int32 *error)
 	return TRUE;
 }
 
-mtp_int32 _util_remove_dir_children_recursive(const mtp_char *dirname,
-		mtp_uint32 *num_of_deleted_file, mtp_uint32 *num_of_file, mtp_bool breadonly)
-{
-	retv_if(dirname == NULL, FALSE);
-
-	DIR *dir = NULL;
-	struct dirent entry = { 0 };
-	struct dirent *entryptr = NULL;
-	mtp_int32 retval = 0;
-	mtp_char pathname[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
-	struct stat entryinfo;
-	mtp_int32 ret = MTP_ERROR_NONE;
-
-	/* Open the given directory */
-	dir = opendir(dirname);
-	if (dir == NULL) {
-		ERR("Open directory Fail[%s], errno [%d]\n", dirname, errno);
-		return MTP_ERROR_GENERAL;
-	}
-
-	retval = do_readdir_r(dir, &entry, &entryptr);
-
-	while (retval == 0 && entryptr != NULL) {
-		/* Skip the names "." and ".."
-		   as we don't want to recurse on them. */
-		if (!g_strcmp0(entry.d_name, ".") ||
-				!g_strcmp0(entry.d_name, "..")) {
-			retval = do_readdir_r(dir, &entry, &entryptr);
-			continue;
-		}
-		g_snprintf(pathname, MTP_MAX_PATHNAME_SIZE + 1,
-				"%s/%s", dirname, entry.d_name);
-		if (stat(pathname, &entryinfo) != 0) {
-			ERR("Error statting %s errno [%d]\n", pathname, errno);
-			closedir(dir);
-			return MTP_ERROR_GENERAL;
-		}
-		*num_of_file += 1;
-		if (S_ISDIR(entryinfo.st_mode)) {
-			ret = _util_remove_dir_children_recursive(pathname,
-					num_of_deleted_file, num_of_file, breadonly);
-			if (MTP_ERROR_GENERAL == ret || MTP_ERROR_ACCESS_DENIED == ret) {
-				ERR("deletion fail [%s]\n", pathname);
-				closedir(dir);
-				return ret;
-			}
-			if (MTP_ERROR_OBJECT_WRITE_PROTECTED == ret) {
-				DBG("Folder[%s] contains read-only files,hence\
-						folder is not deleted\n", pathname);
-				/* Read the next entry */
-				goto DONE;
-			}
-			if (rmdir(pathname) < 0) {
-				ERR("deletion fail [%s], errno [%d]\n", pathname, errno);
-				closedir(dir);
-				if (EACCES == errno)
-					return MTP_ERROR_ACCESS_DENIED;
-				return MTP_ERROR_GENERAL;
-			}
-			*num_of_deleted_file += 1;
-		} else {
-			/* Only during Deleteobject, bReadOnly(TRUE)
-			   do not delete read-only files */
-#ifdef MTP_SUPPORT_SET_PROTECTION
-			if (breadonly) {
-				/* check for file attributes */
-				if (!((S_IWUSR & entryinfo.st_mode) ||
-							(S_IWGRP & entryinfo.st_mode) ||
-							(S_IWOTH & entryinfo.st_mode))) {
-					ret = MTP_ERROR_OBJECT_WRITE_PROTECTED;
-					DBG("File [%s] is readOnly:Deletion Fail\n", pathname);
-					goto DONE;
-				}
-			}
-#endif /* MTP_SUPPORT_SET_PROTECTION */
-			if (unlink(pathname) < 0) {
-				ERR("deletion fail [%s], errno [%d]\n", pathname, errno);
-				closedir(dir);
-				if (EACCES == errno)
-					return MTP_ERROR_ACCESS_DENIED;
-				return MTP_ERROR_GENERAL;
-			}
-			*num_of_deleted_file += 1;
-		}
-DONE:
-		retval = do_readdir_r(dir, &entry, &entryptr);
-		if (retval != 0) {
-			closedir(dir);
-			return MTP_ERROR_GENERAL;
-		}
-	}
-
-	closedir(dir);
-	return ret;
-}
 /* LCOV_EXCL_STOP */
 
 /*
@@ -519,6 +429,8 @@ mtp_bool _util_get_file_attrs(const mtp_char *filename, file_attr_t *attrs)
 	attrs->fsize = (mtp_uint64)fileinfo.st_size;
 	attrs->ctime = fileinfo.st_ctime;
 	attrs->mtime = fileinfo.st_mtime;
+	attrs->dev = (mtp_uint64)fileinfo.st_dev;
+	attrs->ino = (mtp_uint64)fileinfo.st_ino;
 
 	/*Reset attribute mode */
 	attrs->attribute = MTP_FILE_ATTR_MODE_NONE;
@@ -566,37 +478,60 @@ mtp_bool _util_set_file_attrs(const mtp_char *filename, mtp_dword attrib)
 }
 /* LCOV_EXCL_STOP */
 
+/* Record returned by getdents64, which glibc does not declare */
+struct mtp_dirent64 {
+	mtp_uint64 d_ino;
+	mtp_int64 d_off;
+	mtp_uint16 d_reclen;
+	mtp_uchar d_type;
+	mtp_char d_name[];
+};
+
 /*
- * mtp_bool _util_ifind_first(mtp_char *dirname, DIR **dirp,
+ * mtp_bool _util_ifind_first(mtp_char *dirname, mtp_dir_t **dirp,
  *	dir_entry_t *dir_info)
  * This function finds the first file in the directory stream.
  *
  * @param[in]		dirname		specifies the name of directory.
- * @param[out]		dirp		pointer to the directory stream.
+ * @param[out]		dirp		pointer to the directory stream,
+ *					released with _util_ifind_close().
  * @param[in]		dir_info	pointer to the file information.
  * @return		This function returns TRUE on success, otherwise FALSE.
  */
-mtp_bool _util_ifind_first(mtp_char *dirname, DIR **dirp, dir_entry_t *dir_info)
+mtp_bool _util_ifind_first(mtp_char *dirname, mtp_dir_t **dirp,
+		dir_entry_t *dir_info)
 {
-	DIR *dir;
+	mtp_dir_t *dir;
+	struct stat stat_buf = { 0 };
 
 	retv_if(dirp == NULL, FALSE);
 	retv_if(dirname == NULL, FALSE);
 	retv_if(dir_info == NULL, FALSE);
 
-	dir = opendir(dirname);
-	if (NULL == dir) {
+	dir = (mtp_dir_t *)g_malloc(sizeof(mtp_dir_t));
+	dir->buf_len = 0;
+	dir->buf_pos = 0;
+	dir->error = 0;
+	dir->fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir->fd < 0) {
 		/* LCOV_EXCL_START */
-		ERR("opendir(%s) Fail\n", dirname);
+		ERR("open(%s) Fail\n", dirname);
 		_util_print_error();
+		g_free(dir);
 
 		return FALSE;
 	}
 
+	dir->mtime = 0;
+	if (fstat(dir->fd, &stat_buf) == 0) {
+		dir->mtime = (mtp_int64)stat_buf.st_mtim.tv_sec * 1000000000LL +
+			stat_buf.st_mtim.tv_nsec;
+	}
+
 	if (_util_ifind_next(dirname, dir, dir_info) == FALSE) {
 		DBG("Stop enumeration\n");
 		_util_print_error();
-		closedir(dir);
+		_util_ifind_close(dir);
 		return FALSE;
 		/* LCOV_EXCL_STOP */
 	}
@@ -607,54 +542,141 @@ mtp_bool _util_ifind_first(mtp_char *dirname, DIR **dirp, dir_entry_t *dir_info)
 }
 
 /*
- * mtp_bool _util_ifind_next(mtp_char *dirname, DIR *dirp, dir_entry_t *dir_info)
+ * Next record of the stream, refilling the buffer one batch at a time.
+ * NULL is returned both at the end of the stream and on a read error,
+ * which leaves its errno in dirp->error.
+ */
+static struct mtp_dirent64 *__read_dirent(mtp_dir_t *dirp)
+{
+	struct mtp_dirent64 *ent = NULL;
+	long len = 0;
+
+	if (dirp->error != 0)
+		return NULL;
+
+	if (dirp->buf_pos >= dirp->buf_len) {
+		len = syscall(SYS_getdents64, dirp->fd, dirp->buf,
+				sizeof(dirp->buf));
+		if (len < 0) {
+			dirp->error = errno;
+			ERR("getdents64 Fail : %d\n", dirp->error);
+			return NULL;
+		}
+		if (len == 0)
+			return NULL;
+
+		dirp->buf_len = (mtp_int32)len;
+		dirp->buf_pos = 0;
+	}
+
+	ent = (struct mtp_dirent64 *)((mtp_char *)dirp->buf + dirp->buf_pos);
+	dirp->buf_pos += ent->d_reclen;
+
+	return ent;
+}
+
+/*
+ * Stats name relative to the directory fd, flags being 0 or
+ * AT_SYMLINK_NOFOLLOW. Only the fields _util_ifind_next() fills in are
+ * asked for, and the file system is not asked to sync them first.
+ */
+static mtp_bool __stat_dirent(mtp_int32 dir_fd, const mtp_char *name,
+		mtp_int32 flags, mode_t *mode, file_attr_t *attrs)
+{
+	struct stat stat_buf = { 0 };
+#ifdef STATX_TYPE
+	struct statx stx;
+
+	if (statx(dir_fd, name, flags | AT_STATX_DONT_SYNC,
+				STATX_TYPE | STATX_MODE | STATX_SIZE |
+				STATX_MTIME | STATX_INO, &stx) == 0) {
+		*mode = stx.stx_mode;
+		attrs->fsize = stx.stx_size;
+		attrs->mtime = stx.stx_mtime.tv_sec;
+		attrs->dev = (mtp_uint64)makedev(stx.stx_dev_major,
+				stx.stx_dev_minor);
+		attrs->ino = stx.stx_ino;
+		return TRUE;
+	}
+	if (errno != ENOSYS)
+		return FALSE;
+#endif /* STATX_TYPE */
+
+	if (fstatat(dir_fd, name, &stat_buf, flags) < 0)
+		return FALSE;
+
+	*mode = stat_buf.st_mode;
+	attrs->fsize = (mtp_uint64)stat_buf.st_size;
+	attrs->mtime = stat_buf.st_mtime;
+	attrs->dev = (mtp_uint64)stat_buf.st_dev;
+	attrs->ino = (mtp_uint64)stat_buf.st_ino;
+	return TRUE;
+}
+
+/*
+ * mtp_bool _util_ifind_next(mtp_char *dirname, mtp_dir_t *dirp,
+ *	dir_entry_t *dir_info)
  * This function finds the next successive file in the directory stream.
+ * Size and modification time of the entries reported as directories by
+ * getdents64 are left 0. They are still stat'ed for their device and
+ * inode, which d_ino and the parent device get wrong at a mount point. FALSE is also returned
+ * when the stream cannot be read, with dirp->error set.
  *
  * @param[in]		dirname		name of the directory.
  * @param[in]		dirp		pointer to the directory stream.
  * @param[out]		dir_info	Points the file information.
  * @return		This function returns TRUE on success, otherwise FALSE.
  */
-mtp_bool _util_ifind_next(mtp_char *dir_name, DIR *dirp, dir_entry_t *dir_info)
+mtp_bool _util_ifind_next(mtp_char *dir_name, mtp_dir_t *dirp,
+		dir_entry_t *dir_info)
 {
-	mtp_int32 ret = 0;
-	struct dirent entry = {0};
-	struct stat stat_buf = {0};
-	struct dirent *result = NULL;
-	mtp_char path_name[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	struct mtp_dirent64 *ent = NULL;
+	file_attr_t attrs = { 0 };
+	mode_t mode = 0;
 
 	retv_if(dir_name == NULL, FALSE);
+	retv_if(dirp == NULL, FALSE);
 	retv_if(dir_info == NULL, FALSE);
 
 	do {
-		ret = do_readdir_r(dirp, &entry, &result);
-		if (ret != 0) {
-			ERR("do_readdir_r Fail : %d\n", ret);
-			return FALSE;
-		} else if (result == NULL) {
-			DBG("There is no more entry\n");
+		ent = __read_dirent(dirp);
+		if (ent == NULL) {
+			if (dirp->error == 0)
+				DBG("There is no more entry\n");
 			return FALSE;
 		}
 
-		if (_util_create_path(path_name, sizeof(path_name),
-					dir_name, entry.d_name) == FALSE) {
+		if (_util_create_path(dir_info->filename,
+					sizeof(dir_info->filename), dir_name,
+					ent->d_name) == FALSE) {
 			continue;
 		}
 
-		if (stat(path_name, &stat_buf) < 0) {
-			ERR_SECURE("stat Fail, skip [%s]\n", path_name);
+		if (ent->d_type == DT_DIR) {
+			if (!__stat_dirent(dirp->fd, ent->d_name,
+						AT_SYMLINK_NOFOLLOW, &mode, &attrs)) {
+				ERR_SECURE("stat Fail, skip [%s]\n",
+						dir_info->filename);
+				continue;
+			}
+			attrs.fsize = 0;
+			attrs.mtime = 0;
+			break;
+		}
+
+		if (!__stat_dirent(dirp->fd, ent->d_name, 0, &mode, &attrs)) {
+			ERR_SECURE("stat Fail, skip [%s]\n", dir_info->filename);
 			continue;
 		}
 		break;
 	} while (1);
 
-	g_strlcpy(dir_info->filename, path_name, sizeof(dir_info->filename));
 	dir_info->attrs.attribute = MTP_FILE_ATTR_MODE_NONE;
 
-	switch (stat_buf.st_mode & S_IFMT) {
+	switch (mode & S_IFMT) {
 	case S_IFREG:
 		dir_info->type = MTP_FILE_TYPE;
-		if (!(stat_buf.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
+		if (!(mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
 			dir_info->attrs.attribute |= MTP_FILE_ATTR_MODE_READ_ONLY;
 		break;
 
@@ -669,49 +691,233 @@ mtp_bool _util_ifind_next(mtp_char *dir_name, DIR *dirp, dir_entry_t *dir_info)
 	case S_IFLNK:
 	case S_IFSOCK:
 	/* LCOV_EXCL_START */
+		dir_info->type = MTP_ALL_TYPE;
 		dir_info->attrs.attribute |= MTP_FILE_ATTR_MODE_SYSTEM;
 		break;
 
 	default:
+		dir_info->type = MTP_ALL_TYPE;
 		dir_info->attrs.attribute |= MTP_FILE_ATTR_MODE_SYSTEM;
 		ERR_SECURE("%s has unknown type. mode[0x%x]\n",
-				dir_info->filename, stat_buf.st_mode);
+				dir_info->filename, mode);
 		break;
 		/* LCOV_EXCL_STOP */
 	}
 
 	/* Directory Information */
-	dir_info->attrs.mtime = stat_buf.st_mtime;
-	dir_info->attrs.fsize = (mtp_uint64)stat_buf.st_size;
+	dir_info->attrs.mtime = attrs.mtime;
+	dir_info->attrs.fsize = attrs.fsize;
+	dir_info->attrs.dev = attrs.dev;
+	dir_info->attrs.ino = attrs.ino;
 
 	return TRUE;
 }
 
-mtp_bool _util_get_filesystem_info(mtp_char *storepath,
-	fs_info_t *fs_info)
+void _util_ifind_close(mtp_dir_t *dirp)
 {
-	if (!g_strcmp0(storepath, MTP_EXTERNAL_PATH_CHAR)) {
-		struct statfs buf = { 0 };
-		mtp_uint64 avail_size = 0;
-		mtp_uint64 capacity = 0;
-		mtp_uint64 used_size = 0;
+	ret_if(dirp == NULL);
+
+	if (close(dirp->fd) < 0)
+		ERR("close directory fail\n");
+
+	g_free(dirp);
+}
 
-		retvm_if(statfs(storepath, &buf) != 0, FALSE, "statfs is failed\n");
+/* LCOV_EXCL_START */
+typedef struct {
+	mtp_uint32 *num_of_deleted_file;
+	mtp_uint32 *num_of_file;
+	mtp_bool breadonly;
+	gint64 last_report;	/* Monotonic time of the last progress log */
+	remove_cb_t done_cb;
+	void *user_data;
+	mtp_uint32 depth;	/* 0 in the directory being emptied */
+} remove_ctx_t;
+
+static void __report_remove_progress(remove_ctx_t *ctx)
+{
+	gint64 now = g_get_monotonic_time();
 
-		capacity = used_size = avail_size = (mtp_uint64)buf.f_bsize;
-		DBG("Block size : %lu\n", (unsigned long)buf.f_bsize);
-		capacity *= buf.f_blocks;
-		used_size *= (buf.f_blocks - buf.f_bavail);
-		avail_size *= buf.f_bavail;
+	if (now - ctx->last_report < G_USEC_PER_SEC)
+		return;
 
-		fs_info->disk_size = capacity;
-		fs_info->reserved_size = used_size;
-		fs_info->avail_size = avail_size;
+	ctx->last_report = now;
+	DBG("Deleting : [%u] of [%u] entries removed\n",
+			*ctx->num_of_deleted_file, *ctx->num_of_file);
+}
 
-		return TRUE;
+/* Tells the caller a top level entry is gone, or all of it that could */
+static void __report_removed_entry(remove_ctx_t *ctx, const mtp_char *name)
+{
+	if (ctx->depth == 0 && ctx->done_cb)
+		ctx->done_cb(name, ctx->user_data);
+}
+
+/*
+ * Empties the directory open as dir_fd and closes it. Entries are
+ * unlinked relative to their directory, so no path is ever built, and
+ * symbolic links are removed rather than followed.
+ */
+static mtp_int32 __remove_dir_children_at(mtp_int32 dir_fd, remove_ctx_t *ctx)
+{
+	mtp_dir_t *dir = NULL;
+	struct mtp_dirent64 *ent = NULL;
+	struct stat entryinfo = { 0 };
+	mtp_int32 child_fd = -1;
+	mtp_int32 ret = MTP_ERROR_NONE;
+	mtp_int32 result = MTP_ERROR_NONE;
+	mtp_bool is_dir = FALSE;
+
+	dir = (mtp_dir_t *)g_malloc(sizeof(mtp_dir_t));
+	dir->fd = dir_fd;
+	dir->buf_len = 0;
+	dir->buf_pos = 0;
+	dir->error = 0;
+
+	while ((ent = __read_dirent(dir)) != NULL) {
+		if (!g_strcmp0(ent->d_name, ".") || !g_strcmp0(ent->d_name, ".."))
+			continue;
+
+		if (ent->d_type == DT_UNKNOWN) {
+			if (fstatat(dir->fd, ent->d_name, &entryinfo,
+						AT_SYMLINK_NOFOLLOW) != 0) {
+				ERR("Error statting %s errno [%d]\n", ent->d_name, errno);
+				result = MTP_ERROR_GENERAL;
+				break;
+			}
+			is_dir = S_ISDIR(entryinfo.st_mode) ? TRUE : FALSE;
+		} else {
+			is_dir = (ent->d_type == DT_DIR) ? TRUE : FALSE;
+		}
+
+		*ctx->num_of_file += 1;
+		if (is_dir) {
+			child_fd = openat(dir->fd, ent->d_name,
+					O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (child_fd < 0) {
+				ERR("Open directory Fail[%s], errno [%d]\n",
+						ent->d_name, errno);
+				result = (EACCES == errno) ? MTP_ERROR_ACCESS_DENIED :
+					MTP_ERROR_GENERAL;
+				break;
+			}
+
+			ctx->depth++;
+			ret = __remove_dir_children_at(child_fd, ctx);
+			ctx->depth--;
+			if (MTP_ERROR_GENERAL == ret || MTP_ERROR_ACCESS_DENIED == ret) {
+				ERR("deletion fail [%s]\n", ent->d_name);
+				result = ret;
+				break;
+			}
+			if (MTP_ERROR_OBJECT_WRITE_PROTECTED == ret) {
+				DBG("Folder[%s] contains read-only files,hence\
+						folder is not deleted\n", ent->d_name);
+				result = ret;
+				__report_removed_entry(ctx, ent->d_name);
+				continue;
+			}
+			if (unlinkat(dir->fd, ent->d_name, AT_REMOVEDIR) < 0) {
+				ERR("deletion fail [%s], errno [%d]\n", ent->d_name, errno);
+				result = (EACCES == errno) ? MTP_ERROR_ACCESS_DENIED :
+					MTP_ERROR_GENERAL;
+				break;
+			}
+		} else {
+			/* Only during Deleteobject, bReadOnly(TRUE)
+			   do not delete read-only files */
+#ifdef MTP_SUPPORT_SET_PROTECTION
+			if (ctx->breadonly && fstatat(dir->fd, ent->d_name,
+						&entryinfo, AT_SYMLINK_NOFOLLOW) == 0 &&
+					!S_ISLNK(entryinfo.st_mode) &&
+					!((S_IWUSR & entryinfo.st_mode) ||
+						(S_IWGRP & entryinfo.st_mode) ||
+						(S_IWOTH & entryinfo.st_mode))) {
+				DBG("File [%s] is readOnly:Deletion Fail\n", ent->d_name);
+				result = MTP_ERROR_OBJECT_WRITE_PROTECTED;
+				continue;
+			}
+#endif /* MTP_SUPPORT_SET_PROTECTION */
+			if (unlinkat(dir->fd, ent->d_name, 0) < 0) {
+				ERR("deletion fail [%s], errno [%d]\n", ent->d_name, errno);
+				result = (EACCES == errno) ? MTP_ERROR_ACCESS_DENIED :
+					MTP_ERROR_GENERAL;
+				break;
+			}
+		}
+		*ctx->num_of_deleted_file += 1;
+		__report_removed_entry(ctx, ent->d_name);
+		__report_remove_progress(ctx);
+	}
+
+	/* Entries the stream could not list were not removed */
+	if (ent == NULL && dir->error != 0)
+		result = MTP_ERROR_GENERAL;
+
+	_util_ifind_close(dir);
+	return result;
+}
+
+/*
+ * Empties dirname like _util_remove_dir_children_recursive(), calling
+ * done_cb with the name of each of its entries once that entry is
+ * removed, or emptied as far as read-only files allow.
+ */
+mtp_int32 _util_remove_dir_children_notify(const mtp_char *dirname,
+		mtp_uint32 *num_of_deleted_file, mtp_uint32 *num_of_file,
+		mtp_bool breadonly, remove_cb_t done_cb, void *user_data)
+{
+	remove_ctx_t ctx = { 0 };
+	mtp_int32 fd = -1;
+
+	retv_if(dirname == NULL, MTP_ERROR_GENERAL);
+
+	fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		ERR("Open directory Fail[%s], errno [%d]\n", dirname, errno);
+		return MTP_ERROR_GENERAL;
 	}
 
-	return FALSE;
+	ctx.num_of_deleted_file = num_of_deleted_file;
+	ctx.num_of_file = num_of_file;
+	ctx.breadonly = breadonly;
+	ctx.last_report = g_get_monotonic_time();
+	ctx.done_cb = done_cb;
+	ctx.user_data = user_data;
+
+	return __remove_dir_children_at(fd, &ctx);
+}
+
+mtp_int32 _util_remove_dir_children_recursive(const mtp_char *dirname,
+		mtp_uint32 *num_of_deleted_file, mtp_uint32 *num_of_file, mtp_bool breadonly)
+{
+	return _util_remove_dir_children_notify(dirname, num_of_deleted_file,
+			num_of_file, breadonly, NULL, NULL);
+}
+/* LCOV_EXCL_STOP */
+
+mtp_bool _util_get_filesystem_info(mtp_char *storepath,
+	fs_info_t *fs_info)
+{
+	struct statfs buf = { 0 };
+	mtp_uint64 avail_size = 0;
+	mtp_uint64 capacity = 0;
+	mtp_uint64 used_size = 0;
+
+	retv_if(storepath == NULL || fs_info == NULL, FALSE);
+	retvm_if(statfs(storepath, &buf) != 0, FALSE, "statfs is failed\n");
+
+	capacity = used_size = avail_size = (mtp_uint64)buf.f_bsize;
+	DBG("Block size : %lu\n", (unsigned long)buf.f_bsize);
+	capacity *= buf.f_blocks;
+	used_size *= (buf.f_blocks - buf.f_bavail);
+	avail_size *= buf.f_bavail;
+
+	fs_info->disk_size = capacity;
+	fs_info->reserved_size = used_size;
+	fs_info->avail_size = avail_size;
+
+	return TRUE;
 }
 
 /* LCOV_EXCL_START */
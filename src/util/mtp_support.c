@@ -19,9 +19,12 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include "mtp_support.h"
+#include "mtp_utf.h"
 #include "ptp_datacodes.h"
 #include "mtp_util.h"
 
+extern mtp_config_t g_conf;
+
 /*
  * STATIC FUNCTIONS
  */
@@ -69,72 +72,51 @@ void _util_conv_byte_order_gen_str(void *str, mtp_int32 size, mtp_int32 elem_sz)
 /* LCOV_EXCL_STOP */
 
 /*
- * If items_written is greater than or equal to dest_size,
- * src is truncated when it is copied to dest.
+ * Converts src into dest, which holds dest_size bytes, without
+ * allocating. dest is always NUL terminated and a character is never cut
+ * in half. Returns the length in bytes of the whole conversion: if it is
+ * greater than or equal to dest_size, src was truncated. An invalid src
+ * (an unpaired surrogate) gives an empty dest and 0.
  */
 mtp_int32 _util_utf16_to_utf8(char *dest, mtp_int32 dest_size,
 		const mtp_wchar *src)
 {
-	gchar *utf8 = NULL;
-	GError *error = NULL;
-	glong items_read = 0;
-	glong items_written = 0;
-	const gunichar2 *utf16 = (const gunichar2 *)src;
+	mtp_int32 total = 0;
 
 	retv_if(src == NULL, 0);
 	retv_if(dest == NULL, 0);
+	retv_if(dest_size <= 0, 0);
 
-	utf8 = g_utf16_to_utf8(utf16, -1, &items_read, &items_written, &error);
-	if (utf8 == NULL) {
-		/* LCOV_EXCL_START */
-		ERR("%s\n", error->message);
-		g_error_free(error);
+	total = _util_utf16_to_utf8_simd(dest, dest_size, src);
+	if (total == 0 && src[0] != 0)
+		ERR("Invalid UTF-16 string, unpaired surrogate\n");
 
-		dest[0] = '\0';
-		items_written = 0;
-		/* LCOV_EXCL_STOP */
-	} else {
-		g_strlcpy(dest, (char *)utf8, dest_size);
-		g_free(utf8);
-	}
-
-	return (mtp_int32)items_written;
+	return total;
 }
 
 /*
- * If items_written is greater than or equal to dest_items,
- * src is truncated when it is copied to dest.
+ * Converts src into dest, which holds dest_items characters, without
+ * allocating. dest is always NUL terminated and a surrogate pair is never
+ * cut in half. Returns the length in characters of the whole conversion:
+ * if it is greater than or equal to dest_items, src was truncated.
+ * Invalid UTF-8 gives an empty dest and 0.
  */
 mtp_int32 _util_utf8_to_utf16(mtp_wchar *dest, mtp_int32 dest_items,
 		const char *src)
 {
-	GError *error = NULL;
-	glong items_read = 0;
-	gunichar2 *utf16 = NULL;
-	glong items_written = 0;
+	mtp_int32 total = 0;
 
 	retv_if(src == NULL, 0);
 	retv_if(dest == NULL, 0);
+	retv_if(dest_items <= 0, 0);
 
-	utf16 = g_utf8_to_utf16(src, -1, &items_read, &items_written, &error);
-	if (utf16 == NULL) {
-		/* LCOV_EXCL_START */
-		ERR("%s\n", error->message);
-		g_error_free(error);
-		error = NULL;
+	total = _util_utf8_to_utf16_simd(dest, dest_items, src);
+	if (total == 0 && src[0] != '\0')
+		ERR("Invalid UTF-8 string\n");
 
-		dest[0] = (mtp_wchar)'\0';
-		items_written = 0;
-		/* LCOV_EXCL_STOP */
-	} else {
-		_util_wchar_ncpy(dest, utf16, dest_items);
-		g_free(utf16);
-	}
-
-	return (mtp_int32)items_written;
+	return total;
 }
 
-
 /*
  * Copies a unicode string.
  * @param[in]	src	Null-terminated source string
@@ -428,29 +410,23 @@ mtp_bool _util_is_path_len_valid(const mtp_char *path)
 	mtp_uint32 limit = 0;
 	mtp_uint32 mtp_path_len = 0;
 	mtp_uint32 root_path_len = 0;
-
-	static mtp_uint32 max_store_len = 0;
-	static mtp_bool is_initialized = FALSE;
-	static mtp_uint32 external_store_len = 0;
-
-	char ext_path[MTP_MAX_PATHNAME_SIZE + 1] = { 0 };
+	mtp_uint32 max_store_len = 0;
+	mtp_uint32 len = 0;
+	mtp_int32 ii = 0;
 
 	retv_if(path == NULL, FALSE);
 
-	_util_get_external_path(ext_path);
+	for (ii = 0; ii < g_conf.num_storages; ii++) {
+		len = strlen(g_conf.storages[ii].path);
+		max_store_len = MAX(max_store_len, len);
 
-	if (!is_initialized) {
-		is_initialized = TRUE;
-		external_store_len = strlen(ext_path);
-
-		max_store_len = external_store_len;
-
-		DBG("max store len : [%u]\n", max_store_len);
+		if (len > root_path_len &&
+				!strncmp(path, g_conf.storages[ii].path, len) &&
+				(path[len] == '\0' || path[len] == '/'))
+			root_path_len = len;
 	}
 
-	if (!strncmp(path, ext_path, external_store_len)) {
-		root_path_len = external_store_len;
-	} else {
+	if (root_path_len == 0) {
 		ERR("Unknown store's path : %s\n", path);
 		return FALSE;
 	}
@@ -508,34 +484,71 @@ void _util_get_parent_path(const mtp_char *fullpath, mtp_char *p_path)
 	g_strlcpy(p_path, fullpath, (mtp_uint32)(ptr - fullpath) + 1);
 }
 
-void _util_conv_wstr_to_guid(mtp_wchar *wstr, mtp_uint64 *guid)
+/*
+ * SipHash-2-4 with a 128-bit output, keyed with a fixed key so that the
+ * same data gives the same GUID in every session.
+ */
+#define SIP_ROTL(x, b)	(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3) \
+	do { \
+		v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+		v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+	} while (0)
+
+static const mtp_uint64 g_guid_key[2] = {
+	0x7265646e6f707365ULL, 0x722d70746d63ULL	/* "cmtp-responder" */
+};
+
+static mtp_uint64 __read_le64(const mtp_uchar *p, mtp_uint32 len)
 {
-	mtp_uint32 skip_idx;
-	mtp_uint32 cur_idx;
-	mtp_uint64 temp[2];
-	mtp_int32 count = 0;
-	mtp_int32 cpy_sz = 0;
+	mtp_uint64 val = 0;
+	mtp_int32 ii = 0;
 
-	ret_if(wstr == NULL);
-	ret_if(guid == NULL);
+	for (ii = len - 1; ii >= 0; ii--)
+		val = (val << 8) | p[ii];
 
-	while (wstr[count] != 0)
-		count++;
-
-	memset(guid, 0, sizeof(temp));
-	skip_idx = sizeof(temp) / sizeof(mtp_wchar);
-
-	for (cur_idx = 0; cur_idx < count; cur_idx += skip_idx) {
+	return val;
+}
 
-		memset(temp, 0, sizeof(temp));
-		cpy_sz = (count - cur_idx) * sizeof(mtp_wchar);
-		if (cpy_sz > sizeof(temp))
-			cpy_sz = sizeof(temp);
+void _util_get_guid(const void *data, mtp_uint32 size, mtp_uint64 *guid)
+{
+	const mtp_uchar *p = (const mtp_uchar *)data;
+	mtp_uint64 v0 = g_guid_key[0] ^ 0x736f6d6570736575ULL;
+	mtp_uint64 v1 = g_guid_key[1] ^ 0x646f72616e646f6dULL ^ 0xee;
+	mtp_uint64 v2 = g_guid_key[0] ^ 0x6c7967656e657261ULL;
+	mtp_uint64 v3 = g_guid_key[1] ^ 0x7465646279746573ULL;
+	mtp_uint64 m = 0;
+	mtp_uint32 left = size;
+	mtp_int32 ii = 0;
 
-		memcpy(temp, &(wstr[cur_idx]), cpy_sz);
-		guid[0] += temp[0];
-		guid[1] += temp[1];
+	ret_if(guid == NULL);
+	ret_if(data == NULL && size != 0);
+
+	for (; left >= 8; left -= 8, p += 8) {
+		m = __read_le64(p, 8);
+		v3 ^= m;
+		SIP_ROUND(v0, v1, v2, v3);
+		SIP_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
 	}
+
+	m = ((mtp_uint64)size << 56) | __read_le64(p, left);
+	v3 ^= m;
+	SIP_ROUND(v0, v1, v2, v3);
+	SIP_ROUND(v0, v1, v2, v3);
+	v0 ^= m;
+
+	v2 ^= 0xee;
+	for (ii = 0; ii < 4; ii++)
+		SIP_ROUND(v0, v1, v2, v3);
+	guid[0] = v0 ^ v1 ^ v2 ^ v3;
+
+	v1 ^= 0xdd;
+	for (ii = 0; ii < 4; ii++)
+		SIP_ROUND(v0, v1, v2, v3);
+	guid[1] = v0 ^ v1 ^ v2 ^ v3;
 }
 
 mtp_bool _util_get_unique_dir_path(const mtp_char *exist_path,
@@ -88,3 +88,31 @@ void _util_thread_exit(void *val_ptr)
 	pthread_exit(val_ptr);
 }
 /* LCOV_EXCL_STOP */
+
+/*
+ * Called with the store lock just taken, start being the monotonic time
+ * of the request. Long waits are logged with the longest one seen, which
+ * shows how much commands and inotify events hold each other up.
+ */
+void _util_note_lock_wait(const mtp_char *who, mtp_int64 start)
+{
+	/* In ms, readers holding the lock together update it at once */
+	static gint max_wait = 0;
+	mtp_int64 wait = g_get_monotonic_time() - start;
+	gint wait_ms = 0;
+	gint max_ms = 0;
+
+	if (wait < (mtp_int64)MTP_LOCK_WAIT_WARN_MS * 1000)
+		return;
+
+	wait_ms = (gint)MIN(wait / 1000, (mtp_int64)G_MAXINT);
+	do {
+		max_ms = g_atomic_int_get(&max_wait);
+		if (wait_ms <= max_ms)
+			break;
+	} while (!g_atomic_int_compare_and_exchange(&max_wait, max_ms,
+				wait_ms));
+
+	DBG("[%s] waited [%d] ms for the store lock, max [%d] ms\n",
+			who ? who : "", wait_ms, MAX(wait_ms, max_ms));
+}
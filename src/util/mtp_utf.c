@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2019 Collabora Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "mtp_utf.h"
+
+/*
+ * Runs of ASCII are converted 16 bytes at a time with SSE2 or NEON where
+ * available. Blocks are only loaded from 16-byte aligned addresses, so a
+ * block never crosses into a page past the terminating NUL.
+ */
+#if defined(__SSE2__)
+static inline mtp_bool __utf8_ascii_block_to_utf16(const mtp_uchar *src,
+		mtp_wchar *dest)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_load_si128((const __m128i *)src);
+
+	/* A high bit set is a multi-byte sequence, a zero is the end */
+	if (_mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)))
+		return FALSE;
+
+	_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi8(v, zero));
+	_mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi8(v, zero));
+	return TRUE;
+}
+
+static inline mtp_bool __utf16_ascii_block_to_utf8(const mtp_wchar *src,
+		mtp_uchar *dest)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_load_si128((const __m128i *)src);
+	__m128i high = _mm_and_si128(v, _mm_set1_epi16((short)0xFF80));
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF ||
+			_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)))
+		return FALSE;
+
+	_mm_storel_epi64((__m128i *)dest, _mm_packus_epi16(v, v));
+	return TRUE;
+}
+#define UTF_BLOCK_CHARS	16
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static inline mtp_bool __utf8_ascii_block_to_utf16(const mtp_uchar *src,
+		mtp_wchar *dest)
+{
+	uint8x16_t v = vld1q_u8(src);
+
+	if (vmaxvq_u8(v) >= 0x80 || vminvq_u8(v) == 0)
+		return FALSE;
+
+	vst1q_u16(dest, vmovl_u8(vget_low_u8(v)));
+	vst1q_u16(dest + 8, vmovl_u8(vget_high_u8(v)));
+	return TRUE;
+}
+
+static inline mtp_bool __utf16_ascii_block_to_utf8(const mtp_wchar *src,
+		mtp_uchar *dest)
+{
+	uint16x8_t v = vld1q_u16(src);
+
+	if (vmaxvq_u16(v) >= 0x80 || vminvq_u16(v) == 0)
+		return FALSE;
+
+	vst1_u8(dest, vmovn_u16(v));
+	return TRUE;
+}
+#define UTF_BLOCK_CHARS	16
+#else
+#define UTF_BLOCK_CHARS	0
+#endif
+
+#define UTF_IS_BLOCK_ALIGNED(p)	(((uintptr_t)(p) & 15) == 0)
+
+/*
+ * Decodes the UTF-8 sequence at s into *cp and returns its length, or 0
+ * if it is not valid UTF-8: truncated, overlong, a surrogate or past
+ * U+10FFFF. It stops at the first byte that does not fit, so it never
+ * reads past a terminating NUL.
+ */
+static mtp_int32 __utf8_decode(const mtp_uchar *s, mtp_uint32 *cp)
+{
+	mtp_uint32 c = s[0];
+	mtp_uint32 min = 0;
+	mtp_int32 len = 0;
+	mtp_int32 ii = 0;
+
+	if (c < 0x80) {
+		*cp = c;
+		return 1;
+	} else if ((c & 0xE0) == 0xC0) {
+		len = 2;
+		c &= 0x1F;
+		min = 0x80;
+	} else if ((c & 0xF0) == 0xE0) {
+		len = 3;
+		c &= 0x0F;
+		min = 0x800;
+	} else if ((c & 0xF8) == 0xF0) {
+		len = 4;
+		c &= 0x07;
+		min = 0x10000;
+	} else {
+		return 0;
+	}
+
+	for (ii = 1; ii < len; ii++) {
+		if ((s[ii] & 0xC0) != 0x80)
+			return 0;
+		c = (c << 6) | (s[ii] & 0x3F);
+	}
+
+	if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+		return 0;
+
+	*cp = c;
+	return len;
+}
+
+/*
+ * The block path is only taken while nothing has been dropped yet and
+ * the whole block fits, so it never changes what is written or returned;
+ * use_blocks is a constant at every call site and the unused path is
+ * compiled out.
+ */
+static inline mtp_int32 __utf16_to_utf8(char *dest, mtp_int32 dest_size,
+		const mtp_wchar *src, mtp_bool use_blocks)
+{
+	const mtp_wchar *s = src;
+	mtp_uchar *d = (mtp_uchar *)dest;
+	mtp_uchar seq[4];
+	mtp_int32 max = dest_size - 1;
+	mtp_int32 written = 0;
+	mtp_int32 total = 0;
+	mtp_int32 len = 0;
+	mtp_uint32 cp = 0;
+
+	if (src == NULL || dest == NULL || dest_size <= 0)
+		return 0;
+
+	while (*s) {
+#if UTF_BLOCK_CHARS
+		if (use_blocks && written == total && total + 8 <= max &&
+				UTF_IS_BLOCK_ALIGNED(s) &&
+				__utf16_ascii_block_to_utf8(s, d + written)) {
+			s += 8;
+			written += 8;
+			total += 8;
+			continue;
+		}
+#endif
+		cp = *s++;
+		if (cp >= 0xD800 && cp <= 0xDBFF) {
+			if (*s < 0xDC00 || *s > 0xDFFF)
+				goto INVALID;
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (*s++ - 0xDC00);
+		} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+			goto INVALID;
+		}
+
+		if (cp < 0x80) {
+			seq[0] = cp;
+			len = 1;
+		} else if (cp < 0x800) {
+			seq[0] = 0xC0 | (cp >> 6);
+			seq[1] = 0x80 | (cp & 0x3F);
+			len = 2;
+		} else if (cp < 0x10000) {
+			seq[0] = 0xE0 | (cp >> 12);
+			seq[1] = 0x80 | ((cp >> 6) & 0x3F);
+			seq[2] = 0x80 | (cp & 0x3F);
+			len = 3;
+		} else {
+			seq[0] = 0xF0 | (cp >> 18);
+			seq[1] = 0x80 | ((cp >> 12) & 0x3F);
+			seq[2] = 0x80 | ((cp >> 6) & 0x3F);
+			seq[3] = 0x80 | (cp & 0x3F);
+			len = 4;
+		}
+
+		/* Once something did not fit, later characters are only counted */
+		if (written == total && total + len <= max) {
+			memcpy(d + written, seq, len);
+			written += len;
+		}
+		total += len;
+	}
+
+	d[written] = '\0';
+	return total;
+
+INVALID:
+	dest[0] = '\0';
+	return 0;
+}
+
+static inline mtp_int32 __utf8_to_utf16(mtp_wchar *dest, mtp_int32 dest_items,
+		const char *src, mtp_bool use_blocks)
+{
+	const mtp_uchar *s = (const mtp_uchar *)src;
+	mtp_int32 max = dest_items - 1;
+	mtp_int32 written = 0;
+	mtp_int32 total = 0;
+	mtp_int32 units = 0;
+	mtp_int32 len = 0;
+	mtp_uint32 cp = 0;
+
+	if (src == NULL || dest == NULL || dest_items <= 0)
+		return 0;
+
+	while (*s) {
+#if UTF_BLOCK_CHARS
+		if (use_blocks && written == total &&
+				total + UTF_BLOCK_CHARS <= max &&
+				UTF_IS_BLOCK_ALIGNED(s) &&
+				__utf8_ascii_block_to_utf16(s, dest + written)) {
+			s += UTF_BLOCK_CHARS;
+			written += UTF_BLOCK_CHARS;
+			total += UTF_BLOCK_CHARS;
+			continue;
+		}
+#endif
+		len = __utf8_decode(s, &cp);
+		if (len == 0) {
+			dest[0] = (mtp_wchar)'\0';
+			return 0;
+		}
+		s += len;
+		units = (cp < 0x10000) ? 1 : 2;
+
+		/* Once something did not fit, later characters are only counted */
+		if (written == total && total + units <= max) {
+			if (units == 1) {
+				dest[written] = (mtp_wchar)cp;
+			} else {
+				cp -= 0x10000;
+				dest[written] = (mtp_wchar)(0xD800 | (cp >> 10));
+				dest[written + 1] = (mtp_wchar)(0xDC00 | (cp & 0x3FF));
+			}
+			written += units;
+		}
+		total += units;
+	}
+
+	dest[written] = (mtp_wchar)'\0';
+	return total;
+}
+
+mtp_int32 _util_utf16_to_utf8_scalar(char *dest, mtp_int32 dest_size,
+		const mtp_wchar *src)
+{
+	return __utf16_to_utf8(dest, dest_size, src, FALSE);
+}
+
+mtp_int32 _util_utf16_to_utf8_simd(char *dest, mtp_int32 dest_size,
+		const mtp_wchar *src)
+{
+	return __utf16_to_utf8(dest, dest_size, src, TRUE);
+}
+
+mtp_int32 _util_utf8_to_utf16_scalar(mtp_wchar *dest, mtp_int32 dest_items,
+		const char *src)
+{
+	return __utf8_to_utf16(dest, dest_items, src, FALSE);
+}
+
+mtp_int32 _util_utf8_to_utf16_simd(mtp_wchar *dest, mtp_int32 dest_items,
+		const char *src)
+{
+	return __utf8_to_utf16(dest, dest_items, src, TRUE);
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2019 Collabora Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that the _simd UTF-8/UTF-16 converters give the same dest
+ * contents and return values as the _scalar ones, and that a truncated
+ * conversion never ends in part of a character.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mtp_utf.h"
+
+#define TEST_MAX_ITEMS	256
+#define TEST_GUARD	32
+#define TEST_POISON	0xA5
+
+static const char *g_utf8_cases[] = {
+	"",
+	"a",
+	"Hello",
+	"abcdefghijklmno",
+	"abcdefghijklmnop",
+	"abcdefghijklmnopq",
+	"abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ!#",
+	"DCIM/Camera/IMG_20190101_120000.jpg",
+	"caf\xC3\xA9",				/* 2 bytes */
+	"\xC3\xA9t\xC3\xA9",
+	"price_\xE2\x82\xAC_100",		/* 3 bytes */
+	"\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E",
+	"smile_\xF0\x9F\x98\x80.png",		/* 4 bytes, a surrogate pair */
+	"\xF0\x9F\x98\x80\xF0\x9F\x98\x81\xF0\x9F\x98\x82",
+	"\xF4\x8F\xBF\xBF",			/* U+10FFFF */
+	"\xEF\xBF\xBF\xEE\x80\x80",		/* U+FFFF, U+E000 */
+	"abcdefghijklmno\xC3\xA9pqrstuvwxyz0123456789",
+	"abcdefghijklmnop\xE2\x82\xACqrstuvwxyz0123456789abcdef",
+	"abcdefghijklmnopqrstuvwxyz01234\xF0\x9F\x98\x80" "56789abcdefghijklmno",
+	/* Invalid */
+	"\x80",
+	"abc\xBF" "def",
+	"\xC0\x80",				/* overlong NUL */
+	"\xC1\xBF",
+	"\xE0\x80\x80",
+	"\xE0\x9F\xBF",
+	"\xF0\x80\x80\x80",
+	"\xF0\x8F\xBF\xBF",
+	"\xED\xA0\x80",				/* encoded surrogate */
+	"\xED\xBF\xBF",
+	"\xF4\x90\x80\x80",			/* past U+10FFFF */
+	"\xF8\x88\x80\x80\x80",
+	"\xFF",
+	"\xE2\x82",				/* truncated */
+	"abcdefghijklmnopqrstuvwxyz\xF0\x9F\x98",
+	"abcdefghijklmnopqrstuvwxyz\xC3",
+	"\xC3" "abcdefghijklmnopqrstuvwxyz",
+};
+
+static const mtp_wchar g_utf16_cases[][40] = {
+	{ 0 },
+	{ 'a', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+		'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y',
+		'z', 0 },
+	{ 'c', 'a', 'f', 0xE9, 0 },			/* 2 bytes */
+	{ 0x7F, 0x80, 0x7FF, 0x800, 0 },
+	{ 'p', 0x20AC, '1', '0', '0', 0 },		/* 3 bytes */
+	{ 0x65E5, 0x672C, 0x8A9E, 0xFFFF, 0xE000, 0 },
+	{ 's', 0xD83D, 0xDE00, '.', 'p', 'n', 'g', 0 },	/* 4 bytes */
+	{ 0xD83D, 0xDE00, 0xD83D, 0xDE01, 0xDBFF, 0xDFFF, 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 0xE9, 'h', 'i', 'j', 'k', 'l',
+		'm', 'n', 'o', 'p', 'q', 'r', 's', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0xD83D, 0xDE00, 'i', 'j',
+		'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 0 },
+	/* Lone surrogates */
+	{ 0xD83D, 0 },
+	{ 0xDE00, 0 },
+	{ 0xD83D, 'a', 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 0xDE00, 0 },
+	{ 0xD83D, 0xD83D, 0xDE00, 0 },
+	{ 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+		'n', 'o', 'p', 0xDBFF, 0 },
+};
+
+static mtp_int32 g_failures;
+
+static void __fail(const char *what, mtp_int32 id, mtp_int32 offset,
+		mtp_int32 size, const char *msg)
+{
+	fprintf(stderr, "FAIL %s case %d offset %d size %d: %s\n", what, id,
+			offset, size, msg);
+	g_failures++;
+}
+
+static mtp_bool __is_poisoned(const mtp_uchar *buf, mtp_int32 len)
+{
+	mtp_int32 ii = 0;
+
+	for (ii = 0; ii < len; ii++) {
+		if (buf[ii] != TEST_POISON)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static mtp_int32 __get_utf8_len(mtp_uchar lead)
+{
+	if (lead < 0x80)
+		return 1;
+	else if (lead < 0xE0)
+		return 2;
+	else if (lead < 0xF0)
+		return 3;
+	return 4;
+}
+
+/*
+ * src is copied to every offset from a 16-byte boundary, as the vector
+ * path depends on the source alignment, and converted into every dest
+ * size up to one past the full length.
+ */
+static void __test_utf8_to_utf16(mtp_int32 id, const char *src)
+{
+	static char src_buf[TEST_MAX_ITEMS + 16] __attribute__((aligned(16)));
+	mtp_wchar full[TEST_MAX_ITEMS];
+	mtp_wchar vec[TEST_MAX_ITEMS + TEST_GUARD];
+	mtp_wchar ref[TEST_MAX_ITEMS + TEST_GUARD];
+	mtp_int32 full_len = 0;
+	mtp_int32 ret_vec = 0;
+	mtp_int32 ret_ref = 0;
+	mtp_int32 offset = 0;
+	mtp_int32 size = 0;
+	mtp_int32 len = 0;
+	mtp_int32 units = 0;
+
+	full_len = _util_utf8_to_utf16_scalar(full, TEST_MAX_ITEMS, src);
+
+	for (offset = 0; offset < 16; offset++) {
+		strcpy(src_buf + offset, src);
+
+		for (size = 1; size <= full_len + 2; size++) {
+			memset(vec, TEST_POISON, sizeof(vec));
+			memset(ref, TEST_POISON, sizeof(ref));
+
+			ret_vec = _util_utf8_to_utf16_simd(vec, size, src_buf + offset);
+			ret_ref = _util_utf8_to_utf16_scalar(ref, size, src_buf + offset);
+
+			if (ret_vec != ret_ref)
+				__fail("utf8", id, offset, size, "return values differ");
+			if (memcmp(vec, ref, sizeof(vec)))
+				__fail("utf8", id, offset, size, "dest differs");
+			if (ret_ref != full_len)
+				__fail("utf8", id, offset, size, "return is not the full length");
+			if (!__is_poisoned((mtp_uchar *)(vec + size),
+						TEST_GUARD * sizeof(mtp_wchar)))
+				__fail("utf8", id, offset, size, "wrote past dest_items");
+
+			for (len = 0; len < size && vec[len]; len++)
+				;
+			if (len == size) {
+				__fail("utf8", id, offset, size, "not NUL terminated");
+				continue;
+			}
+			if (memcmp(vec, full, len * sizeof(mtp_wchar)))
+				__fail("utf8", id, offset, size, "not a prefix");
+			if (len > 0 && vec[len - 1] >= 0xD800 && vec[len - 1] <= 0xDBFF)
+				__fail("utf8", id, offset, size, "surrogate pair split");
+			if (len < full_len) {
+				units = (full[len] >= 0xD800 && full[len] <= 0xDBFF) ? 2 : 1;
+				if (len + units <= size - 1)
+					__fail("utf8", id, offset, size, "stopped early");
+			}
+		}
+	}
+}
+
+static void __test_utf16_to_utf8(mtp_int32 id, const mtp_wchar *src)
+{
+	static mtp_wchar src_buf[TEST_MAX_ITEMS + 8] __attribute__((aligned(16)));
+	char full[TEST_MAX_ITEMS];
+	char vec[TEST_MAX_ITEMS + TEST_GUARD];
+	char ref[TEST_MAX_ITEMS + TEST_GUARD];
+	mtp_int32 full_len = 0;
+	mtp_int32 ret_vec = 0;
+	mtp_int32 ret_ref = 0;
+	mtp_int32 offset = 0;
+	mtp_int32 size = 0;
+	mtp_int32 len = 0;
+	mtp_int32 ii = 0;
+
+	full_len = _util_utf16_to_utf8_scalar(full, TEST_MAX_ITEMS, src);
+
+	for (offset = 0; offset < 8; offset++) {
+		for (ii = 0; src[ii]; ii++)
+			src_buf[offset + ii] = src[ii];
+		src_buf[offset + ii] = 0;
+
+		for (size = 1; size <= full_len + 4; size++) {
+			memset(vec, TEST_POISON, sizeof(vec));
+			memset(ref, TEST_POISON, sizeof(ref));
+
+			ret_vec = _util_utf16_to_utf8_simd(vec, size, src_buf + offset);
+			ret_ref = _util_utf16_to_utf8_scalar(ref, size, src_buf + offset);
+
+			if (ret_vec != ret_ref)
+				__fail("utf16", id, offset, size, "return values differ");
+			if (memcmp(vec, ref, sizeof(vec)))
+				__fail("utf16", id, offset, size, "dest differs");
+			if (ret_ref != full_len)
+				__fail("utf16", id, offset, size, "return is not the full length");
+			if (!__is_poisoned((mtp_uchar *)vec + size, TEST_GUARD))
+				__fail("utf16", id, offset, size, "wrote past dest_size");
+
+			len = strnlen(vec, size);
+			if (len == size) {
+				__fail("utf16", id, offset, size, "not NUL terminated");
+				continue;
+			}
+			if (memcmp(vec, full, len))
+				__fail("utf16", id, offset, size, "not a prefix");
+			if (len < full_len && ((mtp_uchar)full[len] & 0xC0) == 0x80)
+				__fail("utf16", id, offset, size, "character split");
+			if (len < full_len && len + __get_utf8_len(full[len]) <= size - 1)
+				__fail("utf16", id, offset, size, "stopped early");
+		}
+	}
+}
+
+int main(void)
+{
+	mtp_int32 ii = 0;
+
+	for (ii = 0; ii < sizeof(g_utf8_cases) / sizeof(g_utf8_cases[0]); ii++)
+		__test_utf8_to_utf16(ii, g_utf8_cases[ii]);
+
+	for (ii = 0; ii < sizeof(g_utf16_cases) / sizeof(g_utf16_cases[0]); ii++)
+		__test_utf16_to_utf8(ii, g_utf16_cases[ii]);
+
+	if (g_failures)
+		fprintf(stderr, "%d failures\n", g_failures);
+
+	return g_failures ? 1 : 0;
+}